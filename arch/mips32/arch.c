@@ -22,4 +22,10 @@ volatile unsigned int kernel_sp = 0x81000000;
 
 unsigned int get_phymm_size() {
     return MACHINE_MMSIZE;
-}
\ No newline at end of file
+}
+
+unsigned int get_gp() {
+    unsigned int gp;
+    asm volatile("la %0, _gp\n\t" : "=r"(gp));
+    return gp;
+}
@@ -45,5 +45,6 @@ extern volatile unsigned int kernel_sp;
 //  [31]:  Interrupt enable(RW)
 
 unsigned int get_phymm_size();
+unsigned int get_gp();
 
 #endif
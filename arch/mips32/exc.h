@@ -12,9 +12,8 @@ typedef void (*exc_fn)(unsigned int, unsigned int, context*);
 
 extern exc_fn exceptions[32];
 
-void do_exceptions(unsigned int status, unsigned int cause, context* pt_context, unsigned int bad_addr);
+void do_exceptions(unsigned int status, unsigned int cause, context* pt_context);
 void register_exception_handler(int index, exc_fn fn);
 void init_exception();
-void tlb_refill(unsigned int bad_addr);
-void refill_after(pgd_t* pgd);
+void tlb_fault(int index, unsigned int bad_addr, context* pt_context);
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "intr.h"
 #include "arch.h"
+#include "irqsoff.h"
+#include <zjunix/preempt.h>
 
 #pragma GCC push_options
 #pragma GCC optimize("O0")
@@ -20,6 +22,13 @@ void init_interrupts() {
 
 int enable_interrupts() {
     int old = 0;
+#ifdef IRQSOFF_TRACE
+    unsigned int status;
+    asm volatile("mfc0 %0, $12\n\t" : "=r"(status));
+    // inside an exception handler EXL keeps interrupts masked
+    if ((status & 3) == 0)
+        irqsoff_end();
+#endif  // IRQSOFF_TRACE
     asm volatile(
         "mfc0 $t0, $12\n\t"
         "andi %0, $t0, 0x1\n\t"
@@ -38,18 +47,31 @@ int disable_interrupts() {
         "and $t0, $t0, $t1\n\t"
         "mtc0 $t0, $12"
         : "=r"(old));
+#ifdef IRQSOFF_TRACE
+    if (old)
+        irqsoff_begin((unsigned int)__builtin_return_address(0), IRQSOFF_DISABLE);
+#endif  // IRQSOFF_TRACE
     return old;
 }
 
 void do_interrupts(unsigned int status, unsigned int cause, context* pt_context) {
     int i;
     int index = cause >> 8;
+    irqsoff_begin(index & 0xff, IRQSOFF_IRQ);
+    preempt_count += HARDIRQ_OFFSET;
     for (i = 0; i < 8; i++) {
         if ((index & 1) && interrupts[i] != 0) {
             interrupts[i](status, cause, pt_context);
         }
         index >>= 1;
     }
+    preempt_count -= HARDIRQ_OFFSET;
+    // a woken real-time task or a deferred tick reschedules before returning
+    // from the interrupt, unless the interrupted code disabled preemption
+    if (need_resched && preemptible()) {
+        pc_resched(pt_context);
+    }
+    irqsoff_exc_return();
 }
 
 void register_interrupt_handler(int index, intr_fn fn) {
@@ -63,4 +85,54 @@ void register_interrupt_handler(int index, intr_fn fn) {
         : "=r"(index));
 }
 
+// Timer interrupt (7) fires when count == compare
+void init_timer(unsigned int interval) {
+    asm volatile(
+        "mtc0 %0, $11\n\t"
+        "mtc0 $zero, $9"
+        :
+        : "r"(interval));
+}
+
+// Restart the current timer period, acknowledges the timer interrupt
+void reset_timer() {
+    asm volatile("mtc0 $zero, $9\n\t");
+}
+
+// Software interrupt 0 (Cause.IP0) requests a reschedule from process context;
+// it is taken as soon as interrupts are enabled
+void raise_soft_irq() {
+    asm volatile(
+        "mfc0  $t0, $13\n\t"
+        "ori   $t0, $t0, 0x100\n\t"
+        "mtc0  $t0, $13\n\t"
+        :
+        :
+        : "$t0");
+}
+
+void clear_soft_irq() {
+    asm volatile(
+        "mfc0  $t0, $13\n\t"
+        "li    $t1, 0xfffffeff\n\t"
+        "and   $t0, $t0, $t1\n\t"
+        "mtc0  $t0, $13\n\t"
+        :
+        :
+        : "$t0", "$t1");
+}
+
+// Set Status.EXL: interrupts stay masked until the next eret clears it
+void set_exl() {
+    asm volatile(
+        "mfc0  $t0, $12\n\t"
+        "ori   $t0, $t0, 0x02\n\t"
+        "mtc0  $t0, $12\n\t"
+        "nop\n\t"
+        "nop\n\t"
+        :
+        :
+        : "$t0");
+}
+
 #pragma GCC pop_options
\ No newline at end of file
@@ -12,5 +12,10 @@ int enable_interrupts();
 int disable_interrupts();
 void do_interrupts(unsigned int status, unsigned int cause, context* pt_context);
 void register_interrupt_handler(int index, intr_fn fn);
+void init_timer(unsigned int interval);
+void reset_timer();
+void set_exl();
+void raise_soft_irq();
+void clear_soft_irq();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "irqsoff.h"
+#include "intr.h"
+#include <driver/vga.h>
+#include <zjunix/time.h>
+
+#ifdef IRQSOFF_TRACE
+// all of the state below is only touched with interrupts masked
+static struct irqsoff_site irqsoff_sites[IRQSOFF_SITES];
+static int irqsoff_nr_sites = 0;
+static int irqsoff_open = 0;
+static unsigned int irqsoff_start;
+static unsigned int irqsoff_cur_site;
+static int irqsoff_cur_type;
+static unsigned int irqsoff_windows = 0;
+
+// Interrupts have just been masked
+void irqsoff_begin(unsigned int site, int type) {
+    if (irqsoff_open)
+        return;
+    irqsoff_open = 1;
+    irqsoff_cur_site = site;
+    irqsoff_cur_type = type;
+    irqsoff_start = get_cycles();
+}
+
+// Keep the longest window per site; a new site replaces the site with the
+// shortest maximum once the table is full
+static void irqsoff_record(unsigned int cycles) {
+    struct irqsoff_site *s;
+    struct irqsoff_site *min = 0;
+    int i;
+
+    irqsoff_windows++;
+    for (i = 0; i < irqsoff_nr_sites; i++) {
+        s = &irqsoff_sites[i];
+        if (s->site == irqsoff_cur_site && s->type == irqsoff_cur_type) {
+            s->count++;
+            if (cycles > s->max)
+                s->max = cycles;
+            return;
+        }
+        if (min == 0 || s->max < min->max)
+            min = s;
+    }
+    if (irqsoff_nr_sites < IRQSOFF_SITES)
+        s = &irqsoff_sites[irqsoff_nr_sites++];
+    else if (cycles > min->max)
+        s = min;
+    else
+        return;
+    s->site = irqsoff_cur_site;
+    s->type = irqsoff_cur_type;
+    s->count = 1;
+    s->max = cycles;
+}
+
+// Interrupts are about to be unmasked
+void irqsoff_end() {
+    if (!irqsoff_open)
+        return;
+    irqsoff_open = 0;
+    irqsoff_record(get_cycles() - irqsoff_start);
+}
+
+// Leaving an exception handler: eret unmasks interrupts if IE is set
+void irqsoff_exc_return() {
+    unsigned int status;
+
+    asm volatile("mfc0 %0, $12\n\t" : "=r"(status));
+    if (status & 1)
+        irqsoff_end();
+}
+#endif  // IRQSOFF_TRACE
+
+// Print the sites with the longest interrupts-off windows. Call sites are
+// return addresses, look them up in kernel.map.
+void print_irqsoff() {
+#ifdef IRQSOFF_TRACE
+    // the shell stack is small, keep the snapshot in .bss
+    static struct irqsoff_site top[IRQSOFF_SITES];
+    struct irqsoff_site tmp;
+    unsigned int windows;
+    int old_ie;
+    int n, i, j;
+
+    old_ie = disable_interrupts();
+    n = irqsoff_nr_sites;
+    for (i = 0; i < n; i++)
+        top[i] = irqsoff_sites[i];
+    windows = irqsoff_windows;
+    if (old_ie)
+        enable_interrupts();
+
+    for (i = 1; i < n; i++) {
+        tmp = top[i];
+        for (j = i; j > 0 && top[j - 1].max < tmp.max; j--)
+            top[j] = top[j - 1];
+        top[j] = tmp;
+    }
+    if (n > IRQSOFF_TOP)
+        n = IRQSOFF_TOP;
+
+    kernel_printf("irqs-off windows: %d\n", windows);
+    kernel_printf("MAX(us)\tCOUNT\tSITE\n");
+    for (i = 0; i < n; i++) {
+        kernel_printf("%d\t%d\t", top[i].max / (CYCLES_PER_SEC / 1000000), top[i].count);
+        if (top[i].type == IRQSOFF_DISABLE)
+            kernel_printf("disable_interrupts() from %x\n", top[i].site);
+        else if (top[i].type == IRQSOFF_IRQ)
+            kernel_printf("interrupt, lines %x\n", top[i].site);
+        else
+            kernel_printf("exception %d\n", top[i].site);
+    }
+#else
+    kernel_printf("irqs-off tracer is not compiled in, define IRQSOFF_TRACE in config/debug.h\n");
+#endif  // IRQSOFF_TRACE
+}
+
+void reset_irqsoff() {
+#ifdef IRQSOFF_TRACE
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    irqsoff_nr_sites = 0;
+    irqsoff_windows = 0;
+    if (old_ie)
+        enable_interrupts();
+#endif  // IRQSOFF_TRACE
+}
@@ -0,0 +1,35 @@
+#ifndef _IRQSOFF_H
+#define _IRQSOFF_H
+
+// Interrupts-off latency tracer, built when IRQSOFF_TRACE is defined in
+// config/debug.h. A window opens when disable_interrupts() clears IE or an
+// exception is taken, and closes when interrupts can be taken again.
+
+#define IRQSOFF_SITES 32    // distinct sites remembered
+#define IRQSOFF_TOP 10      // sites shown by print_irqsoff()
+
+#define IRQSOFF_DISABLE 0   // site is the caller of disable_interrupts()
+#define IRQSOFF_IRQ 1       // site is the pending interrupt lines (Cause.IP)
+#define IRQSOFF_EXC 2       // site is the exception code (Cause.ExcCode)
+
+struct irqsoff_site {
+    unsigned int site;
+    int type;
+    unsigned int count;     // windows opened here
+    unsigned int max;       // longest window, in CP0 cycles
+};
+
+#ifdef IRQSOFF_TRACE
+void irqsoff_begin(unsigned int site, int type);
+void irqsoff_end();
+void irqsoff_exc_return();
+#else
+#define irqsoff_begin(site, type) do {} while (0)
+#define irqsoff_end() do {} while (0)
+#define irqsoff_exc_return() do {} while (0)
+#endif  // IRQSOFF_TRACE
+
+void print_irqsoff();
+void reset_irqsoff();
+
+#endif  // ! _IRQSOFF_H
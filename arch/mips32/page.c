@@ -1,4 +1,5 @@
 #include "page.h"
+#include <zjunix/page.h>
 #include <zjunix/utils.h>
 #include "arch.h"
 
@@ -24,6 +25,8 @@ void init_pgtable() {
         "bne $v0, $v1, init_pgtable_L1\n\t"
         "tlbwi\n\t"
         "nop");
+    // nothing is mapped until a task with an address space runs
+    pgd_init(swapper_pg_dir);
 }
 
 #pragma GCC pop_options
\ No newline at end of file
@@ -4,6 +4,8 @@
 .extern kernel_sp
 .extern exception_handler
 .extern interrupt_handler
+.extern pgd_current
+.extern tlb_refills
 
 .set noreorder
 .set noat
@@ -11,19 +13,38 @@
 
 exception:
 	#TLB refill
- 	mfc0 $k0, $4
- 	lw $k1, 0($k0)
- 	mtc0 $k1, $2
- 	lw $k1, 4($k0)
- 	mtc0 $k1, $3
- 	lw $k1, 8($k0)
- 	mtc0 $k1, $10
- 	lw $k1, 12($k0)
- 	mtc0 $k1, $5
- 	nop #	CP0 hazard
- 	nop #  	CP0 hazard
- 	tlbwr
- 	eret
+	#Context[22:4] = BadVAddr[31:13]: bits 22:13 index pgd_current,
+	#bits 12:4 select the even/odd pte pair in the page table.
+	#The low byte of the pgd entry is the region's PageMask >> 13; tables
+	#of large-page regions repeat each TLB entry's pair throughout it.
+	#Invalid ptes are loaded as they are; the retried access then raises
+	#TLBL/TLBS through the general vector and do_exceptions handles it.
+	mfc0 $k0, $4
+	lui $k1, %hi(pgd_current)
+	lw $k1, %lo(pgd_current)($k1)
+	srl $k0, $k0, 11
+	andi $k0, $k0, 0xffc
+	addu $k1, $k1, $k0
+	lw $k1, 0($k1)			# page table | PageMask >> 13
+	andi $k0, $k1, 0xff
+	xor $k1, $k1, $k0
+	sll $k0, $k0, 13
+	mtc0 $k0, $5			# PageMask
+	mfc0 $k0, $4
+	srl $k0, $k0, 1
+	andi $k0, $k0, 0xff8
+	addu $k1, $k1, $k0
+	lw $k0, 0($k1)			# even pte
+	lw $k1, 4($k1)			# odd pte
+	mtc0 $k0, $2
+	mtc0 $k1, $3
+	#Count the miss; this also covers the EntryLo -> tlbwr hazard
+	lui $k0, %hi(tlb_refills)
+	lw $k1, %lo(tlb_refills)($k0)
+	addiu $k1, $k1, 1
+	sw $k1, %lo(tlb_refills)($k0)
+	tlbwr
+	eret
 
 .org 0x0180
 	lui $k0, 0x8000
@@ -23,4 +23,7 @@
 // #define FS_DEBUG
 
 // exec
-// #define EXEC_DEBUG
\ No newline at end of file
+// #define EXEC_DEBUG
+
+// irqs-off latency tracer: longest interrupts-off windows, shown by "irqsoff"
+// #define IRQSOFF_TRACE
\ No newline at end of file
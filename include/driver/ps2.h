@@ -8,5 +8,6 @@ void init_ps2();
 void ps2_handler(unsigned int status, unsigned int cause, context* pt_context);
 int kernel_getkey();
 int kernel_getchar();
+unsigned int ps2_key_stamp();
 
 #endif // ! _DRIVER_PS2
\ No newline at end of file
@@ -1,10 +1,34 @@
 #ifndef _DRIVER_SD_H
 #define _DRIVER_SD_H
 
+#include <zjunix/coroutine.h>
+
 #define SECSIZE 512
 typedef unsigned long u32;
 
+// One-sector transfer for coroutines: sd_submit() queues it, the SD
+// coroutine performs it without blocking the executor, then sets done and
+// wakes req->wait
+struct sd_request {
+    int write;
+    unsigned long addr;
+    unsigned char *buf;
+    int result;                 // 0 on success
+    volatile int done;
+    struct co_waitq wait;
+    struct list_head list;
+};
+
 u32 sd_read_block(unsigned char *buf, unsigned long addr, unsigned long count);
 u32 sd_write_block(unsigned char *buf, unsigned long addr, unsigned long count);
+void sd_request_init(struct sd_request *req, int write, unsigned long addr, unsigned char *buf);
+void sd_submit(struct sd_request *req);
+
+// Await an sd_request from a coroutine
+#define CO_AWAIT_SD(co, req)                            \
+    do {                                                \
+        sd_submit(req);                                 \
+        CO_WAIT_EVENT(co, &(req)->wait, (req)->done);   \
+    } while (0)
 
 #endif  // ! _DRIVER_SD_H
\ No newline at end of file
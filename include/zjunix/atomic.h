@@ -0,0 +1,123 @@
+#ifndef _ZJUNIX_ATOMIC_H
+#define _ZJUNIX_ATOMIC_H
+
+// Atomic operations on aligned 32-bit words, built on ll/sc.
+// An interrupt between ll and sc clears LLbit (eret), so the sc fails and
+// the sequence is retried; no Status accesses are needed.
+// Host builds (tools/schedsim) use the GCC __sync builtins instead.
+
+typedef struct {
+    volatile int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i) { (i) }
+
+#define atomic_read(v) ((v)->counter)
+#define atomic_set(v, i) ((v)->counter = (i))
+
+// Add i to *p, return the old value
+static inline unsigned int atomic_fetch_add(volatile unsigned int *p, unsigned int i) {
+#ifdef __mips__
+    unsigned int old, tmp;
+    asm volatile(
+        "1:\tll\t%0, %2\n\t"
+        "addu\t%1, %0, %3\n\t"
+        "sc\t%1, %2\n\t"
+        "beqz\t%1, 1b\n\t"
+        : "=&r"(old), "=&r"(tmp), "+m"(*p)
+        : "r"(i)
+        : "memory");
+    return old;
+#else
+    return __sync_fetch_and_add(p, i);
+#endif
+}
+
+// *p |= mask, return the old value
+static inline unsigned int atomic_fetch_or(volatile unsigned int *p, unsigned int mask) {
+#ifdef __mips__
+    unsigned int old, tmp;
+    asm volatile(
+        "1:\tll\t%0, %2\n\t"
+        "or\t%1, %0, %3\n\t"
+        "sc\t%1, %2\n\t"
+        "beqz\t%1, 1b\n\t"
+        : "=&r"(old), "=&r"(tmp), "+m"(*p)
+        : "r"(mask)
+        : "memory");
+    return old;
+#else
+    return __sync_fetch_and_or(p, mask);
+#endif
+}
+
+// *p &= mask, return the old value
+static inline unsigned int atomic_fetch_and(volatile unsigned int *p, unsigned int mask) {
+#ifdef __mips__
+    unsigned int old, tmp;
+    asm volatile(
+        "1:\tll\t%0, %2\n\t"
+        "and\t%1, %0, %3\n\t"
+        "sc\t%1, %2\n\t"
+        "beqz\t%1, 1b\n\t"
+        : "=&r"(old), "=&r"(tmp), "+m"(*p)
+        : "r"(mask)
+        : "memory");
+    return old;
+#else
+    return __sync_fetch_and_and(p, mask);
+#endif
+}
+
+// Store new into *p if it still holds old; return the value found
+static inline unsigned int cmpxchg(volatile unsigned int *p, unsigned int old, unsigned int new) {
+#ifdef __mips__
+    unsigned int prev, tmp;
+    asm volatile(
+        "1:\tll\t%0, %2\n\t"
+        "bne\t%0, %3, 2f\n\t"
+        "move\t%1, %4\n\t"
+        "sc\t%1, %2\n\t"
+        "beqz\t%1, 1b\n"
+        "2:\n\t"
+        : "=&r"(prev), "=&r"(tmp), "+m"(*p)
+        : "r"(old), "r"(new)
+        : "memory");
+    return prev;
+#else
+    return __sync_val_compare_and_swap(p, old, new);
+#endif
+}
+
+static inline int atomic_add_return(int i, atomic_t *v) {
+    return (int)atomic_fetch_add((volatile unsigned int *)&(v->counter), (unsigned int)i) + i;
+}
+
+#define atomic_add(i, v) ((void)atomic_add_return((i), (v)))
+#define atomic_sub(i, v) ((void)atomic_add_return(-(i), (v)))
+#define atomic_inc(v) ((void)atomic_add_return(1, (v)))
+#define atomic_dec(v) ((void)atomic_add_return(-1, (v)))
+#define atomic_inc_return(v) atomic_add_return(1, (v))
+#define atomic_dec_return(v) atomic_add_return(-1, (v))
+// 1 if the counter dropped to 0, e.g. the last reference went away
+#define atomic_dec_and_test(v) (atomic_add_return(-1, (v)) == 0)
+
+// Bit nr of the word array at addr, bit 0 is the least significant bit of addr[0]
+static inline void set_bit(int nr, volatile unsigned int *addr) {
+    atomic_fetch_or(addr + (nr >> 5), 1u << (nr & 31));
+}
+
+static inline void clear_bit(int nr, volatile unsigned int *addr) {
+    atomic_fetch_and(addr + (nr >> 5), ~(1u << (nr & 31)));
+}
+
+// Return the old value of the bit
+static inline int test_and_set_bit(int nr, volatile unsigned int *addr) {
+    return (atomic_fetch_or(addr + (nr >> 5), 1u << (nr & 31)) >> (nr & 31)) & 1;
+}
+
+static inline int test_and_clear_bit(int nr, volatile unsigned int *addr) {
+    return (atomic_fetch_and(addr + (nr >> 5), ~(1u << (nr & 31))) >> (nr & 31)) & 1;
+}
+
+#endif  // ! _ZJUNIX_ATOMIC_H
@@ -0,0 +1,20 @@
+#ifndef _ZJUNIX_BITOPS_H
+#define _ZJUNIX_BITOPS_H
+
+// Count leading zeros, clz(0) == 32
+static inline int clz(unsigned int x) {
+#ifdef __mips__
+    int n;
+    asm("clz %0, %1" : "=r"(n) : "r"(x));
+    return n;
+#else
+    return x ? __builtin_clz(x) : 32;
+#endif
+}
+
+// Index of the most significant set bit, -1 if x == 0
+static inline int fls_index(unsigned int x) {
+    return 31 - clz(x);
+}
+
+#endif  // ! _ZJUNIX_BITOPS_H
@@ -3,6 +3,7 @@
 
 #include <zjunix/list.h>
 #include <zjunix/lock.h>
+#include <zjunix/atomic.h>
 
 #define _PAGE_RESERVED (1 << 31)
 #define _PAGE_ALLOCED (1 << 30)
@@ -13,7 +14,7 @@
  */
 struct page {
     unsigned int flag;       // the declaration of the usage of this page
-    unsigned int reference;  //
+    unsigned int reference;  // mappings of the page, changed with inc_ref()/dec_ref()
     struct list_head list;   // double-way list
     void *virtual;           // default 0x(-1)
     unsigned int bplevel;    /* the order level of the page
@@ -31,9 +32,10 @@ struct page {
 /*
  * order means the size of the set of pages, e.g. order = 1 -> 2^1
  * pages(consequent) are free In current system, we allow the max order to be
- * 4(2^4 consequent free pages)
+ * 8(2^8 consequent free pages), the largest TLB page user mappings use
+ * A block of order n is aligned to 2^n pages physically as well
  */
-#define MAX_BUDDY_ORDER 4
+#define MAX_BUDDY_ORDER 8
 
 struct freelist {
     unsigned int nr_free;
@@ -58,8 +60,10 @@ struct buddy_sys {
 #define has_flag(page, val) ((*(page)).flag & val)
 
 #define set_ref(page, val) ((*(page)).reference = (val))
-#define inc_ref(page, val) ((*(page)).reference += (val))
-#define dec_ref(page, val) ((*(page)).reference -= (val))
+#define inc_ref(page, val) atomic_fetch_add(&((*(page)).reference), (val))
+#define dec_ref(page, val) atomic_fetch_add(&((*(page)).reference), -(val))
+// 1 if this dropped the last reference
+#define put_ref(page) (atomic_fetch_add(&((*(page)).reference), -1) == 1)
 
 extern struct page *pages;
 extern struct buddy_sys buddy;
@@ -0,0 +1,81 @@
+#ifndef _ZJUNIX_COROUTINE_H
+#define _ZJUNIX_COROUTINE_H
+
+#include <zjunix/list.h>
+#include <zjunix/workqueue.h>
+
+//无栈协程（protothread）
+//协程函数每次从上次让出处继续执行，让出时返回到执行器，局部变量不保留，需要跨越让出点的状态存放在arg所指的结构中
+//所有协程在同一个内核工作线程中轮流执行，每个协程只占用struct coroutine的空间，不需要独立的内核栈
+//协程函数体中不能使用switch语句，不能调用会睡眠的函数（sleep_on、mutex_lock等），等待都通过下面的宏完成
+
+#define CO_READY 0                  //在执行器就绪链表中
+#define CO_RUNNING 1                //正在执行
+#define CO_WAITING 2                //等待事件或定时
+#define CO_DONE 3                   //执行完毕
+
+#define CO_RET_YIELD 0              //让出执行器，放回就绪链表尾
+#define CO_RET_WAIT 1               //已登记等待，被唤醒或定时到期后放回就绪链表
+#define CO_RET_EXIT 2               //执行完毕
+
+#define CO_PRORITY 16               //执行器工作线程的静态优先级
+
+struct coroutine;
+typedef int (*co_func_t)(struct coroutine * co);
+
+struct coroutine{
+    unsigned int            lc;                         //续点（让出处的行号），0表示从头执行
+    int                     state;                      //协程状态
+    co_func_t               func;                       //协程函数
+    void *                  arg;                        //协程私有数据
+    void                    (*done)(struct coroutine * co);     //执行完毕后在执行器中调用，可释放协程
+    struct list_head        list;                       //就绪链表或等待队列节点
+    struct list_head        timer;                      //定时链表节点
+    unsigned int            expires;                    //定时等待到期的时钟中断计数
+};
+
+//协程等待队列，co_wake_all()可在中断上下文中调用
+struct co_waitq{
+    struct list_head        waiters;
+};
+
+#define CO_WAITQ_INIT(_name) { LIST_HEAD_INIT((_name).waiters) }
+
+#define CO_BEGIN(co)        switch((co)->lc){ case 0:
+#define CO_END(co)          } (co)->lc = 0; return CO_RET_EXIT
+
+//让出执行器，就绪的其他协程都运行一次后继续
+#define CO_YIELD(co)                                                        \
+    do{ (co)->lc = __LINE__; return CO_RET_YIELD; case __LINE__:; }while(0)
+
+//轮询等待cond成立，每次不成立时让出执行器，只用于很快完成且没有中断的设备操作
+#define CO_WAIT_UNTIL(co, cond)                                             \
+    do{ (co)->lc = __LINE__; case __LINE__: if(!(cond)) return CO_RET_YIELD; }while(0)
+
+//在等待队列wq上睡眠直到cond成立
+//先登记等待再检查条件，检查与登记之间的唤醒不会丢失
+#define CO_WAIT_EVENT(co, wq, cond)                                         \
+    do{ (co)->lc = __LINE__; case __LINE__:                                 \
+        if(!(cond)){                                                        \
+            co_wait(co, wq);                                                \
+            if(!(cond)) return CO_RET_WAIT;                                 \
+            co_wait_cancel(co);                                             \
+        }                                                                   \
+    }while(0)
+
+//睡眠ticks个时钟中断
+#define CO_SLEEP(co, ticks)                                                 \
+    do{ co_sleep(co, ticks); (co)->lc = __LINE__; return CO_RET_WAIT; case __LINE__:; }while(0)
+
+extern struct workqueue_struct * co_wq;             //执行器所在的工作队列
+
+void init_coroutines();
+void co_init(struct coroutine * co, co_func_t func, void * arg, void (*done)(struct coroutine * co));
+void co_start(struct coroutine * co);
+void init_co_waitq(struct co_waitq * wq);
+void co_wait(struct coroutine * co, struct co_waitq * wq);
+void co_wait_cancel(struct coroutine * co);
+void co_sleep(struct coroutine * co, unsigned int ticks);
+void co_wake_all(struct co_waitq * wq);
+
+#endif  // !_ZJUNIX_COROUTINE_H
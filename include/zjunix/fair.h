@@ -0,0 +1,34 @@
+#ifndef _ZJUNIX_FAIR_H
+#define _ZJUNIX_FAIR_H
+
+#include <zjunix/pc.h>
+#include <zjunix/rbtree.h>
+#include <zjunix/time.h>
+
+#define FAIR_NICE_0_WEIGHT 1024                     //init进程及默认权重
+#define FAIR_SLEEPER_BONUS (CYCLES_PER_SEC / 20)    //唤醒进程的虚拟运行时间补偿（半个调度周期）
+
+//公平调度运行队列
+//就绪进程按加权虚拟运行时间排序存放在红黑树中，正在运行的进程不在树中
+struct fair_rq{
+    struct rb_root          tasks_timeline;             //红黑树根
+    struct rb_node *        rb_leftmost;                //虚拟运行时间最小的节点
+    unsigned long long      min_vruntime;               //运行队列单调递增的最小虚拟运行时间
+    unsigned int            nr_running;                 //树中进程数
+    unsigned int            load;                       //树中进程权重之和
+};
+
+extern struct fair_rq fair_rq;
+
+void init_fair_rq();
+void fair_init_task(task_struct * task);
+void fair_enqueue(task_struct * task);
+void fair_dequeue(task_struct * task);
+void fair_place(task_struct * task);
+void fair_update_curr(task_struct * curr);
+int fair_tick(task_struct * curr);
+void fair_put_prev(task_struct * curr);
+void fair_yield(task_struct * curr);
+task_struct * fair_pick_next(task_struct * curr);
+
+#endif  // !_ZJUNIX_FAIR_H
@@ -3,13 +3,52 @@
 
 #include <zjunix/list.h>
 
+// #define LOCK_STAT                   // per-lock contention and hold-time statistics, dumped by "lockstat"
+
+#define SPIN_LOCKUP_LOOPS 0x1000000   // spins before reporting a suspected deadlock
+#define LOCK_STAT_TOP 8               // locks shown by print_lock_stat()
+
+#ifdef LOCK_STAT
+// Times are in CP0 cycles; a hold runs from acquisition to release
+struct lock_stat {
+    const char *name;
+    unsigned int acquired;
+    unsigned int contended;         // acquisitions that found the lock taken
+    unsigned long long wait_total;
+    unsigned int wait_max;
+    unsigned long long hold_total;
+    unsigned int hold_max;
+    void *hold_max_site;            // caller of the acquisition with the longest hold
+    void *site;                     // caller of the current acquisition
+    unsigned int hold_start;
+    struct lock_t *next;            // registered on first acquisition
+    int registered;
+};
+#endif  // LOCK_STAT
+
+// Spinlock for short critical sections that must not sleep.
+// The holder runs with preemption disabled, so on this uniprocessor the lock
+// can only be found taken by an interrupt handler that interrupted the holder;
+// data shared with interrupt handlers must use spin_lock_irqsave().
 struct lock_t {
-    unsigned int spin;
-    struct list_head wait;
+    volatile unsigned int spin;
+#ifdef LOCK_STAT
+    struct lock_stat stat;
+#endif
 };
 
-extern void init_lock(struct lock_t *lock);
+#ifdef LOCK_STAT
+#define LOCK_INIT(_name) { 0, { #_name } }
+#else
+#define LOCK_INIT(_name) { 0 }
+#endif
+#define DEFINE_LOCK(_name) struct lock_t _name = LOCK_INIT(_name)
+
+extern void init_lock(struct lock_t *lock, const char *name);
 extern unsigned int lockup(struct lock_t *lock);
 extern unsigned int unlock(struct lock_t *lock);
+extern unsigned int spin_lock_irqsave(struct lock_t *lock);
+extern void spin_unlock_irqrestore(struct lock_t *lock, unsigned int flags);
+extern void print_lock_stat();
 
-#endif  // !_ZJUNIX_LOCK_H
\ No newline at end of file
+#endif  // !_ZJUNIX_LOCK_H
@@ -11,6 +11,7 @@
 #define SEC_PER_CLU 8
 #define DENTRY_PER_SEC 16
 #define DENTRY_SIZE 32
+#define MAPPED_FILE_NUM 16     /* files mapped into address spaces at a time */
 
 struct __attribute__((__packed__)) disk_short_dentry_addr {
     u8 name[8];                   /* Name */
@@ -171,4 +172,7 @@ u32 fat32_cat(u8 *path);
 void fat32_lseek(MY_FILE *file, u32 new_loc);
 u32 fat32_create(u8 *filename);
 u32 fat32_cd(u8 *path);
+u32 fat32_map(u32 start_clu);
+void fat32_unmap(u32 start_clu);
+u32 fat32_mapped(u32 start_clu);
 #endif
\ No newline at end of file
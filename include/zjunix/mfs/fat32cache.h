@@ -69,6 +69,8 @@ u32 init_cache();
 
 struct mem_dentry * get_dentry(u32 sector_num, u32 offset);
 struct mem_page * get_page(u32 relative_cluster_num);
+struct mem_page * map_page(u32 relative_cluster_num);
+void sync_page(u32 relative_cluster_num);
 struct mem_FATbuffer *get_FATBuf(u32 FAT_num, u32 sec_num);
 
 struct mem_dentry * dcache_lookup(struct D_cache *dcache, u32 sector_num, u32 offset);
@@ -84,6 +86,7 @@ void tcache_drop(struct T_cache *tcache);
 u32 update_FAT(u32 crt_clus, u32 next_clus);
 
 void fat32_fflush();
+void fat32_writeback();
 
 u32 __intHash(u32 key, u32 size);
 
@@ -0,0 +1,46 @@
+#ifndef _ZJUNIX_MUTEX_H
+#define _ZJUNIX_MUTEX_H
+
+#include <zjunix/list.h>
+#include <zjunix/pc.h>
+#include <zjunix/pi.h>
+
+#define PI_MAX_CHAIN 8      // longest blocking chain a boost is propagated along
+#define PI_TRACE_NUM 16     // recent inversions kept for pitrace, power of two
+
+// Sleeping mutex with priority inheritance.
+// While tasks wait, the owner runs at the effective priority of the highest
+// waiter; on unlock the mutex is handed to the highest-priority waiter
+// (FIFO among equals) and the old owner drops back to its own priority.
+struct mutex {
+    task_struct *owner;             // 0 when free
+    struct list_head wait_list;     // waiters, linked through task_struct.sched
+    struct list_head held;          // entry in owner->pi_held
+    const char *name;
+    unsigned int inv_count;         // priority inversions seen on this mutex
+    unsigned int inv_max;           // longest inversion, in CP0 cycles
+};
+
+// One priority inversion: a task blocked behind a lower-priority owner
+struct pi_trace {
+    const char *name;
+    pid_t waiter;
+    pid_t owner;                    // owner when the waiter blocked
+    int depth;                      // owners boosted along the blocking chain
+    unsigned int duration;          // block to acquire, in CP0 cycles
+};
+
+#define MUTEX_INIT(_name) { 0, LIST_HEAD_INIT((_name).wait_list), LIST_HEAD_INIT((_name).held), #_name, 0, 0 }
+#define DEFINE_MUTEX(_name) struct mutex _name = MUTEX_INIT(_name)
+
+extern struct pi_trace pi_traces[PI_TRACE_NUM];
+extern unsigned int pi_trace_count;
+
+extern void init_mutex(struct mutex *m, const char *name);
+extern void mutex_lock(struct mutex *m);
+extern int mutex_trylock(struct mutex *m);
+extern void mutex_unlock(struct mutex *m);
+extern void mutex_cancel_wait(task_struct *task);
+extern void print_pi_trace();
+
+#endif  // !_ZJUNIX_MUTEX_H
@@ -1,4 +1,4 @@
-#ifndef  _ZJUNIX_PAGH_H
+#ifndef  _ZJUNIX_PAGE_H
 #define  _ZJUNIX_PAGE_H
 
 #define  PAGE_SHIFT   12     //size of page
@@ -11,9 +11,62 @@
 #define  PGD_MASK     (~((1 << PGD_SHIFT) - 1))
 
 
+#define  PTRS_PER_PGD  1024   //页目录项数，每项对应4MB
+#define  PTRS_PER_PTE  1024   //页表项数，每个页表占一页
+
 typedef unsigned int pgd_t;
 typedef unsigned int pte_t;
 
+//页目录项为页表的内核虚地址，未映射的4MB区域指向共享的invalid_pte_table
+//页表按页对齐，页目录项低8位记录该4MB区域的页大小：PageMask>>13，即2^order-1
+//order为0、2、4、6、8，对应4KB、16KB、64KB、256KB、1MB的TLB页
+//页表项直接采用EntryLo格式，TLB重填时不需转换：
+//  [31:6] PFN  [5:3] C  [2] D（可写）  [1] V  [0] G
+//同一页表中相邻的偶、奇页表项即一个TLB项的EntryLo0、EntryLo1
+#define  _PAGE_GLOBAL   0x01
+#define  _PAGE_VALID    0x02
+#define  _PAGE_DIRTY    0x04
+#define  _PAGE_CACHED   (3 << 3)
+#define  PTE_PFN_SHIFT  6
+
+#define  mk_pte(pa, flags)  ((((pa) >> PAGE_SHIFT) << PTE_PFN_SHIFT) | (flags))
+#define  pte_pa(pte)        (((pte) >> PTE_PFN_SHIFT) << PAGE_SHIFT)
+#define  pte_valid(pte)     ((pte) & _PAGE_VALID)
+#define  pgd_index(va)      ((va) >> PGD_SHIFT)
+#define  pte_index(va)      (((va) >> PAGE_SHIFT) & INDEX_MASK)
+
+#define  PGD_ORDER_MASK     0xff
+#define  HPAGE_MAX_ORDER    8
+#define  pgd_table(pgd)     ((pte_t *)((pgd) & PAGE_MASK))
+#define  order_pagemask(order)  (((1 << (order)) - 1) << 13)
+
+//大页区域中，每个TLB项覆盖的2^(order+1)个页表项里偶数项都是偶页的页表项，
+//奇数项都是奇页的，重填处理程序照常取出缺失地址所在的一对即可
+//hpte_index()为va所在大页的第一个页表项
+#define  hpte_index(va, order) \
+    ((pte_index(va) & ~((2 << (order)) - 1)) | (((va) >> (PAGE_SHIFT + (order))) & 1))
+
+static inline unsigned int pgd_order(pgd_t pgd) {
+    unsigned int mask = pgd & PGD_ORDER_MASK, order = 0;
+    while (mask) {
+        mask >>= 1;
+        order++;
+    }
+    return order;
+}
+
+extern pte_t invalid_pte_table[PTRS_PER_PTE];
+extern pgd_t swapper_pg_dir[PTRS_PER_PGD];
+extern pgd_t *pgd_current;     //TLB重填处理程序查找的页目录
+
+void pgd_init(pgd_t *pgd);
+pte_t *pte_lookup(pgd_t *pgd, unsigned int va);
+pte_t *pte_alloc(pgd_t *pgd, unsigned int va);
+pte_t *hpte_alloc(pgd_t *pgd, unsigned int va, unsigned int order);
+void set_hpte(pte_t *pt, unsigned int index, unsigned int order, pte_t pte);
+unsigned int pt_release(pte_t *pt, unsigned int order);
+void copy_user_page(void *to, void *from);
+
 int do_one_mapping(pgd_t *pgd, unsigned int va, unsigned int pa, unsigned int attr);
 int do_mapping(pgd_t *pgd, unsigned int va, unsigned int npage, unsigned int pa, unsigned int attr);
 
@@ -3,11 +3,14 @@
 
 #include <zjunix/list.h>
 #include <zjunix/pid.h>
+#include <zjunix/rbtree.h>
 #include <zjunix/vm.h>
 
 #define KERNEL_STACK_SIZE 4096      //内核栈大小
 #define TASK_NAME_LEN 32            //进程名长度
-#define START_TIME_LEN 16           //进程开始时间长度
+#define TASK_STRUCT_MAX_SIZE (KERNEL_STACK_SIZE / 4)   //进程控制块大小上限，其余为内核栈
+#define STACK_CANARY 0x57ac6e9d     //内核栈最低处的标记值，被改写说明内核栈溢出
+#define START_TIME_LEN 16           //进程开始时间字符串长度（显示用）
 #define PRORITY_NUM 32              //优先级等级
 #define PRORITY_BYTES ((PRORITY_NUM + 7) >> 3)  //用于优先级位图 
 #define TASK_UNINIT 0               //未初始化
@@ -17,9 +20,18 @@
 #define TASK_TERMINAL 4             //终结
 #define MIN_TIMESLICE 1             //最小时间片数量
 #define MAX_TIMESLICE 0xffffffff    //最大时间片
+#define TICK_CYCLES 10000000        //时钟中断间隔（CP0周期数）
+#define SCHED_NORMAL 0              //普通进程，由优先级数组或公平调度管理
+#define SCHED_FIFO 1                //实时进程，同优先级先到先服务，运行到阻塞或被更高优先级抢占
+#define SCHED_RR 2                  //实时进程，同优先级按时间片轮转
+#define SCHED_DEADLINE 3            //周期进程，按绝对截止时间最早优先（EDF）调度，优先于其他实时进程
 
 #define PC_DEBUG
 
+struct mutex;
+// #define SCHED_FAIR                  //使用公平调度（按加权虚拟运行时间排序的红黑树）代替优先级数组调度
+// #define SCHED_PRIO_TIME             //统计各动态优先级下的运行时间并在top中显示，每个进程控制块增加128字节
+
 struct regs_context{
     unsigned int epc;
     unsigned int at;
@@ -36,19 +48,78 @@ struct regs_context{
 };
 typedef struct regs_context context;
 
+//主动切换时保存的寄存器
+//在函数调用边界上切换，调用者保存的寄存器已由编译器处理，只需保存被调用者保存的寄存器
+struct switch_frame{
+    unsigned int s0, s1, s2, s3, s4, s5, s6, s7;
+    unsigned int gp;
+    unsigned int sp;
+    unsigned int fp;
+    unsigned int ra;
+};
+
+//进程调度统计信息
+struct sched_stat{
+    unsigned long long      run_cycles;                 //累计运行时间（CP0周期数）
+    unsigned int            last_run;                   //最近一次开始运行/统计的周期计数
+    unsigned int            nvcsw;                      //主动切换次数
+    unsigned int            nivcsw;                     //被动切换次数
+    unsigned int            woken;                      //是否处于唤醒后等待运行状态
+    unsigned int            wakeup_stamp;               //被唤醒时的周期计数
+    unsigned int            wakeup_lat_last;            //最近一次唤醒到运行的延迟
+    unsigned int            wakeup_lat_max;             //最大唤醒到运行的延迟
+    unsigned int            wakeup_lat_avg;             //唤醒延迟的滑动平均值
+#ifdef SCHED_PRIO_TIME
+    unsigned int            prio_time[PRORITY_NUM];     //各动态优先级下的运行时间（单位：1024个周期）
+#endif
+};
+
 struct task_struct {
     pid_t                   pid;                        //进程pid号
-    int                     ASID;                       //进程地址空间id号
     volatile int            state;                      //进程状态
     pid_t                   ppid;                       //父进程pid号
     unsigned char           name[TASK_NAME_LEN];        //进程名
     long                    static_prority;             //静态优先级
     long                    dynamic_prority;            //动态优先级
     unsigned int            counter;                    //进程剩余时间片数
-    unsigned char           start_time[START_TIME_LEN]; //进程创建时间
+    unsigned long long      start_time;                 //进程创建时间（CP0周期计数，显示时再格式化）
     long                    sleep_avg;                  //平均睡眠时间
     int                     is_changed;                 //是否改变优先级
-    struct regs_context     context;                    //进程寄存器信息
+    struct regs_context     context;                    //进程寄存器信息（新建或被中断抢占时有效）
+    struct switch_frame     frame;                      //主动让出CPU时保存的寄存器
+    int                     frame_saved;                //寄存器保存在frame中而不是context中
+    unsigned int            preempt_saved;              //主动让出CPU时的抢占计数，再次运行时恢复
+    struct sched_stat       stat;                       //进程调度统计信息
+
+    unsigned long long      vruntime;                   //加权虚拟运行时间（公平调度）
+    unsigned int            exec_start;                 //本次开始运行时的周期计数（公平调度、实时调度）
+    unsigned int            load_weight;                //由静态优先级映射得到的权重（公平调度）
+    unsigned int            load_wmult;                 //2^32 / load_weight，用乘法代替除法（公平调度）
+    int                     on_rq;                      //是否在红黑树运行队列中（公平调度）
+    struct rb_node          run_node;                   //红黑树运行队列节点（公平调度）
+
+    int                     policy;                     //调度策略SCHED_NORMAL/SCHED_FIFO/SCHED_RR/SCHED_DEADLINE
+    int                     rt_priority;                //实时优先级，31最高（实时调度）
+    unsigned int            rt_time_slice;              //SCHED_RR剩余时间片（实时调度）
+    int                     rt_on_rq;                   //是否在实时运行队列中（实时调度）
+    struct list_head        rt_list;                    //实时运行队列节点（实时调度）
+
+    unsigned int            dl_runtime;                 //每个周期的运行预算（周期调度，单位：CP0周期，下同）
+    unsigned int            dl_deadline;                //相对截止时间
+    unsigned int            dl_period;                  //周期
+    unsigned int            dl_release;                 //本周期的释放时刻
+    unsigned int            dl_abs_deadline;            //本周期的绝对截止时间
+    unsigned int            dl_used;                    //本周期已运行时间
+    int                     dl_throttled;               //本周期预算已用完，等待下一周期
+    unsigned int            dl_misses;                  //错过截止时间的次数
+    struct list_head        dl_timer;                   //按释放时刻排序的定时链表节点（周期调度）
+
+    struct list_head        pi_held;                    //持有的互斥锁链表（优先级继承，下同）
+    struct mutex *          pi_blocked_on;              //正在等待的互斥锁
+    int                     pi_boosted;                 //优先级是否被临时提升
+    int                     pi_policy;                  //提升前的调度策略
+    int                     pi_rt_priority;             //提升前的实时优先级
+    long                    pi_dynamic_prority;         //提升前的动态优先级
 
     struct list_head        sched;                      //用于进程调度       
     struct list_head        list;                       //用于进程链表
@@ -59,6 +130,8 @@ struct task_struct {
 
     struct mm_struct *      mm;                         //进程地址空间结构指针
     char *                  files;                      //进程打开文件指针
+
+    unsigned int            stack_canary;               //内核栈溢出标记，须为最后一个成员，紧邻内核栈的最低处
 };
 typedef struct task_struct task_struct;
 
@@ -68,9 +141,20 @@ union task_union{
 };
 typedef union task_union task_union;
 
+//进程统计信息快照，供top等命令在关中断时快速复制后再显示
+struct task_snapshot{
+    pid_t                   pid;
+    int                     state;
+    long                    static_prority;
+    long                    dynamic_prority;
+    unsigned char           name[TASK_NAME_LEN];
+    struct sched_stat       stat;
+};
+
 extern struct list_head tasks;                      //存放所有进程
 extern struct list_head sched[PRORITY_NUM + 1];     //调度链表
 extern task_struct *current_task;                   //当前进程           
+extern volatile int need_resched;                   //中断返回前是否需要重新调度
 unsigned char pro_map[PRORITY_BYTES];               //优先级位图
 // int argsc = 0;
 
@@ -80,9 +164,17 @@ void add_tasks(task_struct * task);
 void add_sched(task_struct * task);
 void add_wait(task_struct * task);
 void add_pro_map(task_struct * task);
+void remove_sched(task_struct * task);
 void init_pc();
 int task_create(char * task_name, long static_prority, void (*entry)(unsigned int argc, void * argv),
                 unsigned int argc, void * argv, pid_t * ret_pid, int is_user);
+int task_create_policy(char * task_name, long static_prority, int policy, int rt_priority,
+                       void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                       pid_t * ret_pid, int is_user);
+int task_create_periodic(char * task_name, unsigned int period, unsigned int runtime, unsigned int deadline,
+                         void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                         pid_t * ret_pid);
+void wait_next_period();
 void remove_terminal(task_struct * task);
 void remove_tasks(task_struct * task);
 void clear_terminal();
@@ -91,22 +183,32 @@ void update_dynamic_prority();
 void update_pro_map();
 task_struct * find_in_pro_map();
 task_struct * find_next_task();
-static void copy_context(context* src, context* dest);
 void activate_mm(task_struct * task);
 void pc_schedule(unsigned int status, unsigned int cause, context* pt_context);
+void pc_resched(context * pt_context);
 int print_proc();
 void print_task_struct();
 task_struct * find_in_tasks(pid_t pid);
+void account_run(task_struct * task);
+void account_wakeup(task_struct * task);
+void account_switch(task_struct * prev, task_struct * next, int voluntary);
+int snapshot_proc(struct task_snapshot * buf, int max, int * total);
 void add_terminal(task_struct * task);
 void task_files_delete(task_struct * task);
 int pc_kill(pid_t pid);
 int kernel_proc(unsigned int argc, void * argv);
+int kthread_create(char * name, long static_prority, void (*fn)(void * arg), void * arg, pid_t * ret_pid);
 int exec_kernel(int argc, void *argv, int is_wait, int is_user);
 task_struct * wait_check(pid_t pid);
 void task_exit();
 void wakeup_parent();
 void wait_pid(pid_t pid);
+void sleep_on(struct list_head * queue);
+void wakeup_task(task_struct * task);
+void wakeup_queue(struct list_head * queue);
+void sched_yield();
 extern void switch_ex(struct regs_context* regs);
-extern void switch_wa(struct regs_context* des, struct regs_context* src);
+extern void switch_to(struct switch_frame* prev, struct switch_frame* next);
+extern void switch_to_ex(struct switch_frame* prev, struct regs_context* next);
 
 #endif  // !_ZJUNIX_PC_H
\ No newline at end of file
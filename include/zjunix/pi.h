@@ -0,0 +1,17 @@
+#ifndef _ZJUNIX_PI_H
+#define _ZJUNIX_PI_H
+
+#include <zjunix/pc.h>
+#include <zjunix/rt.h>
+
+//有效优先级：普通进程为动态优先级（-1~31），实时进程为PRORITY_NUM+实时优先级，周期进程最高
+//数值越大越优先，用于比较不同调度策略的进程
+#define PI_PRIO_NONE (-2)                               //没有等待者
+#define PI_PRIO_DL (PRORITY_NUM + RT_PRIO_NUM)          //周期进程的有效优先级
+
+void pi_init_task(task_struct * task);
+int pi_prio(task_struct * task);
+int pi_base_prio(task_struct * task);
+int pi_setprio(task_struct * task, int prio);
+
+#endif  // !_ZJUNIX_PI_H
@@ -0,0 +1,31 @@
+#ifndef _ZJUNIX_PREEMPT_H
+#define _ZJUNIX_PREEMPT_H
+
+//抢占计数：低16位为preempt_disable()嵌套数（加锁时递增），高16位为中断处理嵌套数
+//计数不为0时时钟中断只记录需要调度，等计数回到0时再切换进程
+//关中断的代码段本身不会被时钟中断打断，不计入抢占计数
+#define PREEMPT_MASK 0x0000ffff
+#define HARDIRQ_OFFSET 0x00010000
+#define HARDIRQ_MASK 0xffff0000
+
+extern volatile unsigned int preempt_count;
+extern unsigned int resched_lat_max;                //需要调度到实际切换的最大延迟（CP0周期数）
+
+#define preempt_disable()                                   \
+    do {                                                    \
+        preempt_count++;                                    \
+        asm volatile("" : : : "memory");                    \
+    } while (0)
+
+//当前被中断的进程上下文是否允许抢占
+#define preemptible() ((preempt_count & PREEMPT_MASK) == 0)
+//是否在中断处理中
+#define in_interrupt() ((preempt_count & HARDIRQ_MASK) != 0)
+
+void preempt_enable();
+void preempt_schedule();
+void cond_resched();
+void set_need_resched();
+void account_resched();
+
+#endif  // !_ZJUNIX_PREEMPT_H
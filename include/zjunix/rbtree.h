@@ -0,0 +1,46 @@
+#ifndef _ZJUNIX_RBTREE_H
+#define _ZJUNIX_RBTREE_H
+
+#include <zjunix/utils.h>
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+/*
+ * Intrusive red-black tree node, embed it into the structure to be indexed.
+ * Lookups and insert positions are done by the user (see rb_link_node),
+ * then rb_insert_color rebalances the tree.
+ */
+struct rb_node {
+    struct rb_node *rb_parent;
+    struct rb_node *rb_left;
+    struct rb_node *rb_right;
+    int rb_color;
+};
+
+struct rb_root {
+    struct rb_node *rb_node;
+};
+
+#define RB_ROOT \
+    { 0 }
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define RB_EMPTY_ROOT(root) ((root)->rb_node == 0)
+
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent, struct rb_node **rb_link) {
+    node->rb_parent = parent;
+    node->rb_color = RB_RED;
+    node->rb_left = node->rb_right = 0;
+    *rb_link = node;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+void rb_erase(struct rb_node *node, struct rb_root *root);
+struct rb_node *rb_first(struct rb_root *root);
+struct rb_node *rb_last(struct rb_root *root);
+struct rb_node *rb_next(struct rb_node *node);
+struct rb_node *rb_prev(struct rb_node *node);
+
+#endif  // ! _ZJUNIX_RBTREE_H
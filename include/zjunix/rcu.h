@@ -0,0 +1,95 @@
+#ifndef _ZJUNIX_RCU_H
+#define _ZJUNIX_RCU_H
+
+#include <zjunix/list.h>
+#include <zjunix/atomic.h>
+
+//顺序计数：写者修改前后各加1，修改期间为奇数
+//读者不阻塞写者，读完后发现计数变化则重新读取
+typedef struct{
+    volatile unsigned int   sequence;
+} seqcount_t;
+
+#define SEQCNT_ZERO { 0 }
+
+//写者正在修改时返回的值与之后的计数必然不等，读完后会重试
+static inline unsigned int read_seqcount_begin(seqcount_t * s){
+    unsigned int ret = s->sequence & ~1u;
+    asm volatile("" : : : "memory");
+    return ret;
+}
+
+//返回1表示读取期间发生了修改，需要重新读取
+static inline int read_seqcount_retry(seqcount_t * s, unsigned int start){
+    asm volatile("" : : : "memory");
+    return s->sequence != start;
+}
+
+//写者之间需另行互斥（如关中断）
+static inline void write_seqcount_begin(seqcount_t * s){
+    s->sequence++;
+    asm volatile("" : : : "memory");
+}
+
+static inline void write_seqcount_end(seqcount_t * s){
+    asm volatile("" : : : "memory");
+    s->sequence++;
+}
+
+//读-复制-更新（RCU）
+//读者在rcu_read_lock()和rcu_read_unlock()之间遍历链表，不关中断也不关抢占，期间可以被抢占
+//写者用list_add_tail_rcu()/list_del_rcu()修改链表，被删除的节点在宽限期结束后才能释放
+//宽限期：rcu_gp_start()切换读者计数的期号，旧期号的读者全部退出后rcu_gp_done()返回1
+//读者状态字：低15位为第0期读者数，16~30位为第1期读者数，最高位为当前期号
+extern volatile unsigned int rcu_state;
+
+#define RCU_EPOCH_SHIFT 31
+#define RCU_READER(idx) ((idx) ? 0x10000u : 1u)
+#define RCU_READERS(state, idx) ((idx) ? ((state) >> 16) & 0x7fff : (state) & 0x7fff)
+
+//返回读者所在的期号，交给rcu_read_unlock()
+static inline int rcu_read_lock(){
+    unsigned int old;
+
+    //读期号与增加计数须是同一次原子操作，否则可能计入已经结束的宽限期
+    do{
+        old = rcu_state;
+    }while(cmpxchg(&rcu_state, old, old + RCU_READER(old >> RCU_EPOCH_SHIFT)) != old);
+    return old >> RCU_EPOCH_SHIFT;
+}
+
+static inline void rcu_read_unlock(int idx){
+    atomic_fetch_add(&rcu_state, -RCU_READER(idx));
+}
+
+//开始宽限期，返回需等待的旧期号；同一时刻只能有一个宽限期
+static inline int rcu_gp_start(){
+    unsigned int old;
+
+    do{
+        old = rcu_state;
+    }while(cmpxchg(&rcu_state, old, old ^ (1u << RCU_EPOCH_SHIFT)) != old);
+    return old >> RCU_EPOCH_SHIFT;
+}
+
+//旧期号的读者都已退出时返回1
+static inline int rcu_gp_done(int idx){
+    return RCU_READERS(rcu_state, idx) == 0;
+}
+
+//节点内容初始化完成后才链入，读者不会看到未初始化的节点
+static inline void list_add_tail_rcu(struct list_head * new, struct list_head * head){
+    new->next = head;
+    new->prev = head->prev;
+    asm volatile("" : : : "memory");
+    head->prev->next = new;
+    head->prev = new;
+}
+
+//保留entry->next，正停在entry上的读者仍能继续遍历；宽限期结束前不能重用entry
+static inline void list_del_rcu(struct list_head * entry){
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+}
+
+#endif  // !_ZJUNIX_RCU_H
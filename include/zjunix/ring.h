@@ -0,0 +1,62 @@
+#ifndef _ZJUNIX_RING_H
+#define _ZJUNIX_RING_H
+
+// Lock-free single-producer/single-consumer ring of fixed-size elements.
+//
+// Only the producer writes head and only the consumer writes tail. Both
+// indices run freely and are masked on access, so the size must be a power
+// of two and head - tail is the fill level across wraparound. Elements are
+// copied in before head is published and copied out before tail is
+// released, so either side may be an interrupt handler and neither needs
+// interrupts off. Several producers (or several consumers) must serialize
+// among themselves.
+//
+// The fields each side writes sit on their own cache line, and batch
+// operations copy at most two contiguous runs.
+
+#define RING_CACHELINE 32
+
+struct ring {
+    // Set up once, read by both sides
+    void *data;
+    unsigned int mask;              // size - 1
+    unsigned int esize;             // bytes per element
+    // Producer side
+    volatile unsigned int head __attribute__((aligned(RING_CACHELINE)));
+    unsigned int dropped;           // elements refused because the ring was full
+    unsigned int high_water;        // largest fill level seen by the producer
+    // Consumer side
+    volatile unsigned int tail __attribute__((aligned(RING_CACHELINE)));
+};
+
+// Static ring over an array whose length is a power of two
+#define RING_INIT(_data) \
+    { (_data), sizeof(_data) / sizeof((_data)[0]) - 1, sizeof((_data)[0]), 0, 0, 0, 0 }
+
+static inline unsigned int ring_count(struct ring *r) {
+    return r->head - r->tail;
+}
+
+static inline unsigned int ring_space(struct ring *r) {
+    return r->mask + 1 - (r->head - r->tail);
+}
+
+static inline int ring_empty(struct ring *r) {
+    return r->head == r->tail;
+}
+
+int init_ring(struct ring *r, void *data, unsigned int esize, unsigned int size);
+unsigned int ring_push_n(struct ring *r, const void *elems, unsigned int n);
+unsigned int ring_pop_n(struct ring *r, void *elems, unsigned int n);
+
+// Return 1 if the element was queued, 0 if the ring was full
+static inline int ring_push(struct ring *r, const void *elem) {
+    return ring_push_n(r, elem, 1);
+}
+
+// Return 1 if an element was dequeued, 0 if the ring was empty
+static inline int ring_pop(struct ring *r, void *elem) {
+    return ring_pop_n(r, elem, 1);
+}
+
+#endif  // ! _ZJUNIX_RING_H
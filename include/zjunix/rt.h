@@ -0,0 +1,49 @@
+#ifndef _ZJUNIX_RT_H
+#define _ZJUNIX_RT_H
+
+#include <zjunix/pc.h>
+#include <zjunix/time.h>
+
+#define RT_PRIO_NUM 32                                  //实时优先级等级，31最高
+#define RT_RR_TIMESLICE 1                               //SCHED_RR时间片（时钟中断数）
+#define RT_PERIOD_CYCLES CYCLES_PER_SEC                 //实时进程限流周期
+#define RT_RUNTIME_CYCLES (CYCLES_PER_SEC / 100 * 95)   //每个周期内实时进程最多运行的时间
+#define DL_BW_SHIFT 10                                  //周期进程带宽（运行预算/周期）的定点小数位数
+#define DL_BW_MAX ((1 << DL_BW_SHIFT) / 100 * 95)       //周期进程总带宽上限，与实时进程限流比例一致
+
+//实时运行队列
+//每个实时优先级一个FIFO链表，位图中第p位表示优先级p的链表非空，正在运行的进程不在队列中
+//周期进程（SCHED_DEADLINE）在单独的链表中按绝对截止时间升序排列，优先于所有实时优先级
+struct rt_rq{
+    struct list_head        dl_queue;                   //周期进程就绪链表
+    struct list_head        dl_timers;                  //等待下一周期释放的周期进程，按释放时刻升序
+    unsigned int            dl_bw;                      //已接纳的周期进程总带宽
+    struct list_head        queue[RT_PRIO_NUM];         //各优先级就绪链表
+    unsigned int            bitmap;                     //非空链表位图
+    unsigned int            nr_running;                 //队列中进程数
+    unsigned int            rt_time;                    //本周期内实时进程已运行的周期数
+    unsigned int            period_start;               //本周期开始时的周期计数
+    int                     throttled;                  //本周期预算已用完，暂停运行实时进程
+};
+
+extern struct rt_rq rt_rq;
+
+void init_rt_rq();
+void rt_init_task(task_struct * task, int policy, int rt_priority);
+void rt_enqueue(task_struct * task, int head);
+void rt_dequeue(task_struct * task);
+int rt_runnable();
+int rt_preempts(task_struct * task, task_struct * curr);
+int rt_need_preempt(task_struct * curr);
+void rt_update_curr(task_struct * curr);
+void rt_period_tick();
+int rt_tick(task_struct * curr);
+void rt_put_prev(task_struct * curr);
+task_struct * rt_pick_next();
+int dl_admit(unsigned int runtime, unsigned int period);
+void dl_unadmit(unsigned int runtime, unsigned int period);
+void dl_start(task_struct * task, unsigned int runtime, unsigned int deadline, unsigned int period);
+void dl_next_period(task_struct * curr);
+void rt_exit_task(task_struct * task);
+
+#endif  // !_ZJUNIX_RT_H
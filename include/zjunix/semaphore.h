@@ -0,0 +1,23 @@
+#ifndef _ZJUNIX_SEMAPHORE_H
+#define _ZJUNIX_SEMAPHORE_H
+
+#include <zjunix/list.h>
+#include <zjunix/pc.h>
+
+// Counting semaphore. Waiters sleep in FIFO order and up() hands the count
+// straight to the first of them, so a later down() cannot overtake it.
+// up() may be called from interrupt handlers, down() only from a task.
+struct semaphore {
+    int count;
+    struct list_head wait_list;     // waiters, linked through task_struct.sched
+};
+
+#define SEMAPHORE_INIT(_name, _count) { _count, LIST_HEAD_INIT((_name).wait_list) }
+#define DEFINE_SEMAPHORE(_name, _count) struct semaphore _name = SEMAPHORE_INIT(_name, _count)
+
+extern void init_sema(struct semaphore *sem, int count);
+extern void down(struct semaphore *sem);
+extern int down_trylock(struct semaphore *sem);
+extern void up(struct semaphore *sem);
+
+#endif  // !_ZJUNIX_SEMAPHORE_H
@@ -38,6 +38,7 @@ struct kmem_cache_cpu {
 };
 
 struct kmem_cache {
+    struct lock_t lock;  // protects the pages of this cache
     unsigned int size;
     unsigned int objsize;
     unsigned int offset;
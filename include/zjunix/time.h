@@ -4,6 +4,24 @@
 // Put current time into buffer, at least 8 char size
 void get_time(char* buf, int len);
 
+// CP0 cycle counter frequency (100MHz)
+#define CYCLES_PER_SEC 100000000
+
+// Clock display task, redrawn once per period within a per-period budget (cycles)
+#define SYSTEM_TIME_PERIOD CYCLES_PER_SEC
+#define SYSTEM_TIME_RUNTIME (CYCLES_PER_SEC / 1000)
 void system_time_proc();
 
-#endif // ! _ZJUNIX_TIME_H
\ No newline at end of file
+// Low 32 bits of the free-running CP0 cycle counter
+unsigned int get_cycles();
+
+// Full 64-bit cycle counter, cheap enough to stamp on every task creation
+unsigned long long get_cycles64();
+
+// Format a get_cycles64() value as hh:mm:ss into buf, at least 9 bytes
+void format_time(unsigned long long cycles, char* buf, int len);
+
+// Convert a 64-bit cycle count into milliseconds without 64-bit division
+unsigned int cycles_to_ms(unsigned long long cycles);
+
+#endif // ! _ZJUNIX_TIME_H
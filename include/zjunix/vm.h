@@ -2,6 +2,7 @@
 #define _ZJUNIX_VM_H
 
 #include <zjunix/page.h>
+#include <zjunix/buddy.h>
 #define VM_AVL_EMPTY NULL
 #define VM_NONE		0x00000000
 
@@ -53,10 +54,47 @@
 #define VM_DEFALUT_ATTR   0x0f
 #define VM_CHANGE2PHY   0x80000000
 
+//mm->context holds an ASID (EntryHi[7:0]) and above it the generation the
+//ASID was handed out in; ASIDs of older generations are stale
+#define ASID_MASK	0xff
+#define ASID_VERSION_MASK	(~ASID_MASK)
+#define ASID_FIRST_VERSION	(ASID_MASK + 1)
+
+//first address tried for mappings without a fixed address
+#define TASK_UNMAPPED_BASE	0x10000000
+
+//do_page_fault() access types
+#define FAULT_READ	0	//TLBL: load or instruction fetch
+#define FAULT_WRITE	1	//TLBS: store to an invalid page
+#define FAULT_MODIFY	2	//Mod: store to a valid page without D
+
+//do_page_fault() results
+#define FAULT_OK	0
+#define FAULT_BADADDR	1	//not inside any vma
+#define FAULT_BADACCESS	2	//the vma does not permit the access
+#define FAULT_OOM	3
+
+//struct page of the frame a valid pte maps; its reference counts the ptes
+//mapping it, so pages shared after dup_mm() are copied on the first write
+#define pte_page(pte)	(pages + (pte_pa(pte) >> PAGE_SHIFT))
+
+//a file mapped by file-backed vmas: the data cluster of each page, looked up
+//once so faults need not walk the FAT chain; the vmas split or duplicated
+//from one mapping share it, the last of them frees it. The file is registered
+//with fat32_map() meanwhile, so its clusters are not freed under the mapping
+struct vm_file{
+			unsigned int reference;
+			unsigned int start_clu;//first data cluster, 0 if the file has none
+			unsigned int size;//file size in bytes
+			unsigned int nr_pages;//pages holding data, faults beyond them fail
+			unsigned int *clusters;//data cluster of each page, as in the FAT
+};
+
 struct mm_struct;
+struct fat_file_s;
 struct mm_struct{
 			struct vm_area_struct *mmap;	//list of VMA
-			struct vm_area_struct *mmap_avl;//tree of VMA
+			struct vm_area_struct *mmap_avl;//AVL tree of VMA, by address
 			struct vm_area_struct *mmap_cache;//LAST FIND VMA RESULT
 			int map_count;//number of VMAs
 
@@ -66,6 +104,9 @@ struct mm_struct{
 			unsigned long start_brk, brk, start_stack;
 			unsigned long tatal_vm, locked_vm, shared_vm, exec_vm;
 			//进程地址空间的大小，锁住无法换页的个数，共享文件内存映射的页数，可执行内存映射中的页数
+			unsigned long rss;//已分配物理页的页数
+			unsigned int context;//generation and ASID, 0 until first switched to
+			unsigned long free_area_cache;//get_unmapped_area() starts here
 
 };
 
@@ -83,16 +124,35 @@ struct vm_area_struct{
 			struct vm_area_struct *vm_avl_right;
 			unsigned long vm_flags;//标识集
 			unsigned long vm_pgoff; // 映射文件的偏移量，以page_size为单位
+			struct vm_file *vm_file;//mapped file, 0 for anonymous memory
+			unsigned long vm_page_order;//VM_HUGEPAGE: mapped with TLB pages of PAGE_SIZE<<vm_page_order
 };
 
 struct mm_struct* mm_create();
 void mm_delete(struct mm_struct* mm);
 unsigned long do_mmap(unsigned long addr, unsigned long len, unsigned long flags);//完成可执行映像向虚存区域的映射，建立有关的虚存区域
+unsigned long do_mmap_pgoff(struct vm_file* file, unsigned long addr, unsigned long len, unsigned long flags, unsigned long pgoff);
+unsigned long do_mmap_file(struct fat_file_s* file, unsigned long addr, unsigned long len, unsigned long flags, unsigned long pgoff);
+int do_msync(unsigned long addr, unsigned long len);
+int filemap_sync_mm(struct mm_struct* mm);
+struct vm_file* get_vm_file(struct vm_file* file);
+void put_vm_file(struct vm_file* file);
 int do_unmap(unsigned long addr, unsigned long len);//取消断开可执行映像向虚存区域的映射，删除有关的虚存区域
 int is_in_vma(unsigned long addr);
 extern void set_tlb_asid(unsigned int asid);
+extern void tlb_update(unsigned int va, unsigned int entry_lo0, unsigned int entry_lo1, unsigned int page_mask);
+extern void flush_tlb_all();
+void switch_mm(struct mm_struct* mm);
+void flush_tlb_mm(struct mm_struct* mm);
+extern unsigned int tlb_refills;
+void print_tlb_stat();
+void reset_tlb_stat();
+struct mm_struct* dup_mm(struct mm_struct* oldmm, int copy);
+void put_user_page(pte_t pte);
+int do_page_fault(struct mm_struct* mm, unsigned int addr, int type);
+void zap_page_range(struct mm_struct* mm, unsigned long start, unsigned long end);
 unsigned long mmap_region(unsigned long addr, unsigned long len, unsigned long flags);
-struct vm_area_struct *vma_merge(struct mm_struct *mm,struct vm_area_struct *prev, unsigned long addr,unsigned long end, unsigned long vm_flags);
+struct vm_area_struct *vma_merge(struct mm_struct *mm,struct vm_area_struct *prev, unsigned long addr,unsigned long end, unsigned long vm_flags, struct vm_file *file, unsigned long pgoff);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef _ZJUNIX_WORKERPOOL_H
+#define _ZJUNIX_WORKERPOOL_H
+
+#include <zjunix/list.h>
+#include <zjunix/pc.h>
+#include <zjunix/time.h>
+
+#define WORKER_POOL_MIN 4           //启动时预先创建的工作线程数
+#define WORKER_POOL_MAX 16          //工作线程数上限
+#define WORKER_POOL_PRORITY 15      //工作线程的静态优先级
+#define WORKER_JOB_MAX_CYCLES CYCLES_PER_SEC    //任务占用工作线程的运行时间上限，超过后该线程离开线程池
+
+//线程池中的工作线程，空闲时在waitq上睡眠，由run_on_worker()交给它一个任务并唤醒
+struct pool_worker{
+    task_struct *           task;                       //工作线程
+    void                    (*fn)(void * arg);          //待执行的任务，0表示没有任务
+    void *                  arg;                        //任务参数
+    struct list_head        list;                       //用于空闲工作线程链表
+    struct list_head        waitq;                      //空闲时在此睡眠
+    unsigned int            jobs;                       //已执行的任务数
+    int                     busy;                       //是否正在执行任务
+    unsigned long long      start;                      //开始执行当前任务时工作线程的累计运行时间
+    int                     detached;                   //任务运行过久，已离开线程池，任务结束后线程退出
+};
+
+extern struct pool_worker * worker_pool[WORKER_POOL_MAX];
+extern int worker_pool_size;                        //线程池中的工作线程数
+
+void init_worker_pool();
+int run_on_worker(void (*fn)(void * arg), void * arg);
+void pool_worker_wait(struct pool_worker * w);
+int pool_worker_run(struct pool_worker * w);
+
+#endif  // !_ZJUNIX_WORKERPOOL_H
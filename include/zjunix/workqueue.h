@@ -0,0 +1,65 @@
+#ifndef _ZJUNIX_WORKQUEUE_H
+#define _ZJUNIX_WORKQUEUE_H
+
+#include <zjunix/list.h>
+#include <zjunix/pc.h>
+
+#define WQ_NAME_LEN 16              //工作队列名长度
+#define WQ_DEFAULT_PRORITY 16       //系统工作队列线程的静态优先级
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct * work);
+
+//工作项，由工作线程在进程上下文中调用func
+struct work_struct{
+    struct list_head        entry;                      //用于工作队列链表
+    work_func_t             func;                       //处理函数
+    int                     pending;                    //是否已在队列中等待处理
+};
+
+//延迟工作项，到期后加入工作队列
+struct delayed_work{
+    struct work_struct          work;
+    struct list_head            timer;                  //用于延迟工作链表
+    unsigned int                expires;                //到期的时钟中断计数
+    struct workqueue_struct *   wq;                     //到期后加入的工作队列
+};
+
+//工作队列，由一个内核线程依次处理其中的工作项
+struct workqueue_struct{
+    struct list_head        worklist;                   //待处理工作项链表
+    struct list_head        waitq;                      //空闲时工作线程在此睡眠，仅由queue_work()唤醒
+    task_struct *           worker;                     //工作线程
+    char                    name[WQ_NAME_LEN];          //工作队列名
+};
+
+#define INIT_WORK(_work, _func)                 \
+    do {                                        \
+        INIT_LIST_HEAD(&(_work)->entry);        \
+        (_work)->func = (_func);                \
+        (_work)->pending = 0;                   \
+    } while (0)
+
+#define INIT_DELAYED_WORK(_dwork, _func)        \
+    do {                                        \
+        INIT_WORK(&(_dwork)->work, (_func));    \
+        INIT_LIST_HEAD(&(_dwork)->timer);       \
+        (_dwork)->expires = 0;                  \
+        (_dwork)->wq = 0;                       \
+    } while (0)
+
+extern struct workqueue_struct * system_wq;         //系统工作队列
+extern unsigned int wq_ticks;                       //时钟中断计数
+
+void init_workqueues();
+struct workqueue_struct * create_workqueue(char * name, long prority);
+int queue_work(struct workqueue_struct * wq, struct work_struct * work);
+int queue_delayed_work(struct workqueue_struct * wq, struct delayed_work * dwork, unsigned int delay);
+int cancel_delayed_work(struct delayed_work * dwork);
+int schedule_work(struct work_struct * work);
+int schedule_delayed_work(struct delayed_work * dwork, unsigned int delay);
+void workqueue_tick();
+int run_workqueue(struct workqueue_struct * wq);
+void worker_wait(struct workqueue_struct * wq);
+
+#endif  // !_ZJUNIX_WORKQUEUE_H
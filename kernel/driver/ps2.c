@@ -1,6 +1,9 @@
 #include "ps2.h"
 #include <driver/vga.h>
 #include <intr.h>
+#include <zjunix/lock.h>
+#include <zjunix/ring.h>
+#include <zjunix/time.h>
 
 #pragma GCC push_options
 #pragma GCC optimize("O0")
@@ -15,12 +18,19 @@ static volatile unsigned int keyboard_state = 0;
 #define CTRL_MASK 16
 #define ALT_MASK 32
 
-static unsigned int buffer[32];
-static unsigned int ready[32];
-static volatile int buffer_wptr = 0;
-static volatile int buffer_rptr = 0;
+// Key ring filled by ps2_handler(), large enough for pasted input.
+// Readers take key_read_lock so the ring keeps a single consumer; the
+// handler never waits for it.
+#define KEY_RING_SIZE 256
+static unsigned int key_data[KEY_RING_SIZE];
+static struct ring key_ring = RING_INIT(key_data);
+static DEFINE_LOCK(key_read_lock);
 static unsigned int key_buffer = 0;
 static unsigned int keyboard_cmd_state = 0;
+// tasks blocked in kernel_getchar()
+static LIST_HEAD(keyboard_wait);
+// cycle count when the newest key arrived
+static volatile unsigned int key_stamp = 0;
 
 signed char scantoascii_uppercase[] = {
     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x09, 0x7E, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x51,
@@ -44,7 +54,7 @@ void print_wptr() {
     col = cursor_col;
     cursor_row = 19;
     cursor_col = 32;
-    kernel_printf("Wptr: %x\n", buffer_wptr);
+    kernel_printf("Wptr: %x\n", key_ring.head);
     cursor_row = row;
     cursor_col = col;
 }
@@ -55,7 +65,7 @@ void print_rptr() {
     col = cursor_col;
     cursor_row = 20;
     cursor_col = 32;
-    kernel_printf("Rptr: %x\n", buffer_rptr);
+    kernel_printf("Rptr: %x\n", key_ring.tail);
     cursor_row = row;
     cursor_col = col;
 }
@@ -68,14 +78,7 @@ void print_buffer() {
     cursor_row = 21;
     cursor_col = 32;
     for (i = 0; i < 32; i++) {
-        kernel_printf("%x ", ready[i]);
-        if (7 == (i % 8)) {
-            cursor_col = 32;
-            cursor_row++;
-        }
-    }
-    for (i = 0; i < 32; i++) {
-        kernel_printf("%x ", buffer[i]);
+        kernel_printf("%x ", key_data[(key_ring.tail + i) & (KEY_RING_SIZE - 1)]);
         if (7 == (i % 8)) {
             cursor_col = 32;
             cursor_row++;
@@ -110,13 +113,7 @@ void print_curr_char(int key) {
 #endif  // ! PS2_DEBUG
 
 void init_buffer() {
-    int i = 0;
-    for (i = 0; i < 32; i++) {
-        buffer[i] = 0;
-        ready[i] = 0;
-    }
-    buffer_wptr = 0;
-    buffer_rptr = 0;
+    init_ring(&key_ring, key_data, sizeof(key_data[0]), KEY_RING_SIZE);
 }
 
 void init_ps2() {
@@ -145,10 +142,11 @@ void ps2_handler(unsigned int status, unsigned int cause, context* pt_context) {
         }
         key_buffer = (key_buffer << 8) | ps2_data_reg;
         if (ps2_data_reg < 0x80) {
-            if ((key_buffer & 0x7f) == key_buffer) {
-                buffer[buffer_wptr] = key_buffer;
-                ready[buffer_wptr] = 1;
-                buffer_wptr = (buffer_wptr + 1) & 31;
+            // a full ring drops the key (counted in key_ring.dropped)
+            // instead of overwriting unread ones
+            if ((key_buffer & 0x7f) == key_buffer && ring_push(&key_ring, &key_buffer)) {
+                key_stamp = get_cycles();
+                wakeup_queue(&keyboard_wait);
 #ifdef PS2_DEBUG
                 print_wptr();
 #endif  // ! PS2_DEBUG
@@ -195,19 +193,17 @@ void ps2_handler(unsigned int status, unsigned int cause, context* pt_context) {
 }
 
 int kernel_getkey() {
-    int temp;
-    if (ready[buffer_rptr] == 0) {
+    unsigned int temp;
+    int got;
+    lockup(&key_read_lock);
+    got = ring_pop(&key_ring, &temp);
+    unlock(&key_read_lock);
+    if (!got) {
         return 0xfff;
     }
-    temp = buffer[buffer_rptr];
 #ifdef PS2_DEBUG
     print_curr_key(temp);
 #endif  // ! PS2_DEBUG
-    ready[buffer_rptr] = 0;
-    buffer_rptr = buffer_rptr + 1;
-    if (buffer_rptr == 32) {
-        init_buffer();
-    }
 #ifdef PS2_DEBUG
     print_rptr();
 #endif  // ! PS2_DEBUG
@@ -229,11 +225,24 @@ void sleep(int cycle) {
         ;
 }
 
+// Cycle count when the newest key arrived, for keystroke latency measurement
+unsigned int ps2_key_stamp() {
+    return key_stamp;
+}
+
+// Block until a key is available; tasks sleep on keyboard_wait instead of
+// polling so they do not compete with runnable tasks while idle
 int kernel_getchar() {
     int key;
+    int old_ie;
     do {
+        old_ie = disable_interrupts();
+        if (ring_empty(&key_ring) && current_task != 0 && current_task->pid != IDLE_PID) {
+            sleep_on(&keyboard_wait);
+        } else if (old_ie) {
+            enable_interrupts();
+        }
         key = kernel_scantoascii(kernel_getkey());
-        sleep(1000);
     } while (key == -1);
 #ifdef PS2_DEBUG
     print_curr_char(key);
@@ -1,5 +1,8 @@
 #include "sd.h"
 #include <driver/vga.h>
+#include <zjunix/mutex.h>
+#include <zjunix/lock.h>
+#include <intr.h>
 
 #pragma GCC push_opitons
 #pragma GCC optimize("O0")
@@ -25,14 +28,8 @@ static int sd_send_cmd_blocking(int cmd, int argument) {
 
 int sd_read_sector_blocking(int id, void* buffer) {
     // Disable interrupts
-    unsigned int prev_status;
-    asm volatile(
-        "mfc0 $t0, $12\n\t"
-        "move %0, $t0\n\t"
-        "li $t1, -2\n\t"
-        "and $t0, $t0, $t1\n\t"
-        "mtc0 $t0, $12\n\t"
-        : "=r"(prev_status));
+    unsigned int old_ie;
+    old_ie = disable_interrupts();
     int code;
     int* buffer_int = (int*)buffer;
     int i;
@@ -52,20 +49,15 @@ int sd_read_sector_blocking(int id, void* buffer) {
     }
 ret:
     // Enable interrupts
-    asm volatile("mtc0 %0, $12\n\t" : : "r"(prev_status));
+    if (old_ie)
+        enable_interrupts();
     return code;
 }
 
 int sd_write_sector_blocking(int id, void* buffer) {
     // Disable interrupts
-    unsigned int prev_status;
-    asm volatile(
-        "mfc0 $t0, $12\n\t"
-        "move %0, $t0\n\t"
-        "li $t1, -2\n\t"
-        "and $t0, $t0, $t1\n\t"
-        "mtc0 $t0, $12\n\t"
-        : "=r"(prev_status));
+    unsigned int old_ie;
+    old_ie = disable_interrupts();
     int code;
     int* buffer_int = (int*)buffer;
     int i;
@@ -84,7 +76,8 @@ int sd_write_sector_blocking(int id, void* buffer) {
         code = 0;
 ret:
     // Enable interrupts
-    asm volatile("mtc0 %0, $12\n\t" : : "r"(prev_status));
+    if (old_ie)
+        enable_interrupts();
     return code;
 }
 
@@ -92,33 +85,40 @@ typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned long u32;
 
+// Serializes multi-sector transfers; a low-priority task in the middle of
+// one is boosted while a higher-priority task waits for the card
+static DEFINE_MUTEX(sd_mutex);
+
 u32 sd_read_block(unsigned char* buf, unsigned long addr, unsigned long count) {
     u32 i;
-    u32 result;
+    u32 result = 0;
+    mutex_lock(&sd_mutex);
     if (1 == count) {
         // read single block
-        return sd_read_sector_blocking(addr, buf);
+        result = sd_read_sector_blocking(addr, buf);
     } else {
         // read multiple block
         for (i = 0; i < count; ++i) {
-            result = sd_read_sector_blocking(addr + i, buf + i * SECSIZE);
-            if (0 != result) {
-                return 1;
+            if (0 != sd_read_sector_blocking(addr + i, buf + i * SECSIZE)) {
+                result = 1;
+                break;
             }
         }
-        return 0;
     }
+    mutex_unlock(&sd_mutex);
+    return result;
 }
 
 u32 sd_write_block(unsigned char* buf, unsigned long addr, unsigned long count) {
     u32 i;
-    u32 result;
+    u32 result = 0;
 #ifdef SD_DEBUG
     kernel_printf("Count: %x, Addr: %x", count, addr);
 #endif
+    mutex_lock(&sd_mutex);
     if (1 == count) {
         // write single block
-        return sd_write_sector_blocking(addr, buf);
+        result = sd_write_sector_blocking(addr, buf);
     } else {
         // write multiple block
         for (i = 0; i < count; ++i) {
@@ -126,11 +126,105 @@ u32 sd_write_block(unsigned char* buf, unsigned long addr, unsigned long count)
             if (0 != result) {
                 kernel_printf("Error: sd_write_sector_blocking failed:%x\n", result);
                 kernel_printf("index=%x, buf=%x\n", addr + i, (int)(buf + i * SECSIZE));
-                return 1;
+                result = 1;
+                break;
             }
         }
-        return 0;
     }
+    mutex_unlock(&sd_mutex);
+    return result;
+}
+
+// Requests from sd_submit(), served in order by sd_co
+static LIST_HEAD(sd_queue);
+static DEFINE_LOCK(sd_queue_lock);
+static struct co_waitq sd_queue_wait = CO_WAITQ_INIT(sd_queue_wait);
+static struct coroutine sd_co;
+static int sd_co_started;
+// state kept across yields of sd_co
+static struct sd_request* sd_cur;
+static int sd_status;
+
+void sd_request_init(struct sd_request* req, int write, unsigned long addr, unsigned char* buf) {
+    req->write = write;
+    req->addr = addr;
+    req->buf = buf;
+    req->result = 0;
+    req->done = 0;
+    init_co_waitq(&(req->wait));
+    INIT_LIST_HEAD(&(req->list));
+}
+
+static void sd_complete(int result) {
+    mutex_unlock(&sd_mutex);
+    sd_cur->result = result;
+    sd_cur->done = 1;
+    co_wake_all(&(sd_cur->wait));
+}
+
+// The same command sequence as sd_read_sector_blocking() and
+// sd_write_sector_blocking(), but the controller is polled once per
+// executor round instead of spinning with interrupts off. sd_mutex keeps
+// sd_read_block()/sd_write_block() callers away from the card meanwhile.
+static int sd_co_run(struct coroutine* co) {
+    int* buf;
+    int i;
+    unsigned int flags;
+
+    CO_BEGIN(co);
+    while (1) {
+        CO_WAIT_EVENT(co, &sd_queue_wait, !list_empty(&sd_queue));
+        CO_WAIT_UNTIL(co, mutex_trylock(&sd_mutex));
+        flags = spin_lock_irqsave(&sd_queue_lock);
+        sd_cur = list_entry(sd_queue.next, struct sd_request, list);
+        list_del_init(&(sd_cur->list));
+        spin_unlock_irqrestore(&sd_queue_lock, flags);
+
+        buf = (int*)sd_cur->buf;
+        SD_CTRL[18] = 0;  // DMA address
+        SD_CTRL[15] = 0;  // Clear data transfer events
+        if (sd_cur->write) {
+            for (i = 0; i < 128; i++)
+                SD_BUF[i] = buf[i];
+        }
+        SD_CTRL[1] = sd_cur->write ? 0x1859 : 0x1139;
+        SD_CTRL[0] = sd_cur->addr;
+        // Wait for command transaction
+        CO_YIELD(co);
+        CO_WAIT_UNTIL(co, (sd_status = SD_CTRL[13]) != 0);
+        if (!(sd_status & 1)) {
+            sd_complete(sd_status);
+            continue;
+        }
+        CO_WAIT_UNTIL(co, (sd_status = SD_CTRL[15]) != 0);
+        if (sd_status & 1) {
+            if (!sd_cur->write) {
+                buf = (int*)sd_cur->buf;
+                for (i = 0; i < 128; i++)
+                    buf[i] = SD_BUF[i];
+            }
+            sd_status = 0;
+        }
+        sd_complete(sd_status);
+    }
+    CO_END(co);
+}
+
+// Queue a one-sector transfer for the SD coroutine. Completion sets
+// req->done and wakes req->wait; see CO_AWAIT_SD().
+void sd_submit(struct sd_request* req) {
+    unsigned int flags;
+
+    flags = spin_lock_irqsave(&sd_queue_lock);
+    req->done = 0;
+    list_add_tail(&(req->list), &sd_queue);
+    if (!sd_co_started) {
+        sd_co_started = 1;
+        co_init(&sd_co, sd_co_run, 0, 0);
+        co_start(&sd_co);
+    }
+    co_wake_all(&sd_queue_wait);
+    spin_unlock_irqrestore(&sd_queue_lock, flags);
 }
 
 #pragma GCC pop_options
\ No newline at end of file
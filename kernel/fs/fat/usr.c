@@ -1,6 +1,7 @@
 #include <driver/vga.h>
 #include <zjunix/log.h>
 #include <zjunix/slab.h>
+#include <zjunix/mfs/fat32.h>
 #include "fat.h"
 #include "utils.h"
 
@@ -16,12 +17,17 @@ u32 fs_rm(u8 *filename) {
     if (fs_open(&mk_dir, filename) == 1)
         goto fs_rm_err;
 
+    /* A mapped file keeps its clusters: mappings still store to them */
+    clus = get_start_cluster(&mk_dir);
+    if (clus != 0 && fat32_mapped(clus)) {
+        log(LOG_FAIL, "fs_rm: file is mapped.");
+        goto fs_rm_err;
+    }
+
     /* Mark 0xE5 */
     mk_dir.entry.data[0] = 0xE5;
 
     /* Release all allocated block */
-    clus = get_start_cluster(&mk_dir);
-
     while (clus != 0 && clus <= fat_info.total_data_clusters + 1) {
         if (get_fat_entry_value(clus, &next_clus) == 1)
             goto fs_rm_err;
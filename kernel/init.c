@@ -13,6 +13,9 @@
 #include <zjunix/slab.h>
 #include <zjunix/syscall.h>
 #include <zjunix/time.h>
+#include <zjunix/workqueue.h>
+#include <zjunix/coroutine.h>
+#include <zjunix/workerpool.h>
 #include "../usr/ps.h"
 
 void machine_info() {
@@ -33,13 +36,17 @@ void machine_info() {
 void create_startup_process() {
     int res;
 
-    res = task_create("Shell_init", 0, (void *)ps, 0, 0, 0, 0);
+    res = task_create_policy("Shell_init", 0, SCHED_RR, SHELL_RT_PRIORITY, (void *)ps, 0, 0, 0, 0);
     if(res != 0){
         kernel_printf("Create startup process failed!\n");
     }
     else{
         kernel_printf("Shell_init created!");
     }
+    res = task_create_periodic("time", SYSTEM_TIME_PERIOD, SYSTEM_TIME_RUNTIME, 0, (void *)system_time_proc, 0, 0, 0);
+    if(res != 0){
+        kernel_printf("Create time process failed!\n");
+    }
     // unsigned int init_gp;
     // asm volatile("la %0, _gp\n\t" : "=r"(init_gp));
     // pc_create(1, ps, (unsigned int)kmalloc(4096) + 4096, init_gp, "powershell");
@@ -81,6 +88,12 @@ void init_kernel() {
     log(LOG_START, "Process Control Module.");
     init_pc();
     create_startup_process();
+    init_workqueues();
+    log(LOG_OK, "Workqueues.");
+    init_coroutines();
+    log(LOG_OK, "Coroutines.");
+    init_worker_pool();
+    log(LOG_OK, "Worker pool.");
     log(LOG_END, "Process Control Module.");
     // Interrupts
     log(LOG_START, "Enable Interrupts.");
@@ -1,35 +1,165 @@
 #include "lock.h"
+#include <driver/vga.h>
 #include <intr.h>
+#include <zjunix/preempt.h>
+#include <zjunix/time.h>
+#include <zjunix/utils.h>
 
-void init_lock(struct lock_t *lock) {
+#ifdef LOCK_STAT
+// every lock acquired at least once, newest first
+static struct lock_t *lock_stat_list = 0;
+#endif
+
+void init_lock(struct lock_t *lock, const char *name) {
     lock->spin = 0;
-    INIT_LIST_HEAD(&(lock->wait));
+#ifdef LOCK_STAT
+    kernel_memset(&(lock->stat), 0, sizeof(struct lock_stat));
+    lock->stat.name = name;
+#endif
 }
 
-unsigned int lockup(struct lock_t *lock) {
+#ifdef LOCK_STAT
+// Called with interrupts off right after taking the lock
+static void lock_stat_acquired(struct lock_t *lock, void *site, unsigned int start, int contended) {
+    struct lock_stat *s = &(lock->stat);
+    unsigned int now = get_cycles();
+
+    if (!s->registered) {
+        s->registered = 1;
+        s->next = lock_stat_list;
+        lock_stat_list = lock;
+    }
+    s->acquired++;
+    if (contended) {
+        s->contended++;
+        s->wait_total += now - start;
+        if (now - start > s->wait_max)
+            s->wait_max = now - start;
+    }
+    s->site = site;
+    s->hold_start = now;
+}
+
+static void lock_stat_release(struct lock_t *lock) {
+    struct lock_stat *s = &(lock->stat);
+    unsigned int hold = get_cycles() - s->hold_start;
+
+    s->hold_total += hold;
+    if (hold > s->hold_max) {
+        s->hold_max = hold;
+        s->hold_max_site = s->site;
+    }
+}
+#endif  // LOCK_STAT
+
+// Test-and-set with interrupts off, spinning with the caller's interrupt
+// state in between. Reports once if the holder never lets go.
+static void spin_acquire(struct lock_t *lock, void *site) {
     unsigned int old_ie;
+    unsigned int loops = 0;
+#ifdef LOCK_STAT
+    unsigned int start = get_cycles();
+#endif
 
-    old_ie = disable_interrupts();
-    if (lock->spin) {
+    while (1) {
+        old_ie = disable_interrupts();
+        if (lock->spin == 0) {
+            lock->spin = 1;
+#ifdef LOCK_STAT
+            lock_stat_acquired(lock, site, start, loops != 0);
+#endif
+            if (old_ie)
+                enable_interrupts();
+            return;
+        }
+        if (old_ie)
+            enable_interrupts();
+        if (++loops == SPIN_LOCKUP_LOOPS)
+            kernel_printf("lockup: spinlock %x held too long\n", (unsigned int)lock);
     }
-    lock->spin = 1;
-    if (old_ie) {
+}
+
+static void spin_release(struct lock_t *lock) {
+#ifdef LOCK_STAT
+    unsigned int old_ie;
+
+    old_ie = disable_interrupts();
+    lock_stat_release(lock);
+    lock->spin = 0;
+    if (old_ie)
         enable_interrupts();
-    }
+#else
+    asm volatile("" : : : "memory");
+    lock->spin = 0;
+#endif
+}
 
+// Holding a lock disables preemption until the matching unlock()
+unsigned int lockup(struct lock_t *lock) {
+    preempt_disable();
+    spin_acquire(lock, __builtin_return_address(0));
     return 1;
 }
 
 unsigned int unlock(struct lock_t *lock) {
+    spin_release(lock);
+    preempt_enable();
+    return 1;
+}
+
+// Take a lock shared with interrupt handlers. Returns the previous interrupt
+// state for spin_unlock_irqrestore().
+unsigned int spin_lock_irqsave(struct lock_t *lock) {
+    unsigned int flags;
+
+    flags = disable_interrupts();
+    preempt_disable();
+    spin_acquire(lock, __builtin_return_address(0));
+    return flags;
+}
+
+// A reschedule deferred by the lock happens once interrupts are back on
+void spin_unlock_irqrestore(struct lock_t *lock, unsigned int flags) {
+    spin_release(lock);
+    preempt_enable();
+    if (flags)
+        enable_interrupts();
+}
+
+// Print the locks with the most total hold time. Call sites are return
+// addresses, look them up in kernel.map.
+void print_lock_stat() {
+#ifdef LOCK_STAT
+    struct lock_stat top[LOCK_STAT_TOP];
+    struct lock_t *lock;
     unsigned int old_ie;
+    int n = 0;
+    int i;
 
+    // copy the top entries with interrupts off, print them afterwards
     old_ie = disable_interrupts();
-    if (lock->spin) {
-        lock->spin = 0;
+    for (lock = lock_stat_list; lock != 0; lock = lock->stat.next) {
+        for (i = n; i > 0 && top[i - 1].hold_total < lock->stat.hold_total; i--) {
+            if (i < LOCK_STAT_TOP)
+                top[i] = top[i - 1];
+        }
+        if (i < LOCK_STAT_TOP) {
+            top[i] = lock->stat;
+            if (n < LOCK_STAT_TOP)
+                n++;
+        }
     }
-    if (old_ie) {
+    if (old_ie)
         enable_interrupts();
-    }
 
-    return 1;
+    kernel_printf("LOCK\t\tACQ\tCONT\tWAIT(ms) max(us)\tHOLD(ms) max(us)\tMAX SITE\n");
+    for (i = 0; i < n; i++) {
+        kernel_printf("%s\t\t%d\t%d\t%d %d\t\t%d %d\t\t%x\n", top[i].name ? top[i].name : "?", top[i].acquired,
+                      top[i].contended, cycles_to_ms(top[i].wait_total),
+                      top[i].wait_max / (CYCLES_PER_SEC / 1000000), cycles_to_ms(top[i].hold_total),
+                      top[i].hold_max / (CYCLES_PER_SEC / 1000000), (unsigned int)top[i].hold_max_site);
+    }
+#else
+    kernel_printf("lock statistics are not compiled in, define LOCK_STAT in zjunix/lock.h\n");
+#endif  // LOCK_STAT
 }
@@ -0,0 +1,186 @@
+#include <zjunix/mutex.h>
+#include <zjunix/time.h>
+#include <driver/vga.h>
+#include <intr.h>
+
+// ring of the most recent priority inversions
+struct pi_trace pi_traces[PI_TRACE_NUM];
+unsigned int pi_trace_count = 0;
+
+void init_mutex(struct mutex *m, const char *name) {
+    m->owner = 0;
+    INIT_LIST_HEAD(&(m->wait_list));
+    INIT_LIST_HEAD(&(m->held));
+    m->name = name;
+    m->inv_count = 0;
+    m->inv_max = 0;
+}
+
+static void mutex_acquire(struct mutex *m, task_struct *task) {
+    m->owner = task;
+    list_add(&(m->held), &(task->pi_held));
+}
+
+// Highest-priority waiter, the earliest one among equals; 0 if none
+static task_struct *mutex_top_waiter(struct mutex *m) {
+    struct list_head *pos;
+    task_struct *task;
+    task_struct *top = 0;
+
+    list_for_each(pos, &(m->wait_list)) {
+        task = container_of(pos, task_struct, sched);
+        if (top == 0 || pi_prio(task) > pi_prio(top))
+            top = task;
+    }
+    return top;
+}
+
+// Recompute the boost of task from the waiters on every mutex it holds.
+// extra is the priority of a task about to wait that is not queued yet.
+// Returns 1 if the effective priority of task changed.
+static int pi_adjust(task_struct *task, int extra) {
+    struct list_head *pos;
+    task_struct *top;
+    int prio = extra;
+
+    list_for_each(pos, &(task->pi_held)) {
+        top = mutex_top_waiter(container_of(pos, struct mutex, held));
+        if (top != 0 && pi_prio(top) > prio)
+            prio = pi_prio(top);
+    }
+    return pi_setprio(task, prio);
+}
+
+// Boost owner to prio, then follow the chain while each boosted owner is
+// itself blocked on another mutex. Returns the number of tasks boosted.
+static int pi_boost_chain(task_struct *owner, int prio) {
+    int depth = 0;
+
+    while (owner != 0 && depth < PI_MAX_CHAIN) {
+        if (!pi_adjust(owner, prio))
+            break;
+        depth++;
+        if (owner->pi_blocked_on == 0)
+            break;
+        owner = owner->pi_blocked_on->owner;
+        prio = PI_PRIO_NONE;
+    }
+    return depth;
+}
+
+static void pi_trace_record(struct mutex *m, pid_t owner, int depth, unsigned int duration) {
+    struct pi_trace *t = &pi_traces[pi_trace_count & (PI_TRACE_NUM - 1)];
+
+    t->name = m->name;
+    t->waiter = current_task->pid;
+    t->owner = owner;
+    t->depth = depth;
+    t->duration = duration;
+    pi_trace_count++;
+    m->inv_count++;
+    if (duration > m->inv_max)
+        m->inv_max = duration;
+}
+
+// Sleep until the mutex is ours. A lower-priority owner (and whatever it is
+// blocked on) is boosted to our priority meanwhile. Process context only.
+void mutex_lock(struct mutex *m) {
+    unsigned int old_ie;
+    unsigned int start;
+    pid_t owner;
+    int inverted, depth;
+
+    // before init_pc() there is a single thread of execution
+    if (current_task == 0)
+        return;
+    old_ie = disable_interrupts();
+    if (m->owner == 0) {
+        mutex_acquire(m, current_task);
+        if (old_ie)
+            enable_interrupts();
+        return;
+    }
+
+    owner = m->owner->pid;
+    start = get_cycles();
+    inverted = pi_prio(m->owner) < pi_prio(current_task);
+    depth = pi_boost_chain(m->owner, pi_prio(current_task));
+    current_task->pi_blocked_on = m;
+    // mutex_unlock() hands the mutex over before waking us
+    sleep_on(&(m->wait_list));
+
+    disable_interrupts();
+    if (inverted)
+        pi_trace_record(m, owner, depth, get_cycles() - start);
+    if (old_ie)
+        enable_interrupts();
+}
+
+// Returns 1 if the mutex was free and is now ours, 0 otherwise
+int mutex_trylock(struct mutex *m) {
+    unsigned int old_ie;
+    int ret = 0;
+
+    if (current_task == 0)
+        return 1;
+    old_ie = disable_interrupts();
+    if (m->owner == 0) {
+        mutex_acquire(m, current_task);
+        ret = 1;
+    }
+    if (old_ie)
+        enable_interrupts();
+    return ret;
+}
+
+// Hand the mutex to the top waiter, who inherits the remaining waiters'
+// boost, and drop our own boost to what the mutexes we still hold require
+void mutex_unlock(struct mutex *m) {
+    unsigned int old_ie;
+    task_struct *next;
+
+    if (current_task == 0)
+        return;
+    old_ie = disable_interrupts();
+    list_del(&(m->held));
+    INIT_LIST_HEAD(&(m->held));
+    m->owner = 0;
+    next = mutex_top_waiter(m);
+    if (next != 0) {
+        next->pi_blocked_on = 0;
+        mutex_acquire(m, next);
+        wakeup_task(next);
+        pi_adjust(next, PI_PRIO_NONE);
+    }
+    pi_adjust(current_task, PI_PRIO_NONE);
+    if (old_ie)
+        enable_interrupts();
+}
+
+// Take task, killed while sleeping in mutex_lock(), off the wait list and
+// drop the boost it gave the owner and whatever the owner is blocked on.
+// Interrupts off.
+void mutex_cancel_wait(task_struct *task) {
+    struct mutex *m = task->pi_blocked_on;
+
+    if (m == 0)
+        return;
+    list_del(&(task->sched));
+    INIT_LIST_HEAD(&(task->sched));
+    task->pi_blocked_on = 0;
+    pi_boost_chain(m->owner, PI_PRIO_NONE);
+}
+
+// Print the most recent priority inversions, oldest first
+void print_pi_trace() {
+    unsigned int i, first;
+    struct pi_trace *t;
+
+    kernel_printf("priority inversions: %d\n", pi_trace_count);
+    first = pi_trace_count > PI_TRACE_NUM ? pi_trace_count - PI_TRACE_NUM : 0;
+    for (i = first; i < pi_trace_count; i++) {
+        t = &pi_traces[i & (PI_TRACE_NUM - 1)];
+        kernel_printf("  %s: waiter %d owner %d chain %d  %dus\n", t->name, t->waiter, t->owner, t->depth,
+                      t->duration / (CYCLES_PER_SEC / 1000000));
+    }
+}
@@ -0,0 +1,52 @@
+#include <zjunix/semaphore.h>
+#include <intr.h>
+
+void init_sema(struct semaphore *sem, int count) {
+    sem->count = count;
+    INIT_LIST_HEAD(&(sem->wait_list));
+}
+
+// Take one unit, sleeping at the tail of the wait list if there is none
+void down(struct semaphore *sem) {
+    unsigned int old_ie;
+
+    old_ie = disable_interrupts();
+    if (sem->count > 0) {
+        sem->count--;
+        if (old_ie)
+            enable_interrupts();
+        return;
+    }
+    // up() passes its unit to us before waking us
+    sleep_on(&(sem->wait_list));
+    if (!old_ie)
+        disable_interrupts();
+}
+
+// Returns 1 if a unit was taken, 0 otherwise
+int down_trylock(struct semaphore *sem) {
+    unsigned int old_ie;
+    int ret = 0;
+
+    old_ie = disable_interrupts();
+    if (sem->count > 0) {
+        sem->count--;
+        ret = 1;
+    }
+    if (old_ie)
+        enable_interrupts();
+    return ret;
+}
+
+// Release one unit to the longest waiter, or back to the count
+void up(struct semaphore *sem) {
+    unsigned int old_ie;
+
+    old_ie = disable_interrupts();
+    if (sem->wait_list.next != &(sem->wait_list))
+        wakeup_task(container_of(sem->wait_list.next, task_struct, sched));
+    else
+        sem->count++;
+    if (old_ie)
+        enable_interrupts();
+}
@@ -1,4 +1,5 @@
 #include <driver/vga.h>
+#include <intr.h>
 #include <zjunix/log.h>
 #include <zjunix/slab.h>
 
@@ -6,6 +7,8 @@
 #include <zjunix/mfs/fat32.h>
 #include <zjunix/mfs/debug.h>
 
+#include <zjunix/workqueue.h>
+
 #include "utils.h"
 #include "../fs/fat/utils.h"
 #include "../../usr/ls.h"
@@ -18,6 +21,16 @@ struct Total_FAT_Info total_info;
 struct mem_dentry * pwd_dentry;
 struct mem_dentry * root_dentry;
 
+static void fat32_writeback_work(struct work_struct *work);
+static struct work_struct writeback_work;
+
+// Files mapped into address spaces, by start cluster. The mappings store
+// straight into the files' clusters until they are gone.
+static struct {
+    u32 start_clu;
+    u32 count;              // mappings of the file, 0 for a free entry
+} mapped_files[MAPPED_FILE_NUM];
+
 u32 init_fat32(u32 base)
 {
     if (init_total_info() == COMMON_ERR) {
@@ -34,6 +47,8 @@ u32 init_fat32(u32 base)
         log(LOG_FAIL, "Load root dentries fail.");
     }
 
+    INIT_WORK(&writeback_work, fat32_writeback_work);
+
     return 0;
 }
 
@@ -384,8 +399,68 @@ void fat32_lseek(MY_FILE *file, u32 new_loc) {
     file->crt_pointer_position = new_loc;
 }
 
+// Write back the caches asynchronously, repeated closes before the worker
+// runs share one writeback
 u32 fat32_close(MY_FILE *file) {
-    fat32_fflush();
+    if (!schedule_work(&writeback_work) && system_wq == 0)
+        fat32_fflush();
+    return 0;
+}
+
+// Runs in the system workqueue; fat32_writeback() keeps the cache lists stable
+static void fat32_writeback_work(struct work_struct *work) {
+    fat32_writeback();
+}
+
+// Register a mapping of the file starting at start_clu
+// Returns 1 if too many files are mapped
+u32 fat32_map(u32 start_clu) {
+    int i, free = -1, old_ie;
+
+    old_ie = disable_interrupts();
+    for (i = 0; i < MAPPED_FILE_NUM; i++) {
+        if (mapped_files[i].count && mapped_files[i].start_clu == start_clu)
+            break;
+        if (!mapped_files[i].count && free < 0)
+            free = i;
+    }
+    if (i == MAPPED_FILE_NUM && free >= 0) {
+        i = free;
+        mapped_files[i].start_clu = start_clu;
+    }
+    if (i < MAPPED_FILE_NUM)
+        mapped_files[i].count++;
+    if (old_ie)
+        enable_interrupts();
+    return i == MAPPED_FILE_NUM;
+}
+
+// Drop a mapping registered with fat32_map()
+void fat32_unmap(u32 start_clu) {
+    int i, old_ie;
+
+    old_ie = disable_interrupts();
+    for (i = 0; i < MAPPED_FILE_NUM; i++) {
+        if (mapped_files[i].count && mapped_files[i].start_clu == start_clu) {
+            mapped_files[i].count--;
+            break;
+        }
+    }
+    if (old_ie)
+        enable_interrupts();
+}
+
+// Whether the file starting at start_clu is mapped. Deleting or truncating
+// the file must fail meanwhile: its freed clusters could be given to
+// another file while the mappings still store to them.
+u32 fat32_mapped(u32 start_clu) {
+    int i;
+
+    for (i = 0; i < MAPPED_FILE_NUM; i++) {
+        if (mapped_files[i].count && mapped_files[i].start_clu == start_clu)
+            return 1;
+    }
+    return 0;
 }
 
 u32 fat32_create(u8 *filename) {
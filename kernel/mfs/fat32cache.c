@@ -1,18 +1,34 @@
+#include <arch.h>
 #include <zjunix/log.h>
+#include <zjunix/buddy.h>
 #include <driver/vga.h>
 #include <zjunix/slab.h>
 #include <zjunix/utils.h>
 
 #include <zjunix/mfs/fat32cache.h>
 #include <zjunix/mfs/debug.h>
+#include <zjunix/preempt.h>
+#include <zjunix/mutex.h>
 
 #include "utils.h"
 #include "../fs/fat/utils.h"
 
+// struct page of the frame holding a cached cluster. The cache holds one
+// reference, every user pte mapping the cluster (kernel/vm/filemap.c) one
+// more; mapped pages are pinned in the cache
+#define page_frame(p) (pages + (((u32)(p)->p_data & ~KERNEL_ENTRY) >> PAGE_SHIFT))
+#define page_mapped(p) (page_frame(p)->reference > 1)
+
 struct D_cache *dcache;
 struct P_cache *pcache;
 struct T_cache *tcache;
 
+// Serializes the three caches. Misses and evictions do sd card I/O under it,
+// so it is a sleeping lock and other tasks keep running meanwhile.
+static DEFINE_MUTEX(fat32_cache_mutex);
+
+static struct mem_page * __get_page(u32 relative_cluster_num);
+
 extern struct Total_FAT_Info total_info;
 
 u32 init_cache() {
@@ -46,6 +62,7 @@ u32 init_cache() {
 
 // Return the mem_dentry struct with no path name
 struct mem_dentry * get_dentry(u32 sector_num, u32 offset) {
+    mutex_lock(&fat32_cache_mutex);
     // look up first
     struct mem_dentry * result = dcache_lookup(dcache, sector_num, offset);
     // if not found
@@ -60,18 +77,55 @@ struct mem_dentry * get_dentry(u32 sector_num, u32 offset) {
         // kernel_printf("offset = %d\n", offset);
 //#endif
         // require the corresponding page
-        struct mem_page * location_page = get_page(page_cluster_num);
+        struct mem_page * location_page = __get_page(page_cluster_num);
         kernel_memcpy(result->dentry_data.data, location_page->p_data + offset * DENTRY_SIZE, DENTRY_SIZE);
         dcache_add(dcache, result);
-        return result;
     } else {
         kernel_printf("dcache look up found!\n");
-        return result;
     }
+    mutex_unlock(&fat32_cache_mutex);
+    return result;
 }
 
 // Input the cluster to data field
 struct mem_page * get_page(u32 relative_cluster_num) {
+    struct mem_page * result;
+
+    mutex_lock(&fat32_cache_mutex);
+    result = __get_page(relative_cluster_num);
+    mutex_unlock(&fat32_cache_mutex);
+    return result;
+}
+
+// get_page() taking a mapping reference on the page, before another task's
+// miss could evict it; put_user_page() drops it
+struct mem_page * map_page(u32 relative_cluster_num) {
+    struct mem_page * result;
+
+    mutex_lock(&fat32_cache_mutex);
+    result = __get_page(relative_cluster_num);
+    if (result != 0)
+        inc_ref(page_frame(result), 1);
+    mutex_unlock(&fat32_cache_mutex);
+    return result;
+}
+
+// Write a page stored to through a user mapping back to sd card, keeping it
+// cached. Mapped pages stay in the cache, so it is never missing
+void sync_page(u32 relative_cluster_num) {
+    struct mem_page * result;
+
+    mutex_lock(&fat32_cache_mutex);
+    result = pcache_lookup(pcache, relative_cluster_num);
+    if (result != 0) {
+        write_page(&total_info, result);
+        result->state = PAGE_CLEAN;
+    }
+    mutex_unlock(&fat32_cache_mutex);
+}
+
+// get_page() with fat32_cache_mutex held
+static struct mem_page * __get_page(u32 relative_cluster_num) {
     // look up first
     struct mem_page * result = pcache_lookup(pcache, relative_cluster_num);
     // if not found
@@ -80,6 +134,9 @@ struct mem_page * get_page(u32 relative_cluster_num) {
         result->state = PAGE_CLEAN;
         result->data_cluster_num = relative_cluster_num;
         result->p_data = (u8 *) kmalloc(CLUSTER_SIZE);
+        // CLUSTER_SIZE is a page, so p_data is a whole frame that user
+        // mappings may share
+        set_ref(page_frame(result), 1);
         // read the corresponding page on disk
         read_page(&total_info, result);
         pcache_add(pcache, result);
@@ -92,6 +149,7 @@ struct mem_page * get_page(u32 relative_cluster_num) {
 }
 
 struct mem_FATbuffer *get_FATBuf(u32 FAT_num, u32 sec_num) {
+    mutex_lock(&fat32_cache_mutex);
     // look up first then same as page cache
     struct mem_FATbuffer * result = tcache_lookup(tcache, FAT_num, sec_num);
 
@@ -109,9 +167,8 @@ struct mem_FATbuffer *get_FATBuf(u32 FAT_num, u32 sec_num) {
         kernel_printf("BEFORE TACHE ADD!\n");
 #endif
         tcache_add(tcache, result);
-        return result;
     }
-    
+    mutex_unlock(&fat32_cache_mutex);
     return result;
 }
 
@@ -288,6 +345,11 @@ void pcache_drop(struct P_cache *pcache) {
     // if it has no pcache reutrn 
     if (pcache->crt_size == 0) return;
     else {
+        // the least recently used page that is not mapped; if all are, the
+        // cache grows past its capacity until some are unmapped
+        while (victim != LRU_head && page_mapped(list_entry(victim, struct mem_page, p_LRU)))
+            victim = victim->prev;
+        if (victim == LRU_head) return;
         // delete from LRU and hash list
         crt_page = list_entry(victim, struct mem_page, p_LRU);
         list_del(victim);
@@ -346,17 +408,67 @@ void fat32_fflush() {
     int dsize = dcache->crt_size;
     int psize = pcache->crt_size;
     int tsize = tcache->crt_size;
+    // each drop may write a page to the sd card: let waiting tasks run in between
     for (int i = 0; i < dsize; i++) {
+        mutex_lock(&fat32_cache_mutex);
         dcache_drop(dcache);
+        mutex_unlock(&fat32_cache_mutex);
+        cond_resched();
     }
     for (int i = 0; i < psize; i++) {
+        mutex_lock(&fat32_cache_mutex);
         pcache_drop(pcache);
+        mutex_unlock(&fat32_cache_mutex);
+        cond_resched();
     }
+    // mapped pages were kept, write them back at least
+    fat32_writeback();
     for (int i = 0; i < tsize; i++) {
+        mutex_lock(&fat32_cache_mutex);
         tcache_drop(tcache);
+        mutex_unlock(&fat32_cache_mutex);
+        cond_resched();
     }
 }
 
+// Write back the first dirty page or FAT buffer, return 0 if there is none
+static int writeback_one() {
+    struct list_head *pos;
+    struct mem_page *crt_page;
+    struct mem_FATbuffer *crt_buf;
+
+    list_for_each(pos, &(pcache->c_LRU)) {
+        crt_page = list_entry(pos, struct mem_page, p_LRU);
+        if (crt_page->state == PAGE_DIRTY) {
+            write_page(&total_info, crt_page);
+            crt_page->state = PAGE_CLEAN;
+            return 1;
+        }
+    }
+    list_for_each(pos, &(tcache->c_LRU)) {
+        crt_buf = list_entry(pos, struct mem_FATbuffer, t_LRU);
+        if (crt_buf->state == PAGE_DIRTY) {
+            write_FAT_buf(&total_info, crt_buf);
+            crt_buf->state = PAGE_CLEAN;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Write dirty pages and FAT buffers back to sd card, keeping them cached.
+// fat32_cache_mutex is held for one entry at a time; other tasks may use the
+// caches between entries, so every entry restarts the scan.
+void fat32_writeback() {
+    int more;
+
+    do {
+        mutex_lock(&fat32_cache_mutex);
+        more = writeback_one();
+        mutex_unlock(&fat32_cache_mutex);
+    } while (more);
+}
+
 // Get hash value
 u32 __intHash(u32 key, u32 size) {
     u32 mask = size - 1;
@@ -1,5 +1,6 @@
 #include <driver/sd.h>
 #include <driver/vga.h>
+#include <zjunix/preempt.h>
 
 #include "utils.h"
 #include "../fs/fat/utils.h"
@@ -157,11 +158,13 @@ u32 get_free_clu(u32 *output) {
     
     u32 i;
     u32 last_FATentry_num = total_info.sectors_per_FAT * SECSIZE / 4;
+    // the scan may read the whole FAT from the sd card: offer to reschedule
     for (i = start_clu; i < last_FATentry_num; i++) {
         if (get_next_clu_num(i) == 0x00000000){
             *output = i;
             return 0;
         }
+        cond_resched();
     }
     
     // If cannot find in those clusters after it
@@ -170,6 +173,7 @@ u32 get_free_clu(u32 *output) {
             *output = i;
             return 0;
         }
+        cond_resched();
     }
 
     // If there is no memory
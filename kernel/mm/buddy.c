@@ -3,6 +3,7 @@
 #include <zjunix/buddy.h>
 #include <zjunix/list.h>
 #include <zjunix/lock.h>
+#include <zjunix/preempt.h>
 #include <zjunix/utils.h>
 
 #define Allign(x, y) (((x)+((y)-1)) & ~((y)-1))
@@ -75,10 +76,11 @@ void init_buddy() {
         INIT_LIST_HEAD(&(buddy.freelist[i].free_head));
     }
     buddy.start_page = pages + buddy.buddy_start_pfn;
-    init_lock(&(buddy.lock));
+    init_lock(&(buddy.lock), "buddy");
 
     for (i = buddy.buddy_start_pfn; i < buddy.buddy_end_pfn; ++i) {
         __free_pages(pages + i, 0);
+        cond_resched();
     }
 }
 
@@ -101,7 +103,7 @@ void __free_pages(struct page *pbpage, unsigned int bplevel) {
         #ifdef budd_debug
         kernel_printf("group%x %x\n", (page_idx), bgroup_idx);
         #endif
-        if(bgroup_page->flag!=0)//the page has been allocated
+        if(bgroup_page->flag!=0)//the page has been allocated (or reserved, or is a slab)
             break;
 
         if (!_is_same_bplevel(bgroup_page, bplevel)) {
@@ -120,14 +122,13 @@ void __free_pages(struct page *pbpage, unsigned int bplevel) {
     }
 
     set_bplevel(pbpage, bplevel);
-
-//    (*(pbpage).flag) = 0;//buddy free
+    set_flags(pbpage, 0);//buddy free, its buddy may merge with it
 
     list_add(&(pbpage->list), &(buddy.freelist[bplevel].free_head));
 #ifdef budd_debug  
     kernel_printf("v%x__addto__%x\n", pbpage->list, buddy.freelist[bplevel].free_head);
 #endif
-     ++buddy.freelist[bplevel].nr_free;
+    ++buddy.freelist[bplevel].nr_free;
     unlock(&buddy.lock);
 }
 
@@ -169,8 +170,7 @@ found:
         list_add(&(buddy_page->list), &(free->free_head));//add into free list 
         ++(free->nr_free);
         set_bplevel(buddy_page, current_order);
-        //(*(buddy_page)).flag = 0;//set to 0
-        set_flags(buddy_page, _PAGE_ALLOCED);
+        set_flags(buddy_page, 0);//free
     }
 
     unlock(&buddy.lock);
@@ -29,6 +29,7 @@ void init_each_slab(struct kmem_cache *cache, unsigned int size) {
     cache->objsize = size;
     cache->objsize  = Allign(size, SIZE_INT);
     cache->size = cache->objsize + sizeof(void *);  // add one char as mark(available), to link the free obj
+    init_lock(&(cache->lock), "kmalloc");
     init_kmem_cpu(&(cache->cpu));
     init_kmem_node(&(cache->node));
 }
@@ -55,7 +56,7 @@ void init_slab() {
 // 64
 void format_slabpage(struct kmem_cache *cache, struct page *page) {
     unsigned char *moffset = (unsigned char *)KMEM_ADDR(page, pages);  // physical addr
-    (*page).flag = 0;//page_slab
+    set_flags(page, _PAGE_SLAB);//kfree() tells slab objects by it; buddy never merges it
     struct slab_head *s_head = (struct slab_head *)moffset;
     void *ptr = moffset  + sizeof(struct slab_head);
  
@@ -68,93 +69,64 @@ void format_slabpage(struct kmem_cache *cache, struct page *page) {
     page->slabp = 0;// slabp represents the base-addr of free space
 }
 
+// A slab page is the cpu page objects are taken from, or sits on the full
+// list (no free object left) or the partial list (some objects freed).
+// Freed objects are chained through their first word from page->slabp;
+// objects never handed out yet are carved from s_head->end_ptr.
 void *slab_alloc(struct kmem_cache *cache) {
     struct slab_head *s_head;
-    void *object = 0;
-    struct page *newpage;
-    // kernel_printf("enter slab_alloc\n");
-    if (cache->cpu.page==0)
-        goto fullPage;
-    newpage = cache->cpu.page;
-    s_head = (struct slab_head*)KMEM_ADDR(newpage, pages);
+    void *object;
+    struct page *page = cache->cpu.page;
+
+    if (page == 0) {
+        if (!list_empty(&(cache->node.partial))) {
 #ifdef SLAB_DEBUG
-    kernel_printf("is_full?%d\n", s_head->isFull);
+            kernel_printf("Get partial page\n");
 #endif
-
-FreeList:
-    if (newpage->slabp != 0) {     // Allocate from free list
-        object = (void*)newpage->slabp;
-        newpage->slabp = *(unsigned int*)newpage->slabp;
-        ++(s_head->nr_objs);
+            page = container_of(cache->node.partial.next, struct page, list);
+            list_del_init(&(page->list));
+            cache->cpu.page = page;
+        } else {
+            // call the buddy system to allocate one more page to be slab-cache
+            page = __alloc_pages(0);  // get bplevel = 0 page === one page
+            if (!page) {  // allocate failed, memory in system is used up
+                kernel_printf("ERROR: slab request one page in cache failed\n");
+                while (1)
+                    ;
+            }
 #ifdef SLAB_DEBUG
-        kernel_printf("From Free-list\nnr_objs:%d\tobject:%x\tnew slabp:%x\n", s_head->nr_objs, object, newpage7s->slabp);
-        // kernel_getchar();
+            kernel_printf("\tnew page, index: %x \n", page - pages);
 #endif  // ! SLAB_DEBUG
-        // kernel_printf("return FreeList-object\n");
-        return object;
+            format_slabpage(cache, page);  // using standard format to shape the new-allocated page
+        }
     }
+    s_head = (struct slab_head *)KMEM_ADDR(page, pages);
 
-fullPage:
-    if(list_empty(&(cache->node.partial))){
-
-    // kernel_printf("Page is Full\n");
-
-    // call the buddy system to allocate one more page to be slab-cache
-    newpage = __alloc_pages(0);// get bplevel = 0 page === one page
-    if(!newpage)
-    {    // allocate failed, memory in system is used up
-        kernel_printf("ERROR: slab request one page in cache failed\n");
-        while(1);
-    }    
-#ifdef SLAB_DEBUG
-        kernel_printf("\tnew page, index: %x \n", newpage - pages);
-#endif  // ! SLAB_DEBUG
-
-    format_slabpage(cache, newpage); // using standard format to shape the new-allocated page,
-    s_head = (struct slab_head*)KMEM_ADDR(newpage, pages);//set the new page be cpu.page
-    goto notFullPage;   
-}
-
-notFullPage:
-    if(s_head->isFull==0)
-    {   
-        // kernel_printf("enter notFullPage\n");
+    if (page->slabp != 0) {  // Allocate from free list
+        object = (void *)page->slabp;
+        page->slabp = *(unsigned int *)object;
+    } else {
         object = s_head->end_ptr;
         s_head->end_ptr = object + cache->size;
-        ++(s_head->nr_objs);
-
-        if(s_head->end_ptr+cache->size - (void*)s_head>= 1<<PAGE_SHIFT)
-        {
+        if (s_head->end_ptr + cache->size - (void *)s_head >= 1 << PAGE_SHIFT)
             s_head->isFull = 1;
-            list_add_tail(&(cache->cpu.page->list), &(cache->node.full));
-            init_kmem_cpu(&(cache->cpu));
-            //after alloc it may full
-#ifdef SLAB_DEBUG
-            kernel_printf("Page become full\n");
-#endif
-        }
-#ifdef SLAB_DEBUG
-        kernel_printf("Page not full\n");
-#endif
-        return object;
     }
+    ++(s_head->nr_objs);
 
+    if (page->slabp == 0 && s_head->isFull) {
 #ifdef SLAB_DEBUG
-        kernel_printf("Get partial page\n");
+        kernel_printf("Page become full\n");
 #endif
-        cache->cpu.page = container_of(cache->node.partial.next, struct page, list);
-        newpage = cache->cpu.page;;
-        list_del(cache->node.partial.next);
-        s_head = (struct slab_head*)KMEM_ADDR(newpage, pages);
-        goto FreeList;
-
-
+        list_add_tail(&(page->list), &(cache->node.full));
+        init_kmem_cpu(&(cache->cpu));
+    }
+    return object;
 }
 
 void slab_free(struct kmem_cache *cache, void *object) {
     struct page *opage = pages + ((unsigned int)object >> PAGE_SHIFT);
-    unsigned int *ptr;
     struct slab_head *s_head = (struct slab_head *)KMEM_ADDR(opage, pages);
+    int was_full;
 
     if (!(s_head->nr_objs)) {
         // kernel_printf("ERROR : slab_free error!\n");
@@ -163,18 +135,15 @@ void slab_free(struct kmem_cache *cache, void *object) {
     }
     object = (void*)((unsigned int)object|KERNEL_ENTRY);
 #ifdef SLAB_DEBUG
-    kernel_printf("page address:%x\n object:%\n slabp:%x\n", opage, object, opage->slabp);//slabp represents the base-addr of free space
+    kernel_printf("page address:%x\n object:%x\n slabp:%x\n", opage, object, opage->slabp);//slabp represents the base-addr of free space
 #endif
-   
-    ptr = (unsigned int *)((unsigned char *)object + cache->offset);
-    *ptr = *((unsigned int *)(s_head->end_ptr));
-    *((unsigned int *)(s_head->end_ptr)) = (unsigned int)object;
+
+    was_full = opage->slabp == 0 && s_head->isFull;
+    *(unsigned int *)object = opage->slabp;
+    opage->slabp = (unsigned int)object;
     --(s_head->nr_objs);
-#ifdef SLAB_DEBUG
-    kernel_printf("slabp: %x\n", opage->slabp);
-#endif
 
-    if (list_empty(&(opage->list))) //it is cpu
+    if (opage == cache->cpu.page) //it is cpu
         return;
 #ifdef SLAB_DEBUG
     kernel_printf("not cpu\n");
@@ -185,12 +154,9 @@ void slab_free(struct kmem_cache *cache, void *object) {
         __free_pages(opage, 0);
         return;
     }
-#ifdef SLAB_DEBUG
-    kernel_printf("has freed\n");
-#endif
-    if((!opage->slabp)&&s_head->isFull){
-    list_del_init(&(opage->list));
-    list_add_tail(&(opage->list), &(cache->node.partial));
+    if (was_full) {
+        list_del_init(&(opage->list));
+        list_add_tail(&(opage->list), &(cache->node.partial));
     }
 }
 
@@ -228,6 +194,7 @@ void *kmalloc(unsigned int size) {
 void *phy_kmalloc(unsigned int size) {
     struct kmem_cache *cache;
     unsigned int bf_index;
+    void *object;
     // kernel_printf("enter phy_kmalloc\n");
     if (!size)
         return 0;
@@ -248,17 +215,25 @@ void *phy_kmalloc(unsigned int size) {
             ;
     }
     // kernel_printf("return slab_alloc\n");
-    return slab_alloc(&(kmalloc_caches[bf_index]));
+    cache = &(kmalloc_caches[bf_index]);
+    lockup(&(cache->lock));
+    object = slab_alloc(cache);
+    unlock(&(cache->lock));
+    return object;
 }
 
 
 void kfree(void *obj) {
     struct page *page;
+    struct kmem_cache *cache;
 
     obj = (void *)((unsigned int)obj & (~KERNEL_ENTRY));
     page = pages + ((unsigned int)obj >> PAGE_SHIFT);
     if (!(page->flag == _PAGE_SLAB))
         return free_pages((void *)((unsigned int)obj & ~((1 << PAGE_SHIFT) - 1)), page->bplevel);
 
-    return slab_free(page->virtual, obj);
+    cache = (struct kmem_cache *)page->virtual;
+    lockup(&(cache->lock));
+    slab_free(cache, obj);
+    unlock(&(cache->lock));
 }
@@ -0,0 +1,209 @@
+#include <zjunix/coroutine.h>
+#include <zjunix/pc.h>
+#include <intr.h>
+#include <driver/vga.h>
+
+//执行器所在的工作队列，由一个内核线程依次运行所有就绪的协程
+struct workqueue_struct * co_wq = 0;
+//就绪协程链表
+static LIST_HEAD(co_ready);
+//就绪协程数
+static unsigned int co_nr_ready = 0;
+//定时等待的协程，按到期时间升序排列
+static LIST_HEAD(co_timers);
+//运行就绪协程的工作项
+static struct work_struct co_work;
+//在最早的定时到期时唤醒协程的延迟工作
+static struct delayed_work co_timer_work;
+static void co_run(struct work_struct * work);
+static void co_timer_fn(struct work_struct * work);
+
+//初始化协程执行器，需在init_workqueues()之后调用
+void init_coroutines(){
+    INIT_LIST_HEAD(&co_ready);
+    INIT_LIST_HEAD(&co_timers);
+    co_nr_ready = 0;
+    INIT_WORK(&co_work, co_run);
+    INIT_DELAYED_WORK(&co_timer_work, co_timer_fn);
+    co_wq = create_workqueue("coroutine", CO_PRORITY);
+    if(co_wq == 0){
+        kernel_printf("Init_coroutines: executor created failed!\n");
+    }
+}
+
+//初始化协程，随后由co_start()开始执行
+//done: 执行完毕后调用，可为0
+void co_init(struct coroutine * co, co_func_t func, void * arg, void (*done)(struct coroutine * co)){
+    co->lc = 0;
+    co->state = CO_DONE;
+    co->func = func;
+    co->arg = arg;
+    co->done = done;
+    INIT_LIST_HEAD(&(co->list));
+    INIT_LIST_HEAD(&(co->timer));
+    co->expires = 0;
+}
+
+//将协程放回就绪链表并通知执行器，调用者需保证中断关闭
+static void co_make_ready(struct coroutine * co){
+    list_del_init(&(co->list));
+    list_del_init(&(co->timer));
+    list_add_tail(&(co->list), &co_ready);
+    co->state = CO_READY;
+    co_nr_ready++;
+    queue_work(co_wq, &co_work);
+}
+
+//开始执行协程，可在中断上下文中调用
+void co_start(struct coroutine * co){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    co_make_ready(co);
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+void init_co_waitq(struct co_waitq * wq){
+    INIT_LIST_HEAD(&(wq->waiters));
+}
+
+//登记在wq上等待，由CO_WAIT_EVENT()调用
+void co_wait(struct coroutine * co, struct co_waitq * wq){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    co->state = CO_WAITING;
+    list_add_tail(&(co->list), &(wq->waiters));
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//等待条件已成立，取消co_wait()的登记
+//登记后已被唤醒时将其从就绪链表中取回，由当前这次执行继续
+void co_wait_cancel(struct coroutine * co){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(co->state == CO_READY){
+        co_nr_ready--;
+    }
+    list_del_init(&(co->list));
+    co->state = CO_RUNNING;
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//重新设置定时延迟工作，在最早的定时到期时运行，调用者需保证中断关闭
+static void co_timer_arm(){
+    struct coroutine * first;
+    int delay;
+
+    if(co_timers.next == &co_timers){
+        return;
+    }
+    first = container_of(co_timers.next, struct coroutine, timer);
+    delay = (int)(first->expires - wq_ticks);
+    cancel_delayed_work(&co_timer_work);
+    queue_delayed_work(co_wq, &co_timer_work, delay > 0 ? delay : 0);
+}
+
+//登记定时等待，由CO_SLEEP()调用
+void co_sleep(struct coroutine * co, unsigned int ticks){
+    struct list_head * pos;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    co->state = CO_WAITING;
+    co->expires = wq_ticks + ticks;
+    list_for_each(pos, &co_timers){
+        if((int)(co->expires - container_of(pos, struct coroutine, timer)->expires) < 0){
+            break;
+        }
+    }
+    list_add_tail(&(co->timer), pos);
+    //新的定时最早到期时重新设置延迟工作
+    if(co_timers.next == &(co->timer)){
+        co_timer_arm();
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//唤醒wq上等待的所有协程，可在中断上下文中调用
+void co_wake_all(struct co_waitq * wq){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    while(wq->waiters.next != &(wq->waiters)){
+        co_make_ready(container_of(wq->waiters.next, struct coroutine, list));
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//定时延迟工作：唤醒到期的协程，并为下一个定时重新设置
+static void co_timer_fn(struct work_struct * work){
+    struct coroutine * co;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    while(co_timers.next != &co_timers){
+        co = container_of(co_timers.next, struct coroutine, timer);
+        if((int)(wq_ticks - co->expires) < 0){
+            break;
+        }
+        co_make_ready(co);
+    }
+    co_timer_arm();
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//执行器：依次运行就绪的协程，直到没有就绪协程
+//每一轮只运行本轮开始时就绪的协程；还有让出的协程时先让同优先级的进程运行，再开始下一轮
+static void co_run(struct work_struct * work){
+    struct coroutine * co;
+    unsigned int n;
+    int ret;
+
+    disable_interrupts();
+    while(co_nr_ready != 0){
+        for(n = co_nr_ready; n != 0 && co_nr_ready != 0; n--){
+            co = container_of(co_ready.next, struct coroutine, list);
+            list_del_init(&(co->list));
+            co_nr_ready--;
+            co->state = CO_RUNNING;
+            enable_interrupts();
+
+            ret = co->func(co);
+
+            disable_interrupts();
+            if(ret == CO_RET_YIELD){
+                list_add_tail(&(co->list), &co_ready);
+                co->state = CO_READY;
+                co_nr_ready++;
+            }
+            else if(ret == CO_RET_EXIT){
+                co->state = CO_DONE;
+                if(co->done != 0){
+                    enable_interrupts();
+                    co->done(co);
+                    disable_interrupts();
+                }
+            }
+            //CO_RET_WAIT：已在等待队列或定时链表中，或者已被唤醒放回就绪链表
+        }
+        if(co_nr_ready != 0){
+            sched_yield();
+            disable_interrupts();
+        }
+    }
+    enable_interrupts();
+}
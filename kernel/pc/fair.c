@@ -0,0 +1,193 @@
+#include <zjunix/fair.h>
+#include <zjunix/time.h>
+
+//公平调度运行队列
+struct fair_rq fair_rq;
+
+//静态优先级到权重的映射，下标为静态优先级（31最高）
+//相邻优先级之间CPU份额相差约25%，优先级15对应默认权重1024
+static const unsigned int fair_prio_to_weight[PRORITY_NUM] = {
+    36,   45,   56,   70,   87,   110,  137,  172,   215,   272,   335,   423,   526,   655,   820,   1024,
+    1277, 1586, 1991, 2501, 3121, 3906, 4904, 6100, 7620, 9548, 11916, 14949, 18705, 23254, 29154, 36291
+};
+
+//a的虚拟运行时间是否早于b，使用有符号差值以容忍回绕
+static int vruntime_before(unsigned long long a, unsigned long long b){
+    return (long long)(a - b) < 0;
+}
+
+//初始化公平调度运行队列
+//在init_pc()中调用
+void init_fair_rq(){
+    fair_rq.tasks_timeline.rb_node = 0;
+    fair_rq.rb_leftmost = 0;
+    fair_rq.min_vruntime = 0;
+    fair_rq.nr_running = 0;
+    fair_rq.load = 0;
+}
+
+//根据静态优先级初始化进程的调度权重
+//idle、init进程（静态优先级-1）使用默认权重
+void fair_init_task(task_struct * task){
+    unsigned int weight = FAIR_NICE_0_WEIGHT;
+    if(task->static_prority >= 0 && task->static_prority < PRORITY_NUM){
+        weight = fair_prio_to_weight[task->static_prority];
+    }
+    task->load_weight = weight;
+    task->load_wmult = 0xffffffff / weight;
+    task->vruntime = 0;
+    task->exec_start = 0;
+    task->on_rq = 0;
+}
+
+//更新运行队列的最小虚拟运行时间，只增不减
+//curr为正在运行（不在树中）的进程，可以为空
+static void update_min_vruntime(task_struct * curr){
+    unsigned long long vruntime = fair_rq.min_vruntime;
+    task_struct * left;
+
+    if(curr != 0){
+        vruntime = curr->vruntime;
+    }
+    if(fair_rq.rb_leftmost != 0){
+        left = rb_entry(fair_rq.rb_leftmost, task_struct, run_node);
+        if(curr == 0 || vruntime_before(left->vruntime, vruntime)){
+            vruntime = left->vruntime;
+        }
+    }
+    if(vruntime_before(fair_rq.min_vruntime, vruntime)){
+        fair_rq.min_vruntime = vruntime;
+    }
+}
+
+//将进程按虚拟运行时间插入红黑树，O(log n)
+void fair_enqueue(task_struct * task){
+    struct rb_node ** link = &(fair_rq.tasks_timeline.rb_node);
+    struct rb_node * parent = 0;
+    task_struct * entry;
+    int leftmost = 1;
+
+    while(*link){
+        parent = *link;
+        entry = rb_entry(parent, task_struct, run_node);
+        //虚拟运行时间相同的进程排在后面，保证同权重进程轮转
+        if(vruntime_before(task->vruntime, entry->vruntime)){
+            link = &(parent->rb_left);
+        }
+        else{
+            link = &(parent->rb_right);
+            leftmost = 0;
+        }
+    }
+
+    //缓存最左节点，选取下一进程时无需遍历
+    if(leftmost){
+        fair_rq.rb_leftmost = &(task->run_node);
+    }
+    rb_link_node(&(task->run_node), parent, link);
+    rb_insert_color(&(task->run_node), &(fair_rq.tasks_timeline));
+
+    task->on_rq = 1;
+    fair_rq.nr_running++;
+    fair_rq.load += task->load_weight;
+}
+
+//将进程从红黑树中移除，O(log n)
+void fair_dequeue(task_struct * task){
+    if(fair_rq.rb_leftmost == &(task->run_node)){
+        fair_rq.rb_leftmost = rb_next(&(task->run_node));
+    }
+    rb_erase(&(task->run_node), &(fair_rq.tasks_timeline));
+
+    task->on_rq = 0;
+    fair_rq.nr_running--;
+    fair_rq.load -= task->load_weight;
+}
+
+//新建或被唤醒的进程进入运行队列前调整其虚拟运行时间
+//睡眠较久的进程最多获得FAIR_SLEEPER_BONUS的补偿，防止其长期独占CPU
+void fair_place(task_struct * task){
+    unsigned long long vruntime = fair_rq.min_vruntime - FAIR_SLEEPER_BONUS;
+    if(vruntime_before(task->vruntime, vruntime)){
+        task->vruntime = vruntime;
+    }
+}
+
+//累加当前进程的加权虚拟运行时间
+//delta_vruntime = delta * 1024 / weight = (delta * wmult) >> 22
+void fair_update_curr(task_struct * curr){
+    unsigned int now = get_cycles();
+    unsigned int delta = now - curr->exec_start;
+
+    curr->exec_start = now;
+    if(curr->load_weight == FAIR_NICE_0_WEIGHT){
+        curr->vruntime += delta;
+    }
+    else{
+        curr->vruntime += ((unsigned long long)delta * curr->load_wmult) >> 22;
+    }
+    update_min_vruntime(curr);
+}
+
+//时钟中断中的公平调度记账，只访问当前进程和缓存的最左节点
+//返回1表示需要重新调度
+int fair_tick(task_struct * curr){
+    task_struct * left;
+
+    //idle进程只要有就绪进程就让出CPU
+    if(curr->pid == IDLE_PID){
+        return fair_rq.nr_running != 0;
+    }
+
+    fair_update_curr(curr);
+    if(fair_rq.rb_leftmost == 0){
+        return 0;
+    }
+    left = rb_entry(fair_rq.rb_leftmost, task_struct, run_node);
+    return vruntime_before(left->vruntime, curr->vruntime);
+}
+
+//仍可运行的当前普通进程放回红黑树
+void fair_put_prev(task_struct * curr){
+    if(curr->pid != IDLE_PID && curr->policy == SCHED_NORMAL && !curr->on_rq &&
+       (curr->state == TASK_RUNNING || curr->state == TASK_READY)){
+        fair_update_curr(curr);
+        fair_enqueue(curr);
+    }
+}
+
+//当前进程主动让出CPU，虚拟运行时间推后到最左进程处
+//相同虚拟运行时间的进程排在后面，随后的fair_pick_next()选取最左进程
+void fair_yield(task_struct * curr){
+    task_struct * left;
+
+    if(curr->pid == IDLE_PID){
+        return;
+    }
+    fair_update_curr(curr);
+    if(fair_rq.rb_leftmost == 0){
+        return;
+    }
+    left = rb_entry(fair_rq.rb_leftmost, task_struct, run_node);
+    if(vruntime_before(curr->vruntime, left->vruntime)){
+        curr->vruntime = left->vruntime;
+    }
+}
+
+//选取虚拟运行时间最小的进程，O(log n)
+//仍可运行的当前进程先放回红黑树，没有就绪进程时返回idle进程
+task_struct * fair_pick_next(task_struct * curr){
+    task_struct * next;
+
+    fair_put_prev(curr);
+
+    if(fair_rq.rb_leftmost == 0){
+        return container_of(sched[PRORITY_NUM].next, task_struct, sched);
+    }
+
+    next = rb_entry(fair_rq.rb_leftmost, task_struct, run_node);
+    fair_dequeue(next);
+    next->exec_start = get_cycles();
+    update_min_vruntime(next);
+    return next;
+}
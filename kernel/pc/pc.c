@@ -1,6 +1,7 @@
 #include <zjunix/pc.h>
 #include <arch.h>
 #include <intr.h>
+#include <irqsoff.h>
 #include <zjunix/syscall.h>
 #include <zjunix/utils.h>
 #include <zjunix/log.h>
@@ -8,6 +9,14 @@
 #include <driver/vga.h>
 #include <driver/ps2.h>
 #include <zjunix/time.h>
+#include <zjunix/fair.h>
+#include <zjunix/rt.h>
+#include <zjunix/workqueue.h>
+#include <zjunix/workerpool.h>
+#include <zjunix/preempt.h>
+#include <zjunix/pi.h>
+#include <zjunix/mutex.h>
+#include <zjunix/rcu.h>
 
 //等待进程链表
 struct list_head wait;
@@ -21,6 +30,31 @@ struct list_head sched[PRORITY_NUM + 1];
 unsigned int sched_time[PRORITY_NUM];
 //当前运行进程指针
 task_struct * current_task = 0;
+static task_struct * find_next_normal();
+static void schedule_tick(context * pt_context);
+static void pc_preempt_irq(unsigned int status, unsigned int cause, context * pt_context);
+//中断返回前是否需要重新调度，由唤醒实时进程或推迟时钟中断调度时设置
+volatile int need_resched = 0;
+//持有锁时到达的时钟中断推迟了调度
+static volatile int tick_deferred = 0;
+//回收终结进程的工作项，等待宽限期时延迟重试
+static struct delayed_work reap_work;
+static void reap_terminal(struct work_struct * work);
+//已从所有进程链表中移除、等待宽限期结束后释放的进程，通过sched链接
+static LIST_HEAD(reap_pending);
+//reap_pending中的进程需等待的宽限期期号
+static int reap_gp;
+//所有进程链表的修改计数，读者据此判断遍历期间链表是否变化
+static seqcount_t tasks_seq = SEQCNT_ZERO;
+//RCU读者状态
+volatile unsigned int rcu_state = 0;
+//周期进程在此等待下一周期
+static LIST_HEAD(period_wait);
+static int do_task_create(char * task_name, long static_prority, int policy, int rt_priority,
+                          void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                          pid_t * ret_pid, int is_user, unsigned int * dl_attr);
+//进程控制块与内核栈共用task_union，编译时检查其大小，超过上限时数组长度为负
+typedef char task_struct_size_check[sizeof(task_struct) <= TASK_STRUCT_MAX_SIZE ? 1 : -1];
 
 int argsc = 0;
 
@@ -46,13 +80,34 @@ void init_pro_map(){
 }
 
 //将进程加入所有进程链表
+//写者之间通过关中断互斥，读者不关中断，遍历时在rcu_read_lock()保护下进行
 void add_tasks(task_struct * task){
-    list_add_tail(&(task->list), &tasks);
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    write_seqcount_begin(&tasks_seq);
+    list_add_tail_rcu(&(task->list), &tasks);
+    write_seqcount_end(&tasks_seq);
+    if(old_ie){
+        enable_interrupts();
+    }
 }
 
 //将进程加入调度链表
 //空进程加入末尾，其他进程按照动态优先级加入
+//实时进程加入实时运行队列，公平调度时除空进程外均加入红黑树运行队列
 void add_sched(task_struct * task){
+    if(task->policy != SCHED_NORMAL){
+        rt_enqueue(task, 0);
+        return;
+    }
+#ifdef SCHED_FAIR
+    if(task->pid != IDLE_PID){
+        fair_place(task);
+        fair_enqueue(task);
+        return;
+    }
+#endif
     int index = task->dynamic_prority;
     if(index == -1){
         list_add_tail(&(task->sched), &sched[PRORITY_NUM]);
@@ -96,29 +151,46 @@ void init_pc(){
     //初始化优先级位图
     init_pro_map();
 
+#ifdef SCHED_FAIR
+    //初始化公平调度运行队列
+    init_fair_rq();
+#endif
+    //初始化实时运行队列
+    init_rt_rq();
+
+    //终结进程由系统工作队列回收
+    INIT_DELAYED_WORK(&reap_work, reap_terminal);
+
     //创建空进程
     //空进程的task_struct结构位于内核代码部分(0-16MB)的最后一页
-    idle = (task_struct * )(kernel_sp - KERNEL_STACK_SIZE);
+    idle = (task_struct * )(unsigned long)(kernel_sp - KERNEL_STACK_SIZE);
     
     //空进程结构初始化
     idle->pid = IDLE_PID;
-    idle->ASID = idle->pid;
     idle->state = TASK_UNINIT;
     idle->ppid = idle->pid;
     kernel_strcpy(idle->name, "idle");
     idle->static_prority = -1;
     idle->dynamic_prority = idle->static_prority;
     idle->counter = MAX_TIMESLICE;
-    kernel_strcpy(idle->start_time, "00:00:00");
+    idle->start_time = 0;
     idle->sleep_avg = 0;
     idle->is_changed = 0;
+    kernel_memset(&(idle->stat), 0, sizeof(struct sched_stat));
+    idle->stat.last_run = get_cycles();
+    fair_init_task(idle);
+    rt_init_task(idle, SCHED_NORMAL, 0);
+    pi_init_task(idle);
     
     //当前寄存器的内容即为空进程的寄存器内容无需赋值
+    idle->frame_saved = 0;
+    idle->preempt_saved = 0;
 
     INIT_LIST_HEAD(&(idle->sched));
     INIT_LIST_HEAD(&(idle->list));
     idle->mm = 0;
     idle->files = 0;
+    idle->stack_canary = STACK_CANARY;
     add_tasks(idle);
     add_sched(idle);
 
@@ -127,30 +199,96 @@ void init_pc(){
 
     //注册进程调度函数，时钟中断触发
     register_interrupt_handler(7, pc_schedule);
+    //进程上下文中请求调度的软件中断
+    register_interrupt_handler(0, pc_preempt_irq);
     //设置cp0中的compare和count寄存器
     //当compare == count时，产生时钟中断（7号）
-    asm volatile(
-        "li $v0, 10000000\n\t"
-        "mtc0 $v0, $11\n\t"
-        "mtc0 $zero, $9");
+    init_timer(TICK_CYCLES);
 
 }
 
-//创建新的进程
+//创建新的普通进程
 //task_name: 进程名
 //entry: 进程的入口函数
 //argv: 进程的参数信息
 //ret_pid：用于返回新创建进程的PID
+//is_user：新进程获得创建者地址空间的写时复制副本（fork），创建者没有时获得空的地址空间
 //创建成功返回0，否则返回1
 int task_create(char * task_name, long static_prority, void (*entry)(unsigned int argc, void * argv),
                 unsigned int argc, void * argv, pid_t * ret_pid, int is_user){
+    return task_create_policy(task_name, static_prority, SCHED_NORMAL, 0, entry, argc, argv, ret_pid, is_user);
+}
+
+//创建新的进程并指定调度策略
+//policy: SCHED_NORMAL/SCHED_FIFO/SCHED_RR，rt_priority: 实时优先级（0-31，31最高）
+//实时进程总是抢占普通进程，其余参数同task_create()
+//创建成功返回0，否则返回1
+int task_create_policy(char * task_name, long static_prority, int policy, int rt_priority,
+                       void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                       pid_t * ret_pid, int is_user){
     //检查静态优先级
     //print_proc();
     if(static_prority >= PRORITY_NUM || static_prority < 0){
         // kernel_printf("Task_create: static_prority out of range!\n");
         return 1;
     }
-    
+    //检查调度策略
+    if(policy != SCHED_NORMAL && policy != SCHED_FIFO && policy != SCHED_RR){
+        return 1;
+    }
+    if(rt_priority >= RT_PRIO_NUM || rt_priority < 0){
+        return 1;
+    }
+    return do_task_create(task_name, static_prority, policy, rt_priority, entry, argc, argv, ret_pid, is_user, 0);
+}
+
+//创建周期进程，按最早截止时间优先（EDF）调度
+//period: 周期，runtime: 每个周期的运行预算，deadline: 相对截止时间，为0时等于周期（单位均为CP0周期）
+//进程每完成一个周期的工作调用wait_next_period()，超出预算时被限流到下一周期
+//周期以时钟中断为粒度释放，因此不能小于TICK_CYCLES；总带宽超过DL_BW_MAX时拒绝创建
+//创建成功返回0，否则返回1
+int task_create_periodic(char * task_name, unsigned int period, unsigned int runtime, unsigned int deadline,
+                         void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                         pid_t * ret_pid){
+    unsigned int dl_attr[3];
+    int old_ie;
+
+    if(deadline == 0){
+        deadline = period;
+    }
+    if(period < TICK_CYCLES || period > 0x7fffffff || deadline > period || runtime == 0 || runtime > deadline){
+        return 1;
+    }
+    old_ie = disable_interrupts();
+    if(dl_admit(runtime, period)){
+        if(old_ie){
+            enable_interrupts();
+        }
+        kernel_printf("Task_create_periodic: bandwidth exceeded!\n");
+        return 1;
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+    dl_attr[0] = runtime;
+    dl_attr[1] = deadline;
+    dl_attr[2] = period;
+    if(do_task_create(task_name, 0, SCHED_DEADLINE, 0, entry, argc, argv, ret_pid, 0, dl_attr)){
+        old_ie = disable_interrupts();
+        dl_unadmit(runtime, period);
+        if(old_ie){
+            enable_interrupts();
+        }
+        return 1;
+    }
+    return 0;
+}
+
+//task_create_policy()和task_create_periodic()的公共部分
+//dl_attr为周期进程的运行预算、相对截止时间和周期，其他进程为0
+static int do_task_create(char * task_name, long static_prority, int policy, int rt_priority,
+                          void (*entry)(unsigned int argc, void * argv), unsigned int argc, void * argv,
+                          pid_t * ret_pid, int is_user, unsigned int * dl_attr){
     //分配PID
     pid_t new_pid;
     if(pid_alloc(&new_pid)){
@@ -171,7 +309,6 @@ int task_create(char * task_name, long static_prority, void (*entry)(unsigned in
 
     //初始化task_struct结构信息
     new_union->task.pid = new_pid;
-    new_union->task.ASID = new_union->task.pid;
     new_union->task.state = TASK_UNINIT;
     new_union->task.ppid = current_task->pid;
     kernel_strcpy(new_union->task.name, task_name);
@@ -195,36 +332,55 @@ int task_create(char * task_name, long static_prority, void (*entry)(unsigned in
         new_union->task.counter = sched_time[new_union->task.static_prority];
     }
     argsc++;
-    char temp_time[START_TIME_LEN];
-    get_time(temp_time, START_TIME_LEN);
-    kernel_strcpy(new_union->task.start_time, temp_time);
+    new_union->task.start_time = get_cycles64();
     new_union->task.sleep_avg = 0;
     new_union->task.is_changed = 0;
+    kernel_memset(&(new_union->task.stat), 0, sizeof(struct sched_stat));
+    fair_init_task(&(new_union->task));
+    rt_init_task(&(new_union->task), policy, rt_priority);
+    pi_init_task(&(new_union->task));
+    if(dl_attr != 0){
+        dl_start(&(new_union->task), dl_attr[0], dl_attr[1], dl_attr[2]);
+    }
 
     //寄存器初始化
     kernel_memset(&(new_union->task.context), 0, sizeof(context));
     //新进程入口地址
-    new_union->task.context.epc = (unsigned int)entry;
+    new_union->task.context.epc = (unsigned long)entry;
     //新进程内核栈指针
-    new_union->task.context.sp = (unsigned int)new_union + KERNEL_STACK_SIZE;
+    new_union->task.context.sp = (unsigned long)new_union + KERNEL_STACK_SIZE;
     //设置全局指针
-    unsigned int init_gp;
-    asm volatile("la %0, _gp\n\t" : "=r"(init_gp));
-    new_union->task.context.gp = init_gp;
+    new_union->task.context.gp = get_gp();
     //设置新进程参数
     new_union->task.context.a0 = argsc - 1;
-    new_union->task.context.a1 = (unsigned int)argv;
+    new_union->task.context.a1 = (unsigned long)argv;
+    //新进程第一次运行时由switch_ex或中断返回恢复完整上下文
+    new_union->task.frame_saved = 0;
+    new_union->task.preempt_saved = 0;
+    new_union->task.stack_canary = STACK_CANARY;
 
     INIT_LIST_HEAD(&(new_union->task.sched));
     INIT_LIST_HEAD(&(new_union->task.list));
 
-    //用户进程空间结构
-    //if(is_user){
-        //new_union->task.mm = mm_create();
-    //}
-    //else{
+    //用户进程空间结构：复制创建者的地址空间，双方共享的页在第一次写时才复制
+    //创建者没有用户地址空间时新建
+    if(is_user){
+        if(current_task->mm != 0){
+            new_union->task.mm = dup_mm(current_task->mm, 0);
+        }
+        else{
+            new_union->task.mm = mm_create();
+        }
+        if(new_union->task.mm == 0){
+            kernel_printf("Task_create: mm allocated failed\n");
+            kfree(new_union);
+            pid_free(new_pid);
+            return 1;
+        }
+    }
+    else{
         new_union->task.mm = 0;
-    //}
+    }
     //打开文件链表
     new_union->task.files = 0;
 
@@ -237,7 +393,11 @@ int task_create(char * task_name, long static_prority, void (*entry)(unsigned in
     add_tasks(&(new_union->task));
     add_sched(&(new_union->task));
     add_pro_map(&(new_union->task));
+    account_wakeup(&(new_union->task));
     new_union->task.state = TASK_READY;
+    if(rt_preempts(&(new_union->task), current_task)){
+        set_need_resched();
+    }
     return 0;
 }
 
@@ -249,20 +409,38 @@ void remove_terminal(task_struct * task){
 }
 
 //从所有进程链表中移除进程
-//在清理结束链表clear_terminal()中调用
+//在清理结束链表clear_terminal()中调用，进程结构在宽限期结束后才能释放
 void remove_tasks(task_struct * task){
-    list_del(&(task->list));
-    INIT_LIST_HEAD(&(task->list));
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    write_seqcount_begin(&tasks_seq);
+    list_del_rcu(&(task->list));
+    write_seqcount_end(&tasks_seq);
+    if(old_ie){
+        enable_interrupts();
+    }
 }
 
 //从优先级调度链表中移除进程
 void remove_sched(task_struct * task){
+    if(task->rt_on_rq){
+        rt_dequeue(task);
+        return;
+    }
+#ifdef SCHED_FAIR
+    if(task->on_rq){
+        fair_dequeue(task);
+        return;
+    }
+#endif
     list_del(&(task->sched));
     INIT_LIST_HEAD(&(task->sched));
 }
 
-//清理终结链表
-//在pc_schedule()中调用
+//清理终结链表，把进程从所有进程链表中移除并放入reap_pending
+//进程结构由reap_terminal()在宽限期结束后释放
+//在回收工作项reap_terminal()中调用，调用者需保证中断关闭
 void clear_terminal(){
     task_struct * task;
 
@@ -279,6 +457,7 @@ void clear_terminal(){
 
         remove_terminal(task);
         remove_tasks(task);
+        list_add_tail(&(task->sched), &reap_pending);
 
         #ifdef PC_DEBUG
             kernel_printf("Clear_terminal: task with pid = %d is cleared\n", temp_pid);
@@ -287,6 +466,54 @@ void clear_terminal(){
     return;
 }
 
+//回收终结进程，在工作线程中执行，不占用时钟中断的时间
+//进程结构在宽限期结束（移除前开始遍历的读者都已退出）后才释放，读者未退出时下一个时钟中断后重试
+static void reap_terminal(struct work_struct * work){
+    task_struct * task;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(reap_pending.next != &reap_pending){
+        if(!rcu_gp_done(reap_gp)){
+            schedule_delayed_work(&reap_work, 1);
+            if(old_ie){
+                enable_interrupts();
+            }
+            return;
+        }
+        while(reap_pending.next != &reap_pending){
+            task = container_of(reap_pending.next, task_struct, sched);
+            list_del(&(task->sched));
+            //释放用户地址空间的页较多，打开中断进行
+            if(task->mm != 0){
+                if(old_ie){
+                    enable_interrupts();
+                }
+                mm_delete(task->mm);
+                disable_interrupts();
+            }
+            //PID与进程结构同时释放，宽限期内的读者按PID查找到的仍是该进程
+            pid_free(task->pid);
+            kfree(task);
+        }
+    }
+
+    //为新终结的进程开始宽限期
+    clear_terminal();
+    if(reap_pending.next != &reap_pending){
+        reap_gp = rcu_gp_start();
+        if(rcu_gp_done(reap_gp)){
+            reap_terminal(work);
+        }
+        else{
+            schedule_delayed_work(&reap_work, 1);
+        }
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
 //更新平均睡眠时间
 //在updata_dynamic_prority()中调用
 void update_sleep_avg(){
@@ -352,8 +579,8 @@ void update_dynamic_prority(){
             //当前进程不变
             if(next != current_task){
                 remove_sched(next);
-                //已经过变化则不再变化
-                if(!next->is_changed){
+                //已经过变化或被优先级继承提升则不再变化
+                if(!next->is_changed && !next->pi_boosted){
                     // #ifdef PC_DEBUG
                     //     kernel_printf("Update_d_prority: pre_prority: %d with pid = %d\n", next->dynamic_prority, next->pid);
                     // #endif
@@ -435,8 +662,40 @@ task_struct * find_in_pro_map(){
 }
 
 //选取下一个要运行的进程，返回其task_struct结构
-//采用动态优先级调度算法，总是选取具有最高优先级的进程，同一优先级中选取链表中的第一个进程
+//有可运行的实时进程时选取实时优先级最高的进程，否则选取普通进程
 task_struct * find_next_task(){
+    //当前为实时进程，先放回实时运行队列
+    if(current_task->policy != SCHED_NORMAL){
+        rt_put_prev(current_task);
+        if(rt_runnable()){
+            return rt_pick_next();
+        }
+#ifdef SCHED_FAIR
+        return fair_pick_next(current_task);
+#else
+        return find_in_pro_map();
+#endif
+    }
+
+    //当前普通进程被实时进程抢占，放回普通调度队列
+    if(rt_runnable()){
+#ifdef SCHED_FAIR
+        fair_put_prev(current_task);
+#else
+        find_next_normal();
+#endif
+        return rt_pick_next();
+    }
+    return find_next_normal();
+}
+
+//选取下一个要运行的普通进程
+//采用动态优先级调度算法，总是选取具有最高优先级的进程，同一优先级中选取链表中的第一个进程
+static task_struct * find_next_normal(){
+#ifdef SCHED_FAIR
+    //公平调度：选取红黑树中虚拟运行时间最小的进程
+    return fair_pick_next(current_task);
+#endif
     task_struct * next;
     int is_back = 0;
 
@@ -451,8 +710,8 @@ task_struct * find_next_task(){
     //优先级进程
     else{
         remove_sched(current_task);
-        //已经过变化则不再变化
-        if(!current_task->is_changed){
+        //已经过变化或被优先级继承提升则不再变化
+        if(!current_task->is_changed && !current_task->pi_boosted){
             int temp = current_task->dynamic_prority;
             // #ifdef PC_DEBUG
             //     kernel_printf("Update_d_prority: pre_prority: %d with pid = %d\n", current_task->dynamic_prority, current_task->pid);
@@ -529,19 +788,138 @@ static void copy_context(context* src, context* dest) {
     dest->ra = src->ra;
 }
 
-//激活task所指的地址空间
-// void activate_mm(task_struct * task){
-//     set_tlb_asid(task->ASID);
-// }
+//由主动切换保存的寄存器构造中断返回时恢复的上下文
+//进程从switch_to()返回处继续执行，调用者保存的寄存器无需恢复
+static void frame_to_context(struct switch_frame * frame, context * dest){
+    dest->epc = frame->ra;
+    dest->s0 = frame->s0;
+    dest->s1 = frame->s1;
+    dest->s2 = frame->s2;
+    dest->s3 = frame->s3;
+    dest->s4 = frame->s4;
+    dest->s5 = frame->s5;
+    dest->s6 = frame->s6;
+    dest->s7 = frame->s7;
+    dest->gp = frame->gp;
+    dest->sp = frame->sp;
+    dest->fp = frame->fp;
+    dest->ra = frame->ra;
+}
 
-//进程调度函数，由时钟中断触发
-//参数pt_context指向当前进程的上下文信息
-void pc_schedule(unsigned int status, unsigned int cause, context * pt_context){
-    // #ifdef PC_DEBUG
-    //     kernel_printf("PC_schedule: current_pid = %d\n", current_task->pid);
-    // #endif
+//激活task所指的地址空间：TLB重填改为查找其页目录，并切换到其ASID
+//内核线程没有用户地址空间，使用swapper_pg_dir，不改变ASID
+void activate_mm(task_struct * task){
+    switch_mm(task->mm);
+}
+
+//检查被切换出去的进程的内核栈是否溢出到进程控制块
+//内核栈向下增长，最先被改写的是位于最低处的标记值
+static void check_stack(task_struct * task){
+    if(task->stack_canary != STACK_CANARY){
+        kernel_printf("Check_stack: kernel stack overflow! --%s\n", task->name);
+        while(1);
+    }
+}
+
+//在中断上下文中切换到next进程
+//pt_context指向中断保存的上下文，中断返回时恢复的即为next的上下文
+static void switch_irq(task_struct * next, context * pt_context){
+    check_stack(current_task);
+    activate_mm(next);
+
+    //保存当前进程上下文
+    copy_context(pt_context, &(current_task->context));
+    account_switch(current_task, next, 0);
+    current_task->state = TASK_READY;
+    current_task = next;
+    //加载下一进程上下文，主动让出CPU的进程只保存了被调用者保存的寄存器
+    //被切换出去的进程可以抢占，抢占计数中只有中断嵌套部分，加上next睡眠时保存的计数
+    if(current_task->frame_saved){
+        current_task->frame_saved = 0;
+        preempt_count += current_task->preempt_saved;
+        frame_to_context(&(current_task->frame), pt_context);
+    }
+    else{
+        copy_context(&(current_task->context), pt_context);
+    }
+    current_task->state = TASK_RUNNING;
+}
+
+//在进程上下文中主动切换到next进程，调用者需保证中断关闭，current_task已指向next
+//只保存prev的被调用者保存寄存器；next上次也是主动让出CPU时只恢复被调用者保存寄存器，
+//否则（新建或被中断抢占的进程）由switch_ex恢复完整上下文
+//抢占计数随进程保存：在不可抢占区中睡眠（如等待互斥锁）不影响其他进程被抢占
+//被中断切换出去的进程抢占计数必为0
+//prev再次被调度时从这里返回，中断打开
+static void switch_voluntary(task_struct * prev, task_struct * next){
+    check_stack(prev);
+    //切换后next在中断打开的状态下继续执行
+    irqsoff_end();
+    activate_mm(next);
+    prev->preempt_saved = preempt_count;
+    preempt_count = next->frame_saved ? next->preempt_saved : 0;
+    prev->frame_saved = 1;
+    if(next->frame_saved){
+        next->frame_saved = 0;
+        switch_to(&(prev->frame), &(next->frame));
+    }
+    else{
+        switch_to_ex(&(prev->frame), &(next->context));
+    }
+}
+
+//中断返回前可以抢占且need_resched置位时调用
+//补做被推迟的时钟中断调度，或使被唤醒的实时进程立即抢占当前进程，不必等到下一个时钟中断
+void pc_resched(context * pt_context){
+    task_struct * next;
+
+    if(tick_deferred){
+        tick_deferred = 0;
+        schedule_tick(pt_context);
+    }
+    else if(rt_need_preempt(current_task)){
+        next = find_next_task();
+        if(next != current_task){
+            switch_irq(next, pt_context);
+        }
+    }
+    //没有切换进程时也清除请求
+    need_resched = 0;
+}
+
+//软件中断0，由preempt_schedule()触发，调度在do_interrupts()返回前完成
+static void pc_preempt_irq(unsigned int status, unsigned int cause, context * pt_context){
+    clear_soft_irq();
+}
 
+//时钟中断中的调度决策：时间片用完或有应抢占的实时进程时切换进程
+//被中断的代码可以抢占时由pc_schedule()调用，否则推迟到pc_resched()
+static void schedule_tick(context * pt_context){
     task_struct * next;
+
+    //实时进程被限流、有更高优先级实时进程或时间片轮转时重新调度
+    //普通进程在有可运行的实时进程时立即被抢占
+    if(current_task->policy != SCHED_NORMAL || rt_runnable()){
+        if(current_task->policy != SCHED_NORMAL && !rt_tick(current_task)){
+            return;
+        }
+        next = find_next_task();
+        if(next == current_task){
+            return;
+        }
+        goto switch_task;
+    }
+
+#ifdef SCHED_FAIR
+    //公平调度：只对当前进程记账，其虚拟运行时间超过最左进程时才重新调度
+    if(!fair_tick(current_task)){
+        return;
+    }
+    next = find_next_task();
+    if(next == current_task){
+        return;
+    }
+#else
     //若非idle、init进程则更改时间片数量
     if(current_task->dynamic_prority != -1){
         current_task->counter--;
@@ -552,12 +930,9 @@ void pc_schedule(unsigned int status, unsigned int cause, context * pt_context){
 
         //判断当前进程时间片是否已用完,若没用完继续运行，若用完执行调度算法
         if(current_task->counter != 0){
-            goto end;
+            return;
         }
         else{
-            //清理终结链表
-            clear_terminal();
-
             //更新动态优先级
             update_dynamic_prority();
 
@@ -566,44 +941,55 @@ void pc_schedule(unsigned int status, unsigned int cause, context * pt_context){
         }
     }
     else{
-        //清理终结链表
-        clear_terminal();
         //调用调度算法，选取下一个要运行的进程
         next = find_next_task();
     }
+#endif
 
+switch_task:
     //如果选取的进程不是当前进程
+    //否则没有其他可运行的进程（如init进程为实时进程且正在睡眠时的idle进程），继续运行当前进程
     if(next != current_task){
-        // if(next->mm != 0){
-        //     activate_mm(next);
-        // }
-
-        //保存当前进程上下文
-        copy_context(pt_context, &(current_task->context));
-        current_task->state = TASK_READY;
-        current_task = next;
-        //加载下一进程上下文
-        copy_context(&(current_task->context), pt_context);
-        current_task->state = TASK_RUNNING;
-        goto end;
-    }    
+        switch_irq(next, pt_context);
+    }
+}
+
+//进程调度函数，由时钟中断触发
+//参数pt_context指向当前进程的上下文信息
+void pc_schedule(unsigned int status, unsigned int cause, context * pt_context){
+    // #ifdef PC_DEBUG
+    //     kernel_printf("PC_schedule: current_pid = %d\n", current_task->pid);
+    // #endif
+
+    //统计当前进程运行时间
+    account_run(current_task);
+    //将到期的延迟工作加入工作队列
+    workqueue_tick();
+    //实时进程限流周期
+    rt_period_tick();
+
+    //被中断的代码禁止了抢占（持有锁），本次调度推迟到preempt_enable()后的中断返回时
+    if(!preemptible()){
+        tick_deferred = 1;
+        set_need_resched();
+    }
     else{
-        kernel_printf("PC_schedule: next == current_task\n");
-        while(1);
-        goto end;
+        schedule_tick(pt_context);
     }
 
-end:
     // #ifdef PC_DEBUG
     //     kernel_printf("PC_shcedule: next_pid = %d\n", current_task->pid);
     // #endif
     //将cp0中到count寄存器复位为0，结束时钟中断
-    asm volatile("mtc0 $zero, $9\n\t");
+    reset_timer();
 }
 
 //打印进程结构信息
 void print_task_struct(task_struct * task){
-    kernel_printf("name: %s \t pid: %d \t ppid: %d \t ", task->name, task->pid, task->ppid);
+    char start_time[START_TIME_LEN];
+
+    format_time(task->start_time, start_time, START_TIME_LEN);
+    kernel_printf("name: %s \t pid: %d \t ppid: %d \t start: %s \t ", task->name, task->pid, task->ppid, start_time);
     kernel_printf("s_prority: %d \t d_prority: %d \t ", task->static_prority, task->dynamic_prority);
     switch(task->state){
         case 0: kernel_printf("state: UNINIT\n");break;
@@ -616,25 +1002,32 @@ void print_task_struct(task_struct * task){
 }
 
 //打印进程链表信息
+//在RCU读保护下遍历，打印期间不关中断，进程结构不会被释放
 int print_proc(){
     struct list_head * pos;
     task_struct * next;
+    int idx;
 
     kernel_printf("ps results:\n");
+    idx = rcu_read_lock();
     list_for_each(pos, &tasks){
         next = container_of(pos, task_struct, list);
         print_task_struct(next);
     }
+    rcu_read_unlock(idx);
     return 0;
 }
 
 //根据PID在所有进程链表中查找进程结构
+//返回的进程结构在调用者自己的RCU读保护或关中断期间有效
 task_struct * find_in_tasks(pid_t pid){
     struct list_head * pos;
     task_struct * next;
     task_struct * ret = 0;
+    int idx;
 
     //遍历所有进程链表
+    idx = rcu_read_lock();
     list_for_each(pos, &tasks){
         next = container_of(pos, task_struct, list);
         if(next->pid == pid){
@@ -642,9 +1035,106 @@ task_struct * find_in_tasks(pid_t pid){
             break;
         }
     }
+    rcu_read_unlock(idx);
     return ret;
 }
 
+//统计进程自上次统计以来的运行时间，并计入当前动态优先级
+//在时钟中断和进程切换时调用，调用者需保证中断关闭
+void account_run(task_struct * task){
+    unsigned int now = get_cycles();
+    unsigned int delta = now - task->stat.last_run;
+
+    task->stat.run_cycles += delta;
+#ifdef SCHED_PRIO_TIME
+    if(task->dynamic_prority >= 0 && task->dynamic_prority < PRORITY_NUM){
+        task->stat.prio_time[task->dynamic_prority] += delta >> 10;
+    }
+#endif
+    task->stat.last_run = now;
+}
+
+//记录进程被唤醒（进入就绪态）的时刻，用于统计唤醒到运行的延迟
+void account_wakeup(task_struct * task){
+    task->stat.wakeup_stamp = get_cycles();
+    task->stat.woken = 1;
+}
+
+//进程切换统计
+//prev: 被换出的进程，next: 被换入的进程，voluntary: prev是否主动让出CPU
+void account_switch(task_struct * prev, task_struct * next, int voluntary){
+    account_run(prev);
+    account_resched();
+    if(voluntary){
+        prev->stat.nvcsw++;
+    }
+    else{
+        prev->stat.nivcsw++;
+    }
+
+    next->stat.last_run = prev->stat.last_run;
+    //被唤醒后第一次运行，统计唤醒延迟
+    if(next->stat.woken){
+        unsigned int lat = next->stat.last_run - next->stat.wakeup_stamp;
+        next->stat.woken = 0;
+        next->stat.wakeup_lat_last = lat;
+        if(lat > next->stat.wakeup_lat_max){
+            next->stat.wakeup_lat_max = lat;
+        }
+        next->stat.wakeup_lat_avg = next->stat.wakeup_lat_avg - (next->stat.wakeup_lat_avg >> 3) + (lat >> 3);
+    }
+}
+
+//复制进程统计信息快照
+//只在关中断期间复制数据，显示由调用者在开中断后完成
+//buf: 快照缓冲区，max: 缓冲区可容纳的进程数，total: 返回进程总数
+//返回复制的进程数
+int snapshot_proc(struct task_snapshot * buf, int max, int * total){
+    struct list_head * pos;
+    task_struct * next;
+    int count;
+    int all;
+    int old_ie;
+    int idx;
+    unsigned int seq;
+
+    old_ie = disable_interrupts();
+    //当前进程的运行时间统计到此刻
+    account_run(current_task);
+    if(old_ie){
+        enable_interrupts();
+    }
+
+    //不关中断遍历，期间有进程加入或移除时重新读取，得到同一时刻的进程列表
+    idx = rcu_read_lock();
+retry:
+    count = 0;
+    all = 0;
+    seq = read_seqcount_begin(&tasks_seq);
+    list_for_each(pos, &tasks){
+        next = container_of(pos, task_struct, list);
+        if(count < max){
+            buf[count].pid = next->pid;
+            buf[count].state = next->state;
+            buf[count].static_prority = next->static_prority;
+            buf[count].dynamic_prority = next->dynamic_prority;
+            kernel_memcpy(buf[count].name, next->name, TASK_NAME_LEN);
+            kernel_memcpy(&(buf[count].stat), &(next->stat), sizeof(struct sched_stat));
+            count++;
+        }
+        all++;
+    }
+    if(read_seqcount_retry(&tasks_seq, seq)){
+        goto retry;
+    }
+    rcu_read_unlock(idx);
+
+    if(total != 0){
+        *total = all;
+    }
+    return count;
+}
+
 //根据PPID在等待队列中查找进程结构
 task_struct * find_in_wait(pid_t ppid){
     struct list_head * pos;
@@ -675,6 +1165,7 @@ void add_terminal(task_struct * task){
 
 //根据输入进程号杀死进程
 //将杀死的进程从优先级链表/等待链表中移除并加入终结链表
+//持有互斥锁的进程不能被杀死：锁无法再被释放，等待者将永远睡眠
 //返回0表示执行成功，否则执行失败
 int pc_kill(pid_t pid){
     //idle进程不能被杀死
@@ -708,29 +1199,47 @@ int pc_kill(pid_t pid){
     //在所有进程链表中找到进程结构
     task = find_in_tasks(pid);
     
-    //存在bug
-    if(task == 0){
-        kernel_printf("PC_kill: pid found but task_struct not found!\n");
+    //已终结的进程在回收前仍占用PID，可能已从所有进程链表中移除
+    if(task == 0 || task->state == TASK_TERMINAL){
+        kernel_printf("PC_kill: task is already terminated!\n");
+        enable_interrupts();
+        return 1;
+    }
+
+    if(!list_empty(&(task->pi_held))){
+        kernel_printf("PC_kill: task holding a mutex can not be killed!\n");
         enable_interrupts();
         return 1;
     }
 
     //改变进程信息
     task->state = TASK_TERMINAL;
-    remove_sched(task);
+    if(task->pi_blocked_on != 0){
+        //从互斥锁等待链表中移除，撤销其对持有者的优先级提升
+        mutex_cancel_wait(task);
+    }
+    else{
+        remove_sched(task);
+    }
+    rt_exit_task(task);
+    update_pro_map();
+    enable_interrupts();
+
+    //共享文件映射的写入写回文件，写回可能睡眠，在调用者的上下文中打开中断进行
+    //进程已不在任何调度或等待链表中，不会再运行；加入终结链表前也不会被回收
+    if(task->mm != 0){
+        filemap_sync_mm(task->mm);
+    }
+
+    disable_interrupts();
     add_terminal(task);
+    schedule_work(&reap_work.work);
     
     // if(task->files != 0){
     //     task_files_delete(task);
     // }
 
-    // if(task->mm != 0){
-    //     mm_delete(task->mm);
-    // }
-
-    //释放pid
-    pid_free(pid);
-    update_pro_map();
+    //用户地址空间和pid由reap_terminal()释放
     enable_interrupts();
     return 0;
 }
@@ -770,21 +1279,11 @@ int char_to_int(char * str){
     return sum;
 }
 
-//内核线程统一入口
-int kernel_proc(unsigned int argc, void * argv){
-
-    kernel_printf("\n<<<<<<<<<<<<<<<kernel_proc>>>>>>>>>>>>>>>\n");
-    kernel_printf("current_task: %d\n", current_task->pid);
-
-    // #ifdef PC_DEBUG
-    //     kernel_printf("argv = %s\n", argv);
-    // #endif
-
-    #ifdef PC_DEBUG
-        kernel_printf("kernel_proc: task_name = %s\n", current_task->name);
-    #endif
+//内核任务主体，在kernel_proc()进程或线程池的工作线程中执行
+//loop不为0时为loop进程，用于测试进程优先级变化
+static void kernel_job(void * loop){
     //loop进程，用于测试进程优先级变化
-    if(kernel_strcmp(current_task->name, "loop") == 0){
+    if(loop){
         while(1);
     }
 
@@ -804,6 +1303,22 @@ int kernel_proc(unsigned int argc, void * argv){
     }
     //进程结束
     kernel_printf("\ncurrent_task: %d with d_prority: %d ending......\n", current_task->pid, current_task->dynamic_prority);
+}
+
+//内核线程统一入口
+int kernel_proc(unsigned int argc, void * argv){
+
+    kernel_printf("\n<<<<<<<<<<<<<<<kernel_proc>>>>>>>>>>>>>>>\n");
+    kernel_printf("current_task: %d\n", current_task->pid);
+
+    // #ifdef PC_DEBUG
+    //     kernel_printf("argv = %s\n", argv);
+    // #endif
+
+    #ifdef PC_DEBUG
+        kernel_printf("kernel_proc: task_name = %s\n", current_task->name);
+    #endif
+    kernel_job((void *)(unsigned long)(kernel_strcmp(current_task->name, "loop") == 0));
 
     //进程退出
     task_exit();
@@ -814,8 +1329,43 @@ int kernel_proc(unsigned int argc, void * argv){
     return 0;
 }
 
+//内核线程参数，由kthread_entry()读取后释放
+struct kthread_info{
+    void (*fn)(void * arg);
+    void * arg;
+};
+
+//内核线程统一入口，执行fn(arg)，返回后退出
+static void kthread_entry(unsigned int argc, void * argv){
+    struct kthread_info info = *(struct kthread_info *)argv;
+
+    kfree(argv);
+    info.fn(info.arg);
+    task_exit();
+}
+
+//通过task_create()创建内核线程
+//fn: 线程函数，arg: 传给线程函数的参数，ret_pid: 用于返回线程的PID
+//创建成功返回0，否则返回1
+int kthread_create(char * name, long static_prority, void (*fn)(void * arg), void * arg, pid_t * ret_pid){
+    struct kthread_info * info;
+
+    info = (struct kthread_info *)kmalloc(sizeof(struct kthread_info));
+    if(info == 0){
+        return 1;
+    }
+    info->fn = fn;
+    info->arg = arg;
+    if(task_create(name, static_prority, kthread_entry, 0, info, ret_pid, 0)){
+        kfree(info);
+        return 1;
+    }
+    return 0;
+}
+
 //kernel创建进程
 //新进程的入口函数相同
+//不等待的任务在优先级与工作线程相同时交给线程池执行，线程池已满时才创建新进程
 //成功返回0，否则返回1
 int exec_kernel(int argc, void * argv, int is_wait, int is_user){
     //获得进程名
@@ -832,12 +1382,19 @@ int exec_kernel(int argc, void * argv, int is_wait, int is_user){
     next = get_each_argv(ptr, pro, ' ');
     int s_prority = char_to_int(pro);
 
-    //创建进程
-    int res;
+    //创建进程，用户进程尚不能由此创建
+    int res = 1;
     pid_t new_pid;
 
     kernel_printf("s_prority = %d\n", s_prority);
 
+    //不需要等待子进程，无需新进程
+    //其他优先级的任务和不会结束的loop进程创建新进程，保证按指定优先级调度且不占用工作线程
+    if(!is_user && !is_wait && s_prority == WORKER_POOL_PRORITY && kernel_strcmp(name, "loop") != 0){
+        if(run_on_worker(kernel_job, 0) == 0){
+            return 0;
+        }
+    }
     if(!is_user){
         //内核线程，新进程入口为kernel_proc函数
         res = task_create(name, s_prority, (void *)kernel_proc, argc, name, &new_pid, 0);
@@ -871,24 +1428,22 @@ void task_exit(){
     // if(current_task->files != 0){
     //     task_files_delete(current_task);
     // }
-    // if(current_task->mm != 0){
-    //     mm_delete(current_task->mm);
-    // }
+    //共享文件映射的写入写回文件，写回可能睡眠，需在进程终结前进行
+    if(current_task->mm != 0){
+        filemap_sync_mm(current_task->mm);
+    }
+    //用户地址空间仍在使用，与pid一起由reap_terminal()释放
 
     //中断关闭
-    asm volatile (      
-        "mfc0  $t0, $12\n\t"
-        "ori   $t0, $t0, 0x02\n\t"
-        "mtc0  $t0, $12\n\t"
-        "nop\n\t"
-        "nop\n\t"
-    );
+    set_exl();
 
     current_task->state = TASK_TERMINAL;
+    rt_exit_task(current_task);
 
     //唤醒父进程函数
     wakeup_parent();
     
+#ifndef SCHED_FAIR
     //更新动态优先级
     update_dynamic_prority();
 
@@ -896,12 +1451,14 @@ void task_exit(){
     update_pro_map();
     //更新是否改变优先级
     update_is_changed();
+#endif
 
     #ifdef PC_DEBUG
         kernel_printf("PC_exit: prepare to find next task\n");
     #endif
 
     //调用调度算法，选取下一个要运行的进程
+    task_struct * prev;
     task_struct * next;
     next = find_next_task();
     
@@ -909,19 +1466,17 @@ void task_exit(){
         kernel_printf("PC_exit: next task pid = %d\n", next->pid);
     #endif
 
-    // if(next->mm != 0){
-    //     activate_mm(next);
-    // }
-
     remove_sched(current_task);
     add_terminal(current_task);
-    pid_free(current_task->pid);
+    schedule_work(&reap_work.work);
     //更新优先级位图
     update_pro_map();
+    prev = current_task;
+    account_switch(prev, next, 1);
     current_task = next;
 
-    //调用汇编代码，加载新的进程上下文信息
-    switch_ex(&(current_task->context));
+    //加载新的进程上下文信息，退出进程的寄存器保存后不再使用
+    switch_voluntary(prev, next);
 
     //进程退出完成，将不会进行到这里
     kernel_printf("Task_exit: error!");
@@ -942,45 +1497,53 @@ void wakeup_parent(){
     
     //父进程在等待
     if(parent != 0){
-        remove_sched(parent);
-        add_sched(parent);
-        add_pro_map(parent);
-        parent->state = TASK_READY;
+        wakeup_task(parent);
     }
 }
 
 //等待子进程
 //停止当前进程并放入等待队列，通过调度算法选取下一进程
 void wait_pid(pid_t pid){
-    disable_interrupts();
-
-    //检查等待进程是否退出
     task_struct * next;
+    int idx;
+
+    //检查等待进程是否退出，在RCU读保护下查找，进程结构不会被释放
+    idx = rcu_read_lock();
     next = wait_check(pid);
-    if(next == 0){
-        enable_interrupts();
+    if(next == 0 || next->ppid != current_task->pid){
+        rcu_read_unlock(idx);
         return;
     }
 
-    if(next->ppid != current_task->pid){
+    //关中断后再次确认，检查之后才退出的子进程不会错过唤醒
+    disable_interrupts();
+    if(next->state == TASK_TERMINAL){
         enable_interrupts();
+        rcu_read_unlock(idx);
         return;
     }
-    enable_interrupts();
+    rcu_read_unlock(idx);
 
-    //中断关闭
-    asm volatile (     
-        "mfc0  $t0, $12\n\t"
-        "ori   $t0, $t0, 0x02\n\t"
-        "mtc0  $t0, $12\n\t"
-        "nop\n\t"
-        "nop\n\t"
-    );
-
-    current_task->state = -(int)pid;
     #ifdef PC_DEBUG
         kernel_printf("Wait_pid: current_pid = %d wait_pid = %d\n", current_task->pid, pid);
     #endif
+    sleep_on(&wait);
+
+    //被唤醒从这里执行
+    kernel_printf("Wait_pid: task wake with pid = %d\n", current_task->pid);
+}
+
+//当前进程主动睡眠
+//停止当前进程并放入等待链表queue，通过调度算法选取下一进程
+//由wakeup_task()将其放回调度链表
+void sleep_on(struct list_head * queue){
+    //中断关闭
+    //EXL置位后即可恢复IE，调用者可在关中断状态下检查睡眠条件后调用，不会丢失唤醒
+    set_exl();
+    enable_interrupts();
+
+    current_task->state = TASK_WAITING;
+#ifndef SCHED_FAIR
     //更新动态优先级
     update_dynamic_prority();
 
@@ -988,43 +1551,120 @@ void wait_pid(pid_t pid){
     update_pro_map();
     //更新是否改变优先级
     update_is_changed();
+#endif
 
-    #ifdef PC_DEBUG
-        kernel_printf("Wait_pid: prepare to find next task\n");
-    #endif
     //调用调度算法，选取下一个要运行的进程
     task_struct * next_sched;
     next_sched = find_next_task();
-    
-    //激活地址空间
-    // if(next_sched->mm != 0){
-    //     activate_mm(next);
-    // }
-    #ifdef PC_DEBUG
-        kernel_printf("Wait_pid: next task pid = %d\n", next->pid);
-    #endif
+
     //将当前进程从调度链表中移除，放入等待链表
     remove_sched(current_task);
     //更新优先级位图
     update_pro_map();
-    add_wait(current_task);
+    list_add_tail(&(current_task->sched), queue);
 
     //加载新进程的上下文信息
     task_struct * curr_sched;
     curr_sched = current_task;
+    account_switch(curr_sched, next_sched, 1);
     current_task = next_sched;
-    switch_wa(&(next_sched->context), &(curr_sched->context));
+    switch_voluntary(curr_sched, next_sched);
+}
 
-    //被唤醒从这里执行
-    kernel_printf("Wait_pid: task wake with pid = %d\n", current_task->pid);
+//当前进程主动让出CPU，放到同优先级就绪进程之后
+//没有其他可运行的进程时直接返回；切换时只保存被调用者保存的寄存器，返回时中断打开
+void sched_yield(){
+    task_struct * prev;
+    task_struct * next;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    prev = current_task;
+    if(prev->policy != SCHED_NORMAL){
+        //按时间片用完处理，由rt_put_prev()放到链表尾
+        prev->rt_time_slice = 0;
+        next = find_next_task();
+    }
+    else if(rt_runnable()){
+        next = find_next_task();
+    }
+    else{
+#ifdef SCHED_FAIR
+        fair_yield(prev);
+        next = find_next_task();
+#else
+        //idle、init进程之间轮转，其他进程放到所在优先级链表尾
+        if(prev->dynamic_prority == -1){
+            next = find_next_task();
+        }
+        else{
+            remove_sched(prev);
+            add_sched(prev);
+            update_pro_map();
+            next = find_in_pro_map();
+        }
+#endif
+    }
+
+    if(next == prev){
+        if(old_ie){
+            enable_interrupts();
+        }
+        return;
+    }
+    account_switch(prev, next, 1);
+    prev->state = TASK_READY;
+    current_task = next;
+    next->state = TASK_RUNNING;
+    switch_voluntary(prev, next);
+}
+
+//周期进程完成本周期的工作，睡眠到下一周期释放
+//非周期进程调用时直接返回
+void wait_next_period(){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(current_task->policy != SCHED_DEADLINE){
+        if(old_ie){
+            enable_interrupts();
+        }
+        return;
+    }
+    dl_next_period(current_task);
+    sleep_on(&period_wait);
+}
+
+//唤醒睡眠的进程
+//将其从等待链表中删除并加入调度链表，调用者需保证中断关闭
+//被唤醒的实时进程可抢占当前进程时，在中断返回前重新调度
+void wakeup_task(task_struct * task){
+    remove_sched(task);
+    add_sched(task);
+    add_pro_map(task);
+    account_wakeup(task);
+    task->state = TASK_READY;
+    if(rt_preempts(task, current_task)){
+        set_need_resched();
+    }
+}
+
+//唤醒在queue上睡眠的所有进程，调用者需保证中断关闭
+void wakeup_queue(struct list_head * queue){
+    while(queue->next != queue){
+        wakeup_task(container_of(queue->next, task_struct, sched));
+    }
 }
 
+//查找未终结的进程，返回值的有效期同find_in_tasks()
 task_struct * wait_check(pid_t pid){
     struct list_head * pos;
     task_struct * next;
     task_struct * ret = 0;
+    int idx;
 
     //遍历所有进程链表
+    idx = rcu_read_lock();
     list_for_each(pos, &tasks){
         next = container_of(pos, task_struct, list);
         if(next->pid == pid && next->state != TASK_TERMINAL){
@@ -1032,5 +1672,6 @@ task_struct * wait_check(pid_t pid){
             break;
         }
     }
+    rcu_read_unlock(idx);
     return ret;
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <zjunix/pi.h>
+#include <zjunix/fair.h>
+#include <zjunix/preempt.h>
+#include <zjunix/time.h>
+
+//初始化进程的优先级继承信息，在rt_init_task()之后调用
+void pi_init_task(task_struct * task){
+    INIT_LIST_HEAD(&(task->pi_held));
+    task->pi_blocked_on = 0;
+    task->pi_boosted = 0;
+    task->pi_policy = task->policy;
+    task->pi_rt_priority = task->rt_priority;
+    task->pi_dynamic_prority = task->dynamic_prority;
+}
+
+//调度参数对应的有效优先级
+static int prio_of(int policy, int rt_priority, long dynamic_prority){
+    if(policy == SCHED_DEADLINE){
+        return PI_PRIO_DL;
+    }
+    if(policy != SCHED_NORMAL){
+        return PRORITY_NUM + rt_priority;
+    }
+    return dynamic_prority;
+}
+
+//进程当前（可能被提升后）的有效优先级
+int pi_prio(task_struct * task){
+    return prio_of(task->policy, task->rt_priority, task->dynamic_prority);
+}
+
+//进程未被提升时的有效优先级
+int pi_base_prio(task_struct * task){
+    if(task->pi_boosted){
+        return prio_of(task->pi_policy, task->pi_rt_priority, task->pi_dynamic_prority);
+    }
+    return pi_prio(task);
+}
+
+//修改调度参数前把进程从运行队列中取出
+//优先级数组调度的当前进程位于调度链表中；实时、公平调度的当前进程不在队列中，只需完成记账
+static void pi_dequeue(task_struct * task){
+    if(task == current_task){
+        if(task->policy != SCHED_NORMAL){
+            rt_update_curr(task);
+            return;
+        }
+#ifdef SCHED_FAIR
+        if(task->pid != IDLE_PID){
+            fair_update_curr(task);
+        }
+#else
+        remove_sched(task);
+#endif
+        return;
+    }
+    //等待中的进程不在运行队列中，被唤醒时按新的参数加入
+    if(task->state == TASK_READY || task->state == TASK_RUNNING){
+        remove_sched(task);
+    }
+}
+
+//修改调度参数后把进程放回运行队列
+//被提升的就绪进程可以抢占当前进程时在中断返回前重新调度
+static void pi_enqueue(task_struct * task){
+    if(task == current_task){
+        task->exec_start = get_cycles();
+#ifdef SCHED_FAIR
+        if(task->policy == SCHED_NORMAL && task->pid != IDLE_PID){
+            fair_place(task);
+        }
+#else
+        if(task->policy == SCHED_NORMAL){
+            add_sched(task);
+            update_pro_map();
+        }
+#endif
+        return;
+    }
+    if(task->state == TASK_READY || task->state == TASK_RUNNING){
+        add_sched(task);
+        update_pro_map();
+        if(rt_preempts(task, current_task)){
+            set_need_resched();
+        }
+    }
+}
+
+//把进程的有效优先级提升到prio，prio不高于其原有优先级时恢复原有的调度参数
+//普通进程被提升到实时优先级时临时成为SCHED_FIFO进程，周期进程不会被提升
+//返回1表示有效优先级发生了变化，调用者需保证中断关闭
+int pi_setprio(task_struct * task, int prio){
+    if(prio <= pi_base_prio(task)){
+        if(!task->pi_boosted){
+            return 0;
+        }
+        pi_dequeue(task);
+        task->policy = task->pi_policy;
+        task->rt_priority = task->pi_rt_priority;
+        task->dynamic_prority = task->pi_dynamic_prority;
+        task->rt_time_slice = RT_RR_TIMESLICE;
+        task->pi_boosted = 0;
+        pi_enqueue(task);
+        return 1;
+    }
+    if(prio == pi_prio(task)){
+        return 0;
+    }
+
+    pi_dequeue(task);
+    if(!task->pi_boosted){
+        task->pi_policy = task->policy;
+        task->pi_rt_priority = task->rt_priority;
+        task->pi_dynamic_prority = task->dynamic_prority;
+        task->pi_boosted = 1;
+    }
+    if(prio >= PRORITY_NUM){
+        //周期进程等待时提升到最高实时优先级
+        if(prio - PRORITY_NUM >= RT_PRIO_NUM){
+            prio = PRORITY_NUM + RT_PRIO_NUM - 1;
+        }
+        if(task->pi_policy == SCHED_NORMAL){
+            task->policy = SCHED_FIFO;
+        }
+        task->rt_priority = prio - PRORITY_NUM;
+        task->dynamic_prority = task->pi_dynamic_prority;
+    }
+    else{
+        task->policy = SCHED_NORMAL;
+        task->dynamic_prority = prio;
+    }
+    pi_enqueue(task);
+    return 1;
+}
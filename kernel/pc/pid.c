@@ -1,11 +1,104 @@
 #include <zjunix/pid.h>
+#include <zjunix/bitops.h>
+#include <zjunix/atomic.h>
+
+//PID位图，置位表示已分配
+//字内最高位对应最小的PID，clz即可找到字内最小的空闲PID
+//各级位图都用ll/sc原子操作修改，分配和释放不需要关中断
+static volatile unsigned int pid_map[PID_WORDS];
+//摘要位图，置位表示对应的PID位图字中有空闲PID
+static volatile unsigned int pid_summary[PID_SUMMARY_WORDS];
+//顶层位图，置位表示对应的摘要字不为0
+static volatile unsigned int pid_top;
+//下一个可分配PID，循环分配以推迟PID的重用，只作为查找起点
+static pid_t next_pid;
+
+#define PID_BIT(n) (0x80000000u >> ((n) & 31))
+
+//摘要字s发生变化后更新顶层位图
+//清除后再复查：并发的置位者先修改下一级再置位上一级，复查能看到其修改，不会丢失空闲PID
+//反过来上一级可能多出置位，查找时遇到再修正
+static void pid_update_top(int s){
+    if(pid_summary[s] != 0){
+        atomic_fetch_or(&pid_top, PID_BIT(s));
+        return;
+    }
+    atomic_fetch_and(&pid_top, ~PID_BIT(s));
+    if(pid_summary[s] != 0){
+        atomic_fetch_or(&pid_top, PID_BIT(s));
+    }
+}
+
+//PID位图字index发生变化后更新上两级位图
+static void pid_update_summary(int index){
+    int s = index >> 5;
+
+    if(pid_map[index] != 0xffffffff){
+        atomic_fetch_or(&pid_summary[s], PID_BIT(index));
+    }
+    else{
+        atomic_fetch_and(&pid_summary[s], ~PID_BIT(index));
+        if(pid_map[index] != 0xffffffff){
+            atomic_fetch_or(&pid_summary[s], PID_BIT(index));
+        }
+    }
+    pid_update_top(s);
+}
+
+//从start开始（含）查找最小的空闲PID，每级位图最多查看一次
+//上级位图的置位已过时（并发的分配刚用完该字）时修正后重新查找
+//找到返回PID，否则返回-1；返回的PID仍需原子地占用
+static int pid_find_free(pid_t start){
+    int index, s;
+    unsigned int bits;
+
+    while(1){
+        index = start >> 5;
+        s = index >> 5;
+
+        //同一个PID位图字内
+        bits = ~pid_map[index] & (0xffffffff >> (start & 31));
+        if(bits != 0){
+            return (index << 5) + clz(bits);
+        }
+
+        //同一个摘要字内，之后的PID位图字
+        bits = (index & 31) == 31 ? 0 : pid_summary[s] & (0xffffffff >> ((index & 31) + 1));
+        if(bits == 0){
+            //之后的摘要字
+            bits = s == 31 ? 0 : pid_top & (0xffffffff >> (s + 1));
+            if(bits == 0){
+                return -1;
+            }
+            s = clz(bits);
+            bits = pid_summary[s];
+            if(bits == 0){
+                pid_update_top(s);
+                continue;
+            }
+        }
+        index = (s << 5) + clz(bits);
+        bits = ~pid_map[index];
+        if(bits != 0){
+            return (index << 5) + clz(bits);
+        }
+        pid_update_summary(index);
+    }
+}
 
 //初始化PID位图
 void init_pid(){
-    for(int i = 0; i < PID_BYTES; i++){
+    int i;
+
+    for(i = 0; i < PID_WORDS; i++){
         pid_map[i] = 0;
     }
-    pid_map[0] = 0x01;      //空进程pid
+    pid_top = 0;
+    for(i = 0; i < PID_SUMMARY_WORDS; i++){
+        pid_summary[i] = 0xffffffff;
+        pid_top |= PID_BIT(i);
+    }
+    pid_map[0] = PID_BIT(IDLE_PID);     //空进程pid
     next_pid = 1;
 }
 
@@ -17,9 +110,7 @@ int pid_check(pid_t pid){
         return 0;
     }
     //查看位图中的该PID
-    int map_index = pid >> 3;
-    int byte_index = pid & 7;
-    if(pid_map[map_index] & (1 << byte_index)){
+    if(pid_map[pid >> 5] & PID_BIT(pid)){
         return 1;
     }
     else{
@@ -28,38 +119,34 @@ int pid_check(pid_t pid){
 }
 
 //分配PID，ret_pid中存放分配的PID
+//从next_pid开始查找，到达末尾后从头查找，O(1)
 //成功分配返回0，否则返回1
 int pid_alloc(pid_t *ret_pid){
-    int i;
-    pid_t temp = next_pid;
-    for(i = 0; i < PID_NUM; i++){
-        if(pid_check(temp)){
-            temp = (temp + 1) % PID_NUM;
+    int pid;
+
+    do{
+        pid = pid_find_free(next_pid);
+        if(pid < 0){
+            pid = pid_find_free(0);
         }
-        else{
-            break;
+        if(pid < 0){
+            return 1;
         }
-    }
-    if(i == PID_NUM){
-        return 1;
-    }
-    int map_index = temp >>3;
-    int byte_index = temp & 7;
-    pid_map[map_index] |= (1 << byte_index);
-    *ret_pid = temp;
-    next_pid = (temp + 1) % PID_NUM;
+        //查找之后PID可能已被其他执行流占用，占用失败时重新查找
+    }while(atomic_fetch_or(&pid_map[pid >> 5], PID_BIT(pid)) & PID_BIT(pid));
+    pid_update_summary(pid >> 5);
+    *ret_pid = pid;
+    next_pid = (pid + 1) % PID_NUM;
     return 0;
 }
 
 //释放PID，成功返回0，否则返回1
 int pid_free(pid_t pid){
-    if(pid_check(pid)){
-        int map_index = pid >> 3;
-        int byte_index = pid & 7;
-        pid_map[map_index] ^= (1 << byte_index);
+    if(pid < PID_NUM && (atomic_fetch_and(&pid_map[pid >> 5], ~PID_BIT(pid)) & PID_BIT(pid))){
+        pid_update_summary(pid >> 5);
         return 0;
     }
     else{
         return 1;
     }
-}
\ No newline at end of file
+}
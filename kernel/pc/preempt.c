@@ -0,0 +1,58 @@
+#include <zjunix/preempt.h>
+#include <zjunix/pc.h>
+#include <zjunix/time.h>
+#include <intr.h>
+
+//抢占计数
+volatile unsigned int preempt_count = 0;
+//need_resched置位时的周期计数
+static unsigned int resched_stamp;
+//需要调度到实际切换的最大延迟
+unsigned int resched_lat_max = 0;
+
+//请求在下一个抢占点重新调度，记录请求时刻用于统计调度延迟
+//调用者需保证中断关闭
+void set_need_resched(){
+    if(!need_resched){
+        need_resched = 1;
+        resched_stamp = get_cycles();
+    }
+}
+
+//进程切换时调用，统计从请求调度到切换的延迟并清除请求
+//调用者需保证中断关闭
+void account_resched(){
+    unsigned int lat;
+
+    if(!need_resched){
+        return;
+    }
+    need_resched = 0;
+    lat = get_cycles() - resched_stamp;
+    if(lat > resched_lat_max){
+        resched_lat_max = lat;
+    }
+}
+
+//在进程上下文中请求重新调度
+//置位软件中断0，开中断时立即进入do_interrupts()，由其在中断返回前完成切换
+void preempt_schedule(){
+    raise_soft_irq();
+}
+
+//结束不可抢占区，计数回到0且有被推迟的调度时立即调度
+void preempt_enable(){
+    asm volatile("" : : : "memory");
+    preempt_count--;
+    if(preempt_count == 0 && need_resched){
+        preempt_schedule();
+    }
+}
+
+//长循环中的调度点，需要调度且可以抢占时让出CPU
+//在不持有锁时调用，持有锁时什么也不做
+void cond_resched(){
+    if(need_resched && preempt_count == 0){
+        preempt_schedule();
+    }
+}
@@ -0,0 +1,314 @@
+#include <zjunix/rt.h>
+#include <zjunix/bitops.h>
+
+//实时调度运行队列
+struct rt_rq rt_rq;
+
+//初始化实时运行队列
+//在init_pc()中调用
+void init_rt_rq(){
+    for(int i = 0; i < RT_PRIO_NUM; i++){
+        INIT_LIST_HEAD(&(rt_rq.queue[i]));
+    }
+    INIT_LIST_HEAD(&(rt_rq.dl_queue));
+    INIT_LIST_HEAD(&(rt_rq.dl_timers));
+    rt_rq.dl_bw = 0;
+    rt_rq.bitmap = 0;
+    rt_rq.nr_running = 0;
+    rt_rq.rt_time = 0;
+    rt_rq.period_start = get_cycles();
+    rt_rq.throttled = 0;
+}
+
+//初始化进程的调度策略
+//policy为SCHED_NORMAL时rt_priority无效
+void rt_init_task(task_struct * task, int policy, int rt_priority){
+    task->policy = policy;
+    task->rt_priority = rt_priority;
+    task->rt_time_slice = RT_RR_TIMESLICE;
+    task->rt_on_rq = 0;
+    INIT_LIST_HEAD(&(task->rt_list));
+    task->dl_runtime = 0;
+    task->dl_deadline = 0;
+    task->dl_period = 0;
+    task->dl_release = 0;
+    task->dl_abs_deadline = 0;
+    task->dl_used = 0;
+    task->dl_throttled = 0;
+    task->dl_misses = 0;
+    INIT_LIST_HEAD(&(task->dl_timer));
+}
+
+//a的截止时间是否早于b
+static int dl_before(task_struct * a, task_struct * b){
+    return (int)(a->dl_abs_deadline - b->dl_abs_deadline) < 0;
+}
+
+//周期进程按绝对截止时间插入就绪链表，相同截止时间先到先服务
+static void dl_enqueue(task_struct * task){
+    struct list_head * pos;
+
+    list_for_each(pos, &(rt_rq.dl_queue)){
+        if(dl_before(task, container_of(pos, task_struct, rt_list))){
+            break;
+        }
+    }
+    list_add_tail(&(task->rt_list), pos);
+}
+
+//截止时间最早的就绪周期进程，没有则返回0
+static task_struct * dl_first(){
+    if(rt_rq.dl_queue.next == &(rt_rq.dl_queue)){
+        return 0;
+    }
+    return container_of(rt_rq.dl_queue.next, task_struct, rt_list);
+}
+
+//按释放时刻插入定时链表
+static void dl_timer_add(task_struct * task){
+    struct list_head * pos;
+    task_struct * next;
+
+    list_for_each(pos, &(rt_rq.dl_timers)){
+        next = container_of(pos, task_struct, dl_timer);
+        if((int)(task->dl_release - next->dl_release) < 0){
+            break;
+        }
+    }
+    list_add_tail(&(task->dl_timer), pos);
+}
+
+//周期进程的带宽，周期不小于一个时钟中断间隔，无需64位除法
+static unsigned int dl_bw(unsigned int runtime, unsigned int period){
+    return runtime / (period >> DL_BW_SHIFT);
+}
+
+//接纳控制：加入新的周期进程后总带宽不超过DL_BW_MAX时接纳
+//返回0表示接纳，1表示拒绝
+int dl_admit(unsigned int runtime, unsigned int period){
+    unsigned int bw = dl_bw(runtime, period);
+
+    if(rt_rq.dl_bw + bw > DL_BW_MAX){
+        return 1;
+    }
+    rt_rq.dl_bw += bw;
+    return 0;
+}
+
+//归还dl_admit()接纳的带宽
+void dl_unadmit(unsigned int runtime, unsigned int period){
+    rt_rq.dl_bw -= dl_bw(runtime, period);
+}
+
+//设置周期进程参数，第一个周期从现在开始
+void dl_start(task_struct * task, unsigned int runtime, unsigned int deadline, unsigned int period){
+    task->dl_runtime = runtime;
+    task->dl_deadline = deadline;
+    task->dl_period = period;
+    task->dl_release = get_cycles();
+    task->dl_abs_deadline = task->dl_release + deadline;
+    task->dl_used = 0;
+    task->dl_throttled = 0;
+}
+
+//当前周期进程完成本周期的工作，计算下一周期的释放时刻并加入定时链表
+//完成时已超过截止时间则记为一次错过；已错过的整个周期被跳过
+//调用者需保证中断关闭，随后调用sleep_on()
+void dl_next_period(task_struct * curr){
+    unsigned int now = get_cycles();
+
+    if((int)(now - curr->dl_abs_deadline) > 0){
+        curr->dl_misses++;
+    }
+    do{
+        curr->dl_release += curr->dl_period;
+    }while((int)(now - curr->dl_release) >= 0);
+    dl_timer_add(curr);
+}
+
+//释放到期的周期进程：睡眠的进程被唤醒，被限流的进程放回就绪链表
+static void dl_release_tick(unsigned int now){
+    task_struct * task;
+
+    while(rt_rq.dl_timers.next != &(rt_rq.dl_timers)){
+        task = container_of(rt_rq.dl_timers.next, task_struct, dl_timer);
+        if((int)(now - task->dl_release) < 0){
+            break;
+        }
+        list_del(&(task->dl_timer));
+        INIT_LIST_HEAD(&(task->dl_timer));
+        task->dl_abs_deadline = task->dl_release + task->dl_deadline;
+        task->dl_used = 0;
+        if(task->dl_throttled){
+            task->dl_throttled = 0;
+            rt_enqueue(task, 0);
+        }
+        else if(task->state == TASK_WAITING){
+            wakeup_task(task);
+        }
+    }
+}
+
+//周期进程退出时移出定时链表并归还带宽
+void rt_exit_task(task_struct * task){
+    if(task->policy != SCHED_DEADLINE){
+        return;
+    }
+    if(task->dl_timer.next != &(task->dl_timer)){
+        list_del(&(task->dl_timer));
+        INIT_LIST_HEAD(&(task->dl_timer));
+    }
+    dl_unadmit(task->dl_runtime, task->dl_period);
+}
+
+//加入对应优先级链表，head为1时加入链表头（被抢占的进程保持原有位置）
+//周期进程按截止时间排序，忽略head
+void rt_enqueue(task_struct * task, int head){
+    struct list_head * queue = &(rt_rq.queue[task->rt_priority]);
+
+    task->rt_on_rq = 1;
+    rt_rq.nr_running++;
+    if(task->policy == SCHED_DEADLINE){
+        dl_enqueue(task);
+        return;
+    }
+    if(head){
+        list_add(&(task->rt_list), queue);
+    }
+    else{
+        list_add_tail(&(task->rt_list), queue);
+    }
+    rt_rq.bitmap |= 1 << task->rt_priority;
+}
+
+//从优先级链表中移除
+void rt_dequeue(task_struct * task){
+    list_del(&(task->rt_list));
+    INIT_LIST_HEAD(&(task->rt_list));
+    if(task->policy != SCHED_DEADLINE &&
+       rt_rq.queue[task->rt_priority].next == &(rt_rq.queue[task->rt_priority])){
+        rt_rq.bitmap &= ~(1 << task->rt_priority);
+    }
+    task->rt_on_rq = 0;
+    rt_rq.nr_running--;
+}
+
+//是否有可运行的实时进程（未被限流）
+int rt_runnable(){
+    return (rt_rq.bitmap != 0 || dl_first() != 0) && !rt_rq.throttled;
+}
+
+//task进入就绪态时是否应立即抢占当前进程curr
+int rt_preempts(task_struct * task, task_struct * curr){
+    if(task->policy == SCHED_NORMAL || rt_rq.throttled){
+        return 0;
+    }
+    if(task->policy == SCHED_DEADLINE){
+        return curr->policy != SCHED_DEADLINE || dl_before(task, curr);
+    }
+    if(curr->policy == SCHED_DEADLINE){
+        return 0;
+    }
+    return curr->policy == SCHED_NORMAL || task->rt_priority > curr->rt_priority;
+}
+
+//是否有可运行的实时进程应抢占当前进程curr
+int rt_need_preempt(task_struct * curr){
+    task_struct * first;
+
+    if(!rt_runnable()){
+        return 0;
+    }
+    first = dl_first();
+    if(first != 0 && rt_preempts(first, curr)){
+        return 1;
+    }
+    if(curr->policy == SCHED_DEADLINE || rt_rq.bitmap == 0){
+        return 0;
+    }
+    return curr->policy == SCHED_NORMAL || fls_index(rt_rq.bitmap) > curr->rt_priority;
+}
+
+//统计当前实时进程的运行时间，用完本周期预算后限流
+//周期进程同时计入自身的运行预算
+void rt_update_curr(task_struct * curr){
+    unsigned int now = get_cycles();
+    unsigned int delta = now - curr->exec_start;
+
+    rt_rq.rt_time += delta;
+    curr->dl_used += delta;
+    curr->exec_start = now;
+    if(rt_rq.rt_time >= RT_RUNTIME_CYCLES){
+        rt_rq.throttled = 1;
+    }
+}
+
+//每个时钟中断调用，周期结束时清零预算并解除限流，并释放到期的周期进程
+void rt_period_tick(){
+    unsigned int now = get_cycles();
+
+    dl_release_tick(now);
+    if(now - rt_rq.period_start >= RT_PERIOD_CYCLES){
+        rt_rq.period_start = now;
+        rt_rq.rt_time = 0;
+        rt_rq.throttled = 0;
+    }
+}
+
+//时钟中断中对当前实时进程记账
+//返回1表示需要重新调度：被限流、有更高优先级的实时进程、周期进程用完本周期预算、
+//或SCHED_RR时间片用完且同优先级有其他进程
+int rt_tick(task_struct * curr){
+    rt_update_curr(curr);
+    if(curr->policy == SCHED_DEADLINE && curr->dl_used >= curr->dl_runtime){
+        //预算用完，等到下一周期再继续本次工作
+        curr->dl_throttled = 1;
+        return 1;
+    }
+    if(rt_rq.throttled || rt_need_preempt(curr)){
+        return 1;
+    }
+    if(curr->policy == SCHED_RR && --curr->rt_time_slice == 0){
+        //同优先级有其他进程时轮转，rt_time_slice保持为0由rt_put_prev()放到链表尾
+        if(rt_rq.bitmap & (1 << curr->rt_priority)){
+            return 1;
+        }
+        curr->rt_time_slice = RT_RR_TIMESLICE;
+    }
+    return 0;
+}
+
+//当前实时进程让出CPU时放回队列
+//时间片用完的SCHED_RR进程放到链表尾，被抢占的进程放到链表头，睡眠的进程不放回
+//预算用完的周期进程加入定时链表，到下一周期释放
+void rt_put_prev(task_struct * curr){
+    int expired = curr->rt_time_slice == 0;
+
+    rt_update_curr(curr);
+    if(expired){
+        curr->rt_time_slice = RT_RR_TIMESLICE;
+    }
+    if(curr->state != TASK_RUNNING && curr->state != TASK_READY){
+        return;
+    }
+    if(curr->dl_throttled){
+        curr->dl_release += curr->dl_period;
+        dl_timer_add(curr);
+        return;
+    }
+    rt_enqueue(curr, !expired);
+}
+
+//截止时间最早的周期进程优先，否则选取最高优先级链表中的第一个进程，O(1)
+//调用者需保证rt_runnable()
+task_struct * rt_pick_next(){
+    task_struct * next;
+
+    next = dl_first();
+    if(next == 0){
+        next = container_of(rt_rq.queue[fls_index(rt_rq.bitmap)].next, task_struct, rt_list);
+    }
+    rt_dequeue(next);
+    next->exec_start = get_cycles();
+    return next;
+}
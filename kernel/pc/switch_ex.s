@@ -1,5 +1,6 @@
 .globl  switch_ex
-.globl  switch_wa
+.globl  switch_to
+.globl  switch_to_ex
 
 .set noreorder
 .set noat
@@ -48,49 +49,64 @@ switch_ex:
 	eret
 
 
-#把ra的值存入epc中
-switch_wa:
-	move	$k1, $sp
-	move    $sp, $a1
-
-
-save_context:
-	sw $at, 4($sp)
-	sw $v0, 8($sp)
-	sw $v1, 12($sp)
-	sw $a0, 16($sp)
-	sw $a1, 20($sp)
-	sw $a2, 24($sp)
-	sw $a3, 28($sp)
-	sw $t0, 32($sp)
-	sw $t1, 36($sp)
-	sw $t2, 40($sp)
-	sw $t3, 44($sp)
-	sw $t4, 48($sp)
-	sw $t5, 52($sp)
-	sw $t6, 56($sp)
-	sw $t7, 60($sp)
-	sw $s0, 64($sp)
-	sw $s1, 68($sp)
-	sw $s2, 72($sp)
-	sw $s3, 76($sp)
-	sw $s4, 80($sp)
-	sw $s5, 84($sp)
-	sw $s6, 88($sp)
-	sw $s7, 92($sp)
-	sw $t8, 96($sp)
-	sw $t9, 100($sp)
-	sw $gp, 112($sp)
-	sw $k1, 116($sp)
-	sw $fp, 120($sp)
-	sw $ra, 124($sp)
-	mfhi $t3
-	mflo $t4
-	sw $ra, 0($sp) # EPC !!!!
-
-	sw $t3, 104($sp) # HI
-	sw $t4, 108($sp) # LO
+#主动切换，在函数调用边界上只需保存、恢复被调用者保存的寄存器
+#a0: 当前进程的switch_frame，a1: 下一进程的switch_frame
+#恢复后开中断并清除EXL，返回到下一进程上次调用switch_to()之后
+switch_to:
+	sw $s0, 0($a0)
+	sw $s1, 4($a0)
+	sw $s2, 8($a0)
+	sw $s3, 12($a0)
+	sw $s4, 16($a0)
+	sw $s5, 20($a0)
+	sw $s6, 24($a0)
+	sw $s7, 28($a0)
+	sw $gp, 32($a0)
+	sw $sp, 36($a0)
+	sw $fp, 40($a0)
+	sw $ra, 44($a0)
+	lw $s0, 0($a1)
+	lw $s1, 4($a1)
+	lw $s2, 8($a1)
+	lw $s3, 12($a1)
+	lw $s4, 16($a1)
+	lw $s5, 20($a1)
+	lw $s6, 24($a1)
+	lw $s7, 28($a1)
+	lw $gp, 32($a1)
+	lw $sp, 36($a1)
+	lw $fp, 40($a1)
+	lw $ra, 44($a1)
+	mtc0 $zero, $9	#count = 0
+	mfc0 $t0, $12
+	li $t1, 0xfffffffd
+	and $t0, $t0, $t1	#清除EXL
+	ori $t0, $t0, 0x01	#IE
+	mtc0 $t0, $12
+	jr $ra
+	nop
 
-	j  switch_ex
 
-			
\ No newline at end of file
+#主动切换到上下文保存在regs_context中的进程（新建或被中断抢占的进程）
+#a0: 当前进程的switch_frame，a1: 下一进程的regs_context
+#置EXL和IE后由switch_ex恢复完整上下文，eret后中断打开
+switch_to_ex:
+	sw $s0, 0($a0)
+	sw $s1, 4($a0)
+	sw $s2, 8($a0)
+	sw $s3, 12($a0)
+	sw $s4, 16($a0)
+	sw $s5, 20($a0)
+	sw $s6, 24($a0)
+	sw $s7, 28($a0)
+	sw $gp, 32($a0)
+	sw $sp, 36($a0)
+	sw $fp, 40($a0)
+	sw $ra, 44($a0)
+	mfc0 $t0, $12
+	ori $t0, $t0, 0x03	#EXL, IE
+	mtc0 $t0, $12
+	nop	# CP0 hazard
+	nop	# CP0 hazard
+	j switch_ex
+	move $a0, $a1
@@ -0,0 +1,177 @@
+#include <zjunix/workerpool.h>
+#include <zjunix/slab.h>
+#include <zjunix/preempt.h>
+#include <intr.h>
+#include <driver/vga.h>
+
+//线程池，工作线程创建后不再退出，短任务交给空闲线程执行，省去创建和回收进程的开销
+//任务运行超过WORKER_JOB_MAX_CYCLES后其线程离开线程池，由新线程补上，任务结束后该线程退出
+struct pool_worker * worker_pool[WORKER_POOL_MAX];
+int worker_pool_size = 0;
+//空闲工作线程链表，后进先出，最近运行过的线程优先
+static LIST_HEAD(pool_idle);
+
+//没有任务时加入空闲链表并睡眠，由run_on_worker()唤醒
+//检查与睡眠之间保持关中断，不会丢失唤醒
+void pool_worker_wait(struct pool_worker * w){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(w->fn == 0){
+        list_add(&(w->list), &pool_idle);
+        sleep_on(&(w->waitq));
+        return;
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//执行交给该工作线程的任务
+//返回1表示任务运行过久，该线程已离开线程池，调用者释放w后退出
+int pool_worker_run(struct pool_worker * w){
+    void (*fn)(void * arg);
+    void * arg;
+    int old_ie;
+    int detached;
+
+    old_ie = disable_interrupts();
+    fn = w->fn;
+    arg = w->arg;
+    w->fn = 0;
+    if(fn != 0){
+        w->busy = 1;
+        w->start = w->task->stat.run_cycles;
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+    if(fn != 0){
+        fn(arg);
+        w->jobs++;
+    }
+
+    old_ie = disable_interrupts();
+    w->busy = 0;
+    detached = w->detached;
+    if(old_ie){
+        enable_interrupts();
+    }
+    return detached;
+}
+
+//工作线程入口
+static void pool_worker_thread(void * arg){
+    struct pool_worker * w = (struct pool_worker *)arg;
+
+    while(1){
+        pool_worker_wait(w);
+        if(pool_worker_run(w)){
+            //已离开线程池，返回后由kthread_entry()退出
+            kfree(w);
+            return;
+        }
+    }
+}
+
+//任务运行时间超过WORKER_JOB_MAX_CYCLES的线程离开线程池，空出的位置可以创建新线程
+//不会结束的任务因此只占用自己的线程，不会长期占满线程池
+//调用者需保证中断关闭
+static void pool_detach_stale(){
+    struct pool_worker * w;
+    int i = 0;
+
+    while(i < worker_pool_size){
+        w = worker_pool[i];
+        if(w->busy && w->task->stat.run_cycles - w->start > WORKER_JOB_MAX_CYCLES){
+            w->detached = 1;
+            worker_pool_size--;
+            worker_pool[i] = worker_pool[worker_pool_size];
+            continue;
+        }
+        i++;
+    }
+}
+
+//创建一个工作线程，fn不为0时新线程第一次运行即执行该任务
+//调用者需保证中断关闭，失败返回0
+static struct pool_worker * pool_grow(void (*fn)(void * arg), void * arg){
+    struct pool_worker * w;
+    pid_t pid;
+
+    if(worker_pool_size >= WORKER_POOL_MAX){
+        return 0;
+    }
+    w = (struct pool_worker *)kmalloc(sizeof(struct pool_worker));
+    if(w == 0){
+        return 0;
+    }
+    w->fn = fn;
+    w->arg = arg;
+    w->jobs = 0;
+    w->busy = 0;
+    w->start = 0;
+    w->detached = 0;
+    INIT_LIST_HEAD(&(w->list));
+    INIT_LIST_HEAD(&(w->waitq));
+    if(kthread_create("worker", WORKER_POOL_PRORITY, pool_worker_thread, w, &pid)){
+        kfree(w);
+        return 0;
+    }
+    w->task = find_in_tasks(pid);
+    worker_pool[worker_pool_size] = w;
+    worker_pool_size++;
+    return w;
+}
+
+//预先创建WORKER_POOL_MIN个工作线程
+//需在init进程创建之后调用
+void init_worker_pool(){
+    int i;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    worker_pool_size = 0;
+    INIT_LIST_HEAD(&pool_idle);
+    for(i = 0; i < WORKER_POOL_MIN; i++){
+        if(pool_grow(0, 0) == 0){
+            kernel_printf("Init_worker_pool: worker created failed!\n");
+            break;
+        }
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//在线程池中执行fn(arg)，fn返回后工作线程回到空闲链表
+//没有空闲线程时创建新线程，达到WORKER_POOL_MAX后返回1，调用者可改用task_create()
+//任务以WORKER_POOL_PRORITY运行，需要其他优先级或不会结束的任务应使用task_create()
+//可在中断上下文中调用，此时只交给空闲线程：创建线程需kmalloc()，会获取slab/buddy的自旋锁
+//没有空闲线程时返回1
+//成功返回0
+int run_on_worker(void (*fn)(void * arg), void * arg){
+    struct pool_worker * w;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(pool_idle.next != &pool_idle){
+        w = container_of(pool_idle.next, struct pool_worker, list);
+        list_del(&(w->list));
+        INIT_LIST_HEAD(&(w->list));
+        w->fn = fn;
+        w->arg = arg;
+        wakeup_queue(&(w->waitq));
+    }
+    else if(in_interrupt()){
+        w = 0;
+    }
+    else{
+        pool_detach_stale();
+        w = pool_grow(fn, arg);
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+    return w == 0;
+}
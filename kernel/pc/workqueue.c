@@ -0,0 +1,209 @@
+#include <zjunix/workqueue.h>
+#include <intr.h>
+#include <zjunix/slab.h>
+#include <zjunix/utils.h>
+#include <driver/vga.h>
+
+//系统工作队列，用于进程回收、文件缓存写回等延后处理的工作
+struct workqueue_struct * system_wq = 0;
+//时钟中断计数，延迟工作以此计时
+unsigned int wq_ticks = 0;
+//延迟工作链表，按到期时间升序排列
+static LIST_HEAD(delayed_list);
+
+//初始化工作队列，创建系统工作队列及其工作线程
+//需在init进程创建之后调用，保证init进程的PID为INIT_PID
+void init_workqueues(){
+    wq_ticks = 0;
+    INIT_LIST_HEAD(&delayed_list);
+    system_wq = create_workqueue("events", WQ_DEFAULT_PRORITY);
+    if(system_wq == 0){
+        kernel_printf("Init_workqueues: system workqueue created failed!\n");
+    }
+}
+
+//依次处理工作队列中的所有工作项
+//取出工作项时关中断，调用处理函数时开中断，处理函数可以再次加入自身
+//返回处理的工作项数
+int run_workqueue(struct workqueue_struct * wq){
+    struct work_struct * work;
+    int count = 0;
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    while(wq->worklist.next != &(wq->worklist)){
+        work = container_of(wq->worklist.next, struct work_struct, entry);
+        list_del(&(work->entry));
+        INIT_LIST_HEAD(&(work->entry));
+        work->pending = 0;
+        enable_interrupts();
+
+        work->func(work);
+        count++;
+
+        disable_interrupts();
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+    return count;
+}
+
+//工作队列为空时工作线程睡眠，由queue_work()唤醒
+//检查与睡眠之间保持关中断，不会丢失唤醒
+void worker_wait(struct workqueue_struct * wq){
+    int old_ie;
+
+    old_ie = disable_interrupts();
+    if(wq->worklist.next == &(wq->worklist)){
+        sleep_on(&(wq->waitq));
+        return;
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+}
+
+//工作线程入口
+static void worker_thread(void * arg){
+    struct workqueue_struct * wq = (struct workqueue_struct *)arg;
+
+    while(1){
+        run_workqueue(wq);
+        worker_wait(wq);
+    }
+}
+
+//创建工作队列及其工作线程
+//prority: 工作线程的静态优先级
+//失败返回0
+struct workqueue_struct * create_workqueue(char * name, long prority){
+    struct workqueue_struct * wq;
+    pid_t pid;
+    int i;
+
+    wq = (struct workqueue_struct *)kmalloc(sizeof(struct workqueue_struct));
+    if(wq == 0){
+        return 0;
+    }
+    INIT_LIST_HEAD(&(wq->worklist));
+    INIT_LIST_HEAD(&(wq->waitq));
+    for(i = 0; i < WQ_NAME_LEN - 1 && name[i]; i++){
+        wq->name[i] = name[i];
+    }
+    wq->name[i] = 0;
+
+    if(kthread_create(name, prority, worker_thread, wq, &pid)){
+        kfree(wq);
+        return 0;
+    }
+    wq->worker = find_in_tasks(pid);
+    return wq;
+}
+
+//将工作项加入工作队列，工作线程空闲时将其唤醒
+//可在中断上下文中调用
+//返回1表示加入成功，0表示工作项已在队列中或工作队列不存在
+int queue_work(struct workqueue_struct * wq, struct work_struct * work){
+    int old_ie;
+
+    if(wq == 0){
+        return 0;
+    }
+    old_ie = disable_interrupts();
+    if(work->pending){
+        if(old_ie){
+            enable_interrupts();
+        }
+        return 0;
+    }
+    work->pending = 1;
+    list_add_tail(&(work->entry), &(wq->worklist));
+    //只唤醒在worker_wait()中空闲睡眠的工作线程
+    //处理函数中睡眠在互斥锁等其他等待链表上的工作线程不能被移出
+    wakeup_queue(&(wq->waitq));
+    if(old_ie){
+        enable_interrupts();
+    }
+    return 1;
+}
+
+//将工作项在delay个时钟中断后加入工作队列，delay为0时立即加入
+//返回1表示加入成功，0表示工作项已在等待
+int queue_delayed_work(struct workqueue_struct * wq, struct delayed_work * dwork, unsigned int delay){
+    struct list_head * pos;
+    struct delayed_work * next;
+    int old_ie;
+
+    if(delay == 0){
+        return queue_work(wq, &(dwork->work));
+    }
+    old_ie = disable_interrupts();
+    if(dwork->work.pending){
+        if(old_ie){
+            enable_interrupts();
+        }
+        return 0;
+    }
+    dwork->work.pending = 1;
+    dwork->wq = wq;
+    dwork->expires = wq_ticks + delay;
+    //按到期时间插入，时钟中断中只需检查链表头
+    list_for_each(pos, &delayed_list){
+        next = container_of(pos, struct delayed_work, timer);
+        if((int)(dwork->expires - next->expires) < 0){
+            break;
+        }
+    }
+    list_add_tail(&(dwork->timer), pos);
+    if(old_ie){
+        enable_interrupts();
+    }
+    return 1;
+}
+
+//取消尚未到期的延迟工作
+//返回1表示取消成功，0表示工作项未在等待到期
+int cancel_delayed_work(struct delayed_work * dwork){
+    int old_ie;
+    int ret = 0;
+
+    old_ie = disable_interrupts();
+    if(dwork->timer.next != &(dwork->timer)){
+        list_del(&(dwork->timer));
+        INIT_LIST_HEAD(&(dwork->timer));
+        dwork->work.pending = 0;
+        ret = 1;
+    }
+    if(old_ie){
+        enable_interrupts();
+    }
+    return ret;
+}
+
+//加入系统工作队列
+int schedule_work(struct work_struct * work){
+    return queue_work(system_wq, work);
+}
+
+//延迟加入系统工作队列
+int schedule_delayed_work(struct delayed_work * dwork, unsigned int delay){
+    return queue_delayed_work(system_wq, dwork, delay);
+}
+
+//时钟中断中调用，将到期的延迟工作加入工作队列
+void workqueue_tick(){
+    struct delayed_work * dwork;
+
+    wq_ticks++;
+    while(delayed_list.next != &delayed_list){
+        dwork = container_of(delayed_list.next, struct delayed_work, timer);
+        if((int)(wq_ticks - dwork->expires) < 0){
+            break;
+        }
+        list_del(&(dwork->timer));
+        INIT_LIST_HEAD(&(dwork->timer));
+        dwork->work.pending = 0;
+        queue_work(dwork->wq, &(dwork->work));
+    }
+}
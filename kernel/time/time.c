@@ -33,6 +33,8 @@ void get_time_string(unsigned int ticks_high, unsigned int ticks_low, char *buf)
 #pragma GCC push_options
 #pragma GCC optimize("O0")
 
+// Clock in the bottom-right corner, redrawn once per period.
+// Runs as a periodic task (see task_create_periodic), sleeping between redraws.
 void system_time_proc() {
     unsigned int ticks_high, ticks_low;
     int i;
@@ -49,18 +51,40 @@ void system_time_proc() {
             kernel_putchar_at(day[i], 0xfff, 0, 29, 61 + i);
         for (i = 0; i < 8; i++)
             kernel_putchar_at(buffer[i], 0xfff, 0, 29, 72 + i);
+        wait_next_period();
     }
 }
 
 void get_time(char *buf, int len) {
-    assert(len >= 9, "Buf of get_time too small, at least 9 bytes");
+    format_time(get_cycles64(), buf, len);
+}
+
+void format_time(unsigned long long cycles, char *buf, int len) {
+    assert(len >= 9, "Buf of format_time too small, at least 9 bytes");
+    get_time_string((unsigned int)(cycles >> 32), (unsigned int)cycles, buf);
+    buf[8] = 0;
+}
+
+unsigned long long get_cycles64() {
     unsigned int ticks_high, ticks_low;
     asm volatile(
         "mfc0 %0, $9, 6\n\t"
         "mfc0 %1, $9, 7\n\t"
         : "=r"(ticks_low), "=r"(ticks_high));
-    get_time_string(ticks_high, ticks_low, buf);
-    buf[8] = 0;
+    return ((unsigned long long)ticks_high << 32) | ticks_low;
+}
+
+unsigned int get_cycles() {
+    unsigned int ticks_low;
+    asm volatile("mfc0 %0, $9, 6\n\t" : "=r"(ticks_low));
+    return ticks_low;
 }
 
-#pragma GCC pop_options
\ No newline at end of file
+#pragma GCC pop_options
+
+unsigned int cycles_to_ms(unsigned long long cycles) {
+    unsigned int high = (unsigned int)(cycles >> 32);
+    unsigned int low = (unsigned int)cycles;
+    // 2^32 / 100000: q = 42949, r = 67296, same trick as get_time_string
+    return high * 42949 + (high * 67296) / 100000 + low / 100000;
+}
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "vm.h"
+#include <zjunix/slab.h>
+#include <zjunix/utils.h>
+#include <intr.h>
+
+//EntryLo flags of a page in a vma with vm_flags
+//the MIPS32 TLB has no read or execute inhibit, so VM_READ/VM_EXEC only
+//decide whether the page may be faulted in at all; D follows VM_WRITE
+static unsigned int vm_pte_flags(unsigned long vm_flags)
+{
+	unsigned int flags = _PAGE_CACHED | _PAGE_VALID;
+	if(vm_flags & VM_WRITE)
+		flags |= _PAGE_DIRTY;
+	return flags;
+}
+
+//do_page_fault() in a VM_HUGEPAGE vma: pages of vma->vm_page_order are
+//allocated, copied and write-enabled whole, and loaded with their PageMask
+static int do_huge_page_fault(struct mm_struct* mm, struct vm_area_struct* vma, unsigned int addr, int type)
+{
+	unsigned int order = vma->vm_page_order;
+	unsigned int size = PAGE_SIZE << order;
+	pgd_t old = mm->pgd[pgd_index(addr)];
+	unsigned int i, k;
+	pte_t* pt;
+	pte_t pte;
+	void* page;
+
+	pt = hpte_alloc(mm->pgd, addr, order);
+	if(!pt)
+		return FAULT_OOM;
+	//the TLB may hold entries of the region's old page size, whose ranges
+	//would overlap the new ones
+	if(pgd_table(old)!=invalid_pte_table&&pgd_order(old)!=order)
+		flush_tlb_mm(mm);
+
+	i = hpte_index(addr, order);
+	pte = pt[i];
+	if(!pte_valid(pte))
+	{
+		page = kmalloc(size);
+		if(!page)
+			return FAULT_OOM;
+		kernel_memset(page, 0, size);
+		pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, vm_pte_flags(vma->vm_flags));
+		set_ref(pte_page(pte), 1);
+		mm->rss += 1 << order;
+	}
+	else if(type!=FAULT_READ)
+	{
+		if(pte_page(pte)->reference>1)
+		{
+			page = kmalloc(size);
+			if(!page)
+				return FAULT_OOM;
+			for(k=0;k<1<<order;k++)
+				copy_user_page((char*)page + k * PAGE_SIZE, (void*)(pte_pa(pte) + VM_CHANGE2PHY + k * PAGE_SIZE));
+			put_user_page(pte);
+			pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, vm_pte_flags(vma->vm_flags));
+			set_ref(pte_page(pte), 1);
+		}
+		else
+			pte |= _PAGE_DIRTY;
+	}
+	set_hpte(pt, i, order, pte);
+
+	i &= ~1;
+	tlb_update(addr, pt[i], pt[i+1], order_pagemask(order));
+	return FAULT_OK;
+}
+
+//a store to the present, write-protected page *pte of vma: copy the page
+//unless the pte is its only mapping (shared after dup_mm(), or a private
+//file mapping's page cache cluster, which the cache holds a reference to)
+static int do_wp_page(struct vm_area_struct* vma, pte_t* pte)
+{
+	void* page;
+
+	if(pte_page(*pte)->reference>1)
+	{
+		page = kmalloc(PAGE_SIZE);
+		if(!page)
+			return FAULT_OOM;
+		copy_user_page(page, (void*)(pte_pa(*pte) + VM_CHANGE2PHY));
+		put_user_page(*pte);
+		*pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, vm_pte_flags(vma->vm_flags));
+		set_ref(pte_page(*pte), 1);
+	}
+	else
+		*pte |= _PAGE_DIRTY;
+	return FAULT_OK;
+}
+
+//do_page_fault() in a file-backed vma: the page cache's cluster itself is
+//mapped, write-protected until the first store; the store copies it in a
+//private mapping, and makes it dirty in a shared one, for filemap_sync()
+//to write back; may sleep on the page cache and sd card I/O
+static int do_file_page_fault(struct mm_struct* mm, struct vm_area_struct* vma, unsigned int addr, int type)
+{
+	unsigned long index = vma->vm_pgoff + ((addr - vma->vm_start) >> PAGE_SHIFT);
+	pte_t* pte;
+	pte_t* pair;
+	void* page;
+	int ret;
+
+	pte = pte_alloc(mm->pgd, addr);
+	if(!pte)
+		return FAULT_OOM;
+	if(!pte_valid(*pte))
+	{
+		//past the end of the file
+		if(index>=vma->vm_file->nr_pages)
+			return FAULT_BADADDR;
+		page = filemap_page(vma->vm_file, index);
+		if(!page)
+			return FAULT_OOM;
+		*pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, _PAGE_CACHED | _PAGE_VALID);
+		mm->rss++;
+	}
+	if(type!=FAULT_READ)
+	{
+		if(vma->vm_flags & VM_SHARED)
+			*pte |= _PAGE_DIRTY;
+		else
+		{
+			ret = do_wp_page(vma, pte);
+			if(ret!=FAULT_OK)
+				return ret;
+		}
+	}
+
+	pair = (pte_t*)((unsigned int)pte & ~(2 * sizeof(pte_t) - 1));
+	tlb_update(addr, pair[0], pair[1], 0);
+	return FAULT_OK;
+}
+
+//handle a TLB invalid (FAULT_READ/FAULT_WRITE) or TLB modified
+//(FAULT_MODIFY) exception at addr in mm
+//the page is allocated only if addr lies in a vma permitting the access,
+//then its pte pair is loaded into the TLB
+int do_page_fault(struct mm_struct* mm, unsigned int addr, int type)
+{
+	struct vm_area_struct* vma;
+	pte_t* pte;
+	pte_t* pair;
+	void* page;
+	int ret;
+
+	tlb_faults++;
+	vma = find_vma(mm, addr);
+	if(!vma||vma->vm_start>addr)
+		return FAULT_BADADDR;
+	if(type==FAULT_READ)
+	{
+		if(!(vma->vm_flags & (VM_READ|VM_EXEC)))
+			return FAULT_BADACCESS;
+	}
+	else if(!(vma->vm_flags & VM_WRITE))
+		return FAULT_BADACCESS;
+	if(vma->vm_flags & VM_HUGEPAGE)
+		return do_huge_page_fault(mm, vma, addr, type);
+	if(vma->vm_file)
+		return do_file_page_fault(mm, vma, addr, type);
+
+	pte = pte_alloc(mm->pgd, addr);
+	if(!pte)
+		return FAULT_OOM;
+	if(!pte_valid(*pte))
+	{
+		page = kmalloc(PAGE_SIZE);
+		if(!page)
+			return FAULT_OOM;
+		kernel_memset(page, 0, PAGE_SIZE);
+		*pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, vm_pte_flags(vma->vm_flags));
+		set_ref(pte_page(*pte), 1);
+		mm->rss++;
+	}
+	else if(type!=FAULT_READ)
+	{
+		//present but write-protected by dup_mm()
+		ret = do_wp_page(vma, pte);
+		if(ret!=FAULT_OK)
+			return ret;
+	}
+
+	pair = (pte_t*)((unsigned int)pte & ~(2 * sizeof(pte_t) - 1));
+	tlb_update(addr, pair[0], pair[1], 0);
+	return FAULT_OK;
+}
+
+//free the pages mapped in [start, end) and drop their TLB entries
+void zap_page_range(struct mm_struct* mm, unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+	pgd_t* pgd;
+	pte_t* pte;
+	int old_ie;
+
+	for(addr=start&PAGE_MASK;addr<end;addr+=PAGE_SIZE)
+	{
+		pgd = mm->pgd + pgd_index(addr);
+		if(pgd_table(*pgd)==invalid_pte_table)
+		{
+			//no page table: skip the rest of this 4MB region
+			addr = (addr & PGD_MASK) + (1 << PGD_SHIFT) - PAGE_SIZE;
+			if(addr+PAGE_SIZE==0)
+				break;
+			continue;
+		}
+		//a whole region, or one of large pages (their vmas cover whole
+		//regions): free the page table too, so the region may later be
+		//mapped with another page size
+		if(pgd_order(*pgd)||(!(addr & ~PGD_MASK)&&end-addr>=(1 << PGD_SHIFT)))
+		{
+			mm->rss -= pt_release(pgd_table(*pgd), pgd_order(*pgd));
+			*pgd = (pgd_t)invalid_pte_table;
+			addr = (addr & PGD_MASK) + (1 << PGD_SHIFT) - PAGE_SIZE;
+			if(addr+PAGE_SIZE==0)
+				break;
+			continue;
+		}
+		pte = pgd_table(*pgd) + pte_index(addr);
+		if(pte_valid(*pte))
+		{
+			put_user_page(*pte);
+			*pte = 0;
+			mm->rss--;
+		}
+	}
+	old_ie = disable_interrupts();
+	flush_tlb_mm(mm);
+	if(old_ie)
+		enable_interrupts();
+}
@@ -0,0 +1,189 @@
+#include "vm.h"
+#include <zjunix/slab.h>
+#include <zjunix/utils.h>
+#include <zjunix/atomic.h>
+#include <zjunix/pc.h>
+#include <zjunix/mfs/fat32cache.h>
+#include <arch.h>
+#include <intr.h>
+
+#include "../mfs/utils.h"
+
+//file-backed vmas map the FAT32 page cache's clusters into the process, so
+//reading a mapped file copies nothing; stores through shared mappings are
+//written back by filemap_sync() on do_msync() and do_unmap(), and by
+//filemap_sync_mm() before a task terminates: writeback sleeps on the SD
+//card, so mm_delete() on the reaper does not do it
+//the file size is fixed at mmap time: stores past the end of the file do
+//not extend it
+
+#if CLUSTER_SIZE != PAGE_SIZE
+#error "file mappings need one page per cluster"
+#endif
+
+//end of a cluster chain in the FAT
+#define CLUSTER_CHAIN_END	0x0ffffff8
+
+static struct vm_file* vm_file_create(MY_FILE* file)
+{
+	struct vm_file* vf;
+	unsigned int n, i, clu;
+
+	vf = kmalloc(sizeof(struct vm_file));
+	if(!vf)
+		return 0;
+	vf->reference = 1;
+	vf->start_clu = 0;
+	vf->size = get_file_size(file);
+	vf->clusters = 0;
+	n = Allign(vf->size, PAGE_SIZE) >> PAGE_SHIFT;
+	if(n)
+	{
+		vf->clusters = kmalloc(n * sizeof(unsigned int));
+		if(!vf->clusters)
+		{
+			kfree(vf);
+			return 0;
+		}
+	}
+	//a file without data has start cluster 0
+	clu = get_start_clu_num(file);
+	if(clu>=2&&clu<CLUSTER_CHAIN_END)
+	{
+		if(fat32_map(clu))
+		{
+			if(vf->clusters)
+				kfree(vf->clusters);
+			kfree(vf);
+			return 0;
+		}
+		vf->start_clu = clu;
+	}
+	for(i=0;i<n&&clu>=2&&clu<CLUSTER_CHAIN_END;i++)
+	{
+		vf->clusters[i] = clu;
+		clu = get_next_clu_num(clu);
+	}
+	vf->nr_pages = i;
+	return vf;
+}
+
+struct vm_file* get_vm_file(struct vm_file* file)
+{
+	if(file)
+		atomic_fetch_add(&file->reference, 1);
+	return file;
+}
+
+void put_vm_file(struct vm_file* file)
+{
+	if(file&&atomic_fetch_add(&file->reference, -1)==1)
+	{
+		if(file->start_clu)
+			fat32_unmap(file->start_clu);
+		if(file->clusters)
+			kfree(file->clusters);
+		kfree(file);
+	}
+}
+
+//map len bytes of file from its page pgoff at addr (0: anywhere), with
+//vm_flags flags; stores reach the file if flags has VM_SHARED and are
+//private copies otherwise. Returns the address, -1 on failure
+unsigned long do_mmap_file(MY_FILE* file, unsigned long addr, unsigned long len, unsigned long flags, unsigned long pgoff)
+{
+	struct vm_file* vf;
+
+	vf = vm_file_create(file);
+	if(!vf)
+		return -1;
+	addr = do_mmap_pgoff(vf, addr, len, flags, pgoff);
+	put_vm_file(vf);
+	return addr;
+}
+
+//kernel address of page index of file, in the page cache; the cache keeps
+//it until the pte mapping it is dropped with put_user_page()
+void* filemap_page(struct vm_file* file, unsigned long index)
+{
+	struct mem_page* page;
+
+	page = map_page(file->clusters[index] - 2);
+	return page ? page->p_data : 0;
+}
+
+//write the pages of the shared file vma stored to in [start, end) back to
+//the file and write-protect them again, so the next store is noticed
+//returns the number of pages written; the caller flushes mm's TLB
+int filemap_sync(struct mm_struct* mm, struct vm_area_struct* vma, unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+	pte_t* pte;
+	int n = 0;
+
+	for(addr=start;addr<end;addr+=PAGE_SIZE)
+	{
+		pte = pte_lookup(mm->pgd, addr);
+		if(!pte)
+		{
+			//no page table: skip the rest of this 4MB region
+			addr = (addr & PGD_MASK) + (1 << PGD_SHIFT) - PAGE_SIZE;
+			if(addr+PAGE_SIZE==0)
+				break;
+			continue;
+		}
+		if(!pte_valid(*pte)||!(*pte & _PAGE_DIRTY))
+			continue;
+		*pte &= ~_PAGE_DIRTY;
+		sync_page(vma->vm_file->clusters[vma->vm_pgoff + ((addr - vma->vm_start) >> PAGE_SHIFT)] - 2);
+		n++;
+	}
+	return n;
+}
+
+//write back the stores through all shared file mappings of mm, called in
+//process context before the task owning mm terminates, as it may sleep
+//returns the number of pages written; mm is not used again, so its TLB
+//entries are left alone
+int filemap_sync_mm(struct mm_struct* mm)
+{
+	struct vm_area_struct* vma;
+	int n = 0;
+
+	for(vma=mm->mmap;vma;vma=vma->vm_next)
+	{
+		if(vma->vm_file&&(vma->vm_flags & VM_SHARED))
+			n += filemap_sync(mm, vma, vma->vm_start, vma->vm_end);
+	}
+	return n;
+}
+
+//write the stores through shared file mappings in [addr, addr+len) back
+//returns the number of pages written, -1 if the range is not page aligned
+int do_msync(unsigned long addr, unsigned long len)
+{
+	struct mm_struct* mm = current_task->mm;
+	struct vm_area_struct* vma;
+	unsigned long end;
+	int n = 0, old_ie;
+
+	len = Allign(len, PAGE_SIZE);
+	if(addr&~PAGE_MASK||addr>KERNEL_ENTRY||len>KERNEL_ENTRY-addr)
+		return -1;
+	end = addr + len;
+	for(vma=find_vma(mm,addr);vma&&vma->vm_start<end;vma=vma->vm_next)
+	{
+		if(vma->vm_file&&(vma->vm_flags & VM_SHARED))
+			n += filemap_sync(mm, vma, addr>vma->vm_start ? addr : vma->vm_start,
+							  end<vma->vm_end ? end : vma->vm_end);
+	}
+	//drop the TLB entries still allowing stores
+	if(n)
+	{
+		old_ie = disable_interrupts();
+		flush_tlb_mm(mm);
+		if(old_ie)
+			enable_interrupts();
+	}
+	return n;
+}
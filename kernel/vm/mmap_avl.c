@@ -0,0 +1,171 @@
+#include "vm.h"
+#include <driver/vga.h>
+
+//AVL tree of the vmas of an address space, keyed by vm_start
+//vmas never overlap, so the order by vm_start is also the order by vm_end
+//and find_vma() can search on vm_end; vm_next/vm_prev link the same vmas
+//in address order
+
+//the height of an AVL tree of 2^32 nodes is below 1.44*32
+#define AVL_MAXHEIGHT	48
+
+#define heightof(tree)	((tree)==VM_AVL_EMPTY ? 0 : (tree)->vm_avl_height)
+
+//restore the balance of the count subtrees whose links sit on the stack
+//below top, bottom-up; stops as soon as a subtree keeps its height
+static void avl_rebalance(struct vm_area_struct*** top, int count)
+{
+	struct vm_area_struct **nodeplace, *node, *l, *r, *lr, *rl;
+	int hl, hr, height;
+
+	for(;count>0;count--)
+	{
+		nodeplace = *--top;
+		node = *nodeplace;
+		l = node->vm_avl_left;
+		r = node->vm_avl_right;
+		hl = heightof(l);
+		hr = heightof(r);
+		if(hl>hr+1)
+		{
+			lr = l->vm_avl_right;
+			if(heightof(l->vm_avl_left)>=heightof(lr))
+			{
+				//single right rotation
+				node->vm_avl_left = lr;
+				l->vm_avl_right = node;
+				node->vm_avl_height = heightof(lr) + 1;
+				l->vm_avl_height = node->vm_avl_height + 1;
+				*nodeplace = l;
+			}
+			else
+			{
+				//left-right double rotation, lr becomes the root
+				l->vm_avl_right = lr->vm_avl_left;
+				node->vm_avl_left = lr->vm_avl_right;
+				lr->vm_avl_left = l;
+				lr->vm_avl_right = node;
+				l->vm_avl_height = node->vm_avl_height = hl - 1;
+				lr->vm_avl_height = hl;
+				*nodeplace = lr;
+			}
+		}
+		else if(hr>hl+1)
+		{
+			rl = r->vm_avl_left;
+			if(heightof(r->vm_avl_right)>=heightof(rl))
+			{
+				node->vm_avl_right = rl;
+				r->vm_avl_left = node;
+				node->vm_avl_height = heightof(rl) + 1;
+				r->vm_avl_height = node->vm_avl_height + 1;
+				*nodeplace = r;
+			}
+			else
+			{
+				r->vm_avl_left = rl->vm_avl_right;
+				node->vm_avl_right = rl->vm_avl_left;
+				rl->vm_avl_right = r;
+				rl->vm_avl_left = node;
+				r->vm_avl_height = node->vm_avl_height = hr - 1;
+				rl->vm_avl_height = hr;
+				*nodeplace = rl;
+			}
+		}
+		else
+		{
+			height = (hl>hr ? hl : hr) + 1;
+			if(height==node->vm_avl_height)
+				break;
+			node->vm_avl_height = height;
+		}
+	}
+}
+
+//insert vma, which must not overlap any vma in the tree
+void avl_insert(struct vm_area_struct* vma, struct vm_area_struct** ptree)
+{
+	struct vm_area_struct** stack[AVL_MAXHEIGHT];
+	struct vm_area_struct*** top = stack;
+	struct vm_area_struct** nodeplace = ptree;
+	struct vm_area_struct* node;
+	int count = 0;
+
+	for(;;)
+	{
+		node = *nodeplace;
+		if(node==VM_AVL_EMPTY)
+			break;
+		*top++ = nodeplace;
+		count++;
+		if(vma->vm_start<node->vm_start)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	vma->vm_avl_left = vma->vm_avl_right = VM_AVL_EMPTY;
+	vma->vm_avl_height = 1;
+	*nodeplace = vma;
+	avl_rebalance(top, count);
+}
+
+//remove vma from the tree
+void avl_remove(struct vm_area_struct* vma, struct vm_area_struct** ptree)
+{
+	struct vm_area_struct** stack[AVL_MAXHEIGHT];
+	struct vm_area_struct*** top = stack;
+	struct vm_area_struct*** top_vma;
+	struct vm_area_struct** nodeplace = ptree;
+	struct vm_area_struct** vmaplace;
+	struct vm_area_struct* node;
+	int count = 0;
+
+	for(;;)
+	{
+		node = *nodeplace;
+		if(node==VM_AVL_EMPTY)
+		{
+			kernel_printf("avl_remove: vma %x-%x not in tree\n", vma->vm_start, vma->vm_end);
+			return;
+		}
+		*top++ = nodeplace;
+		count++;
+		if(node==vma)
+			break;
+		if(vma->vm_start<node->vm_start)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	vmaplace = nodeplace;
+
+	if(vma->vm_avl_left==VM_AVL_EMPTY)
+	{
+		*vmaplace = vma->vm_avl_right;
+		top--;
+		count--;
+	}
+	else
+	{
+		//the rightmost node of the left subtree takes vma's place
+		top_vma = top;
+		nodeplace = &vma->vm_avl_left;
+		for(;;)
+		{
+			node = *nodeplace;
+			if(node->vm_avl_right==VM_AVL_EMPTY)
+				break;
+			*top++ = nodeplace;
+			count++;
+			nodeplace = &node->vm_avl_right;
+		}
+		*nodeplace = node->vm_avl_left;
+		node->vm_avl_left = vma->vm_avl_left;
+		node->vm_avl_right = vma->vm_avl_right;
+		node->vm_avl_height = vma->vm_avl_height;
+		*vmaplace = node;
+		//the first link stacked below vma was its left link, now node's
+		*top_vma = &node->vm_avl_left;
+	}
+	avl_rebalance(top, count);
+}
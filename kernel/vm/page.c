@@ -0,0 +1,160 @@
+#include <zjunix/page.h>
+#include <zjunix/vm.h>
+#include <zjunix/slab.h>
+#include <zjunix/utils.h>
+#include <driver/vga.h>
+
+//page table shared by every unmapped 4MB region, all entries invalid,
+//so the refill handler never has to test for a missing page table
+pte_t invalid_pte_table[PTRS_PER_PTE] __attribute__((aligned(PAGE_SIZE)));
+//page directory of tasks without a user address space
+pgd_t swapper_pg_dir[PTRS_PER_PGD] __attribute__((aligned(PAGE_SIZE)));
+//page directory walked by the refill handler, switched by switch_mm()
+pgd_t *pgd_current = swapper_pg_dir;
+
+//point every entry of pgd at the invalid page table
+void pgd_init(pgd_t *pgd)
+{
+	int i;
+	for(i=0;i<PTRS_PER_PGD;i++)
+		pgd[i] = (pgd_t)invalid_pte_table;
+}
+
+//return the pte of va, or 0 if its page table does not exist
+pte_t *pte_lookup(pgd_t *pgd, unsigned int va)
+{
+	pte_t *pt = pgd_table(pgd[pgd_index(va)]);
+	if(pt==invalid_pte_table)
+		return 0;
+	return pt + pte_index(va);
+}
+
+//return the pte of va, allocating its page table if needed; 0 if out of memory
+pte_t *pte_alloc(pgd_t *pgd, unsigned int va)
+{
+	pte_t *pt = pgd_table(pgd[pgd_index(va)]);
+	if(pt==invalid_pte_table)
+	{
+		pt = kmalloc(PAGE_SIZE);
+		if(pt==0)
+			return 0;
+		kernel_memset(pt, 0, PAGE_SIZE);
+		pgd[pgd_index(va)] = (pgd_t)pt;
+	}
+	return pt + pte_index(va);
+}
+
+//return the page table of the 4MB region of va, set up for TLB pages of
+//order; 0 if out of memory, or if the region maps pages of another order
+//an empty table of another order is taken over
+pte_t *hpte_alloc(pgd_t *pgd, unsigned int va, unsigned int order)
+{
+	pgd_t *entry = pgd + pgd_index(va);
+	pte_t *pt = pgd_table(*entry);
+	int i;
+
+	if(pt==invalid_pte_table)
+	{
+		pt = kmalloc(PAGE_SIZE);
+		if(pt==0)
+			return 0;
+	}
+	else if(pgd_order(*entry)==order)
+		return pt;
+	else
+	{
+		for(i=0;i<PTRS_PER_PTE;i++)
+		{
+			if(pte_valid(pt[i]))
+				return 0;
+		}
+	}
+	kernel_memset(pt, 0, PAGE_SIZE);
+	*entry = (pgd_t)pt | ((1 << order) - 1);
+	return pt;
+}
+
+//store the pte of a large page of order in every entry standing for it;
+//index is hpte_index() of an address in the page
+void set_hpte(pte_t *pt, unsigned int index, unsigned int order, pte_t pte)
+{
+	unsigned int end = (index & ~1) + (2 << order);
+	for(;index<end;index+=2)
+		pt[index] = pte;
+}
+
+//drop the pages mapped by the page table of a region of order, then free
+//it; return how many 4KB pages were mapped
+unsigned int pt_release(pte_t *pt, unsigned int order)
+{
+	unsigned int i, n = 0;
+	unsigned int step = order ? 2 << order : 1;
+
+	for(i=0;i<PTRS_PER_PTE;i+=step)
+	{
+		if(pte_valid(pt[i]))
+		{
+			put_user_page(pt[i]);
+			n += 1 << order;
+		}
+		//the odd page of each TLB entry
+		if(order&&pte_valid(pt[i+1]))
+		{
+			put_user_page(pt[i+1]);
+			n += 1 << order;
+		}
+	}
+	kfree((void*)pt);
+	return n;
+}
+
+//copy a user page a word at a time
+void copy_user_page(void *to, void *from)
+{
+	unsigned int *dst = to;
+	unsigned int *src = from;
+	int i;
+	for(i=0;i<PAGE_SIZE/sizeof(unsigned int);i++)
+		dst[i] = src[i];
+}
+
+//drop one mapping of the page pte maps, freeing it with the last one
+void put_user_page(pte_t pte)
+{
+	if(put_ref(pte_page(pte)))
+		kfree((void*)(pte_pa(pte) + VM_CHANGE2PHY));
+}
+
+//map the physics addr pa to the vitural addr va, pgd is the page table
+//attr is the EntryLo flags the page have (_PAGE_VALID, _PAGE_DIRTY...)
+int do_one_mapping(pgd_t *pgd, unsigned int va, unsigned int pa, unsigned int attr)
+{
+	pte_t *pte;
+
+	pte = pte_alloc(pgd, va);
+	if(pte==0)
+		return 1;
+#ifdef VMA_AREA_DEBUG
+	kernel_printf("MAP VA:%x  PA:%x pde_index:%x\n", va, pa, pgd_index(va));
+#endif
+	*pte = mk_pte(pa, attr);
+	return 0;
+}
+
+//map to the phy page
+int do_mapping(pgd_t *pgd, unsigned int va, unsigned int npage, unsigned int pa, unsigned int attr)
+{
+	int res;
+	int i = 0;
+	while(i<npage)
+	{
+		res = do_one_mapping(pgd, va ,pa,attr);
+		if(res)
+			return 1;
+
+		va = va + PAGE_SIZE;
+		pa = pa + PAGE_SIZE;
+		i++;
+	}
+	return 0;
+}
@@ -1,11 +1,12 @@
 .globl  set_tlb_asid
+.globl  tlb_update
+.globl  flush_tlb_all
 
 .set noreorder
 .set noat
 .align 2
 
 set_tlb_asid:
-    mtc0    $zero, $5   #PageMask
     mfc0    $t0, $10    #entry_hi
    # lui     $t1, 0xffff
    # ori     $t1, $t1, 0xe000
@@ -16,5 +17,69 @@ set_tlb_asid:
     nop
     nop
     jr      $ra
+    nop
 
+# tlb_update(va, entry_lo0, entry_lo1, page_mask): load the pte pair of va
+# for the current ASID, replacing the entry that already maps it if any.
+# Interrupts must be off (or EXL set).
+tlb_update:
+    mfc0    $t0, $10    #entry_hi
+    andi    $t1, $t0, 0xff
+    li      $t2, 0xffffe000
+    nor     $t3, $a3, $zero
+    and     $t2, $t2, $t3   #VPN2 of the pair of large pages
+    and     $a0, $a0, $t2
+    or      $a0, $a0, $t1
+    mtc0    $a0, $10
+    nop
+    nop
+    tlbp
+    nop
+    nop
+    mfc0    $t1, $0     #index, bit 31 set when nothing matched
+    mtc0    $a1, $2
+    mtc0    $a2, $3
+    mtc0    $a3, $5     #PageMask
+    nop
+    bltz    $t1, tlb_update_random
+    nop
+    tlbwi
+    b       tlb_update_done
+    nop
+tlb_update_random:
+    tlbwr
+tlb_update_done:
+    nop
+    nop
+    mtc0    $t0, $10
+    nop
+    nop
+    jr      $ra
+    nop
 
+# flush_tlb_all(): point every entry at a distinct kseg0 page, which is
+# never translated, like init_pgtable(). Interrupts must be off.
+flush_tlb_all:
+    mfc0    $t0, $10
+    mtc0    $zero, $2
+    mtc0    $zero, $3
+    mtc0    $zero, $5
+    lui     $t1, 0x8000
+    li      $t2, 0x2000
+    move    $t3, $zero
+    li      $t4, 32
+flush_tlb_all_loop:
+    mtc0    $t3, $0
+    mtc0    $t1, $10
+    addu    $t1, $t1, $t2
+    nop
+    nop
+    tlbwi
+    addiu   $t3, $t3, 1
+    bne     $t3, $t4, flush_tlb_all_loop
+    nop
+    mtc0    $t0, $10
+    nop
+    nop
+    jr      $ra
+    nop
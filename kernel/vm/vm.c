@@ -4,6 +4,90 @@
 #include <zjunix/pc.h>
 #include <driver/vga.h>
 #include <arch.h>
+#include <intr.h>
+
+//last context handed out; its generation is the current one
+static unsigned int asid_cache = ASID_FIRST_VERSION;
+//mm whose ASID is in EntryHi; kernel threads leave it there
+static struct mm_struct* asid_mm;
+
+//TLB statistics, shown by the tlbstat shell command
+unsigned int tlb_refills;	//TLB misses, counted by the refill handler
+unsigned int tlb_faults;	//of those and Mod exceptions, the ones reaching do_page_fault()
+unsigned int tlb_flushes;	//full flushes on ASID generation rollover
+unsigned int mm_switches;	//switch_mm() onto a user address space
+unsigned int asid_switches;	//of those, the ones that wrote EntryHi
+
+//give mm the next ASID; once all 256 of a generation are used, start a new
+//generation and flush the TLB, which makes every older context stale
+//called with interrupts off
+static void get_new_mmu_context(struct mm_struct* mm)
+{
+	unsigned int asid = asid_cache + 1;
+
+	if(!(asid & ASID_MASK))
+	{
+		flush_tlb_all();
+		tlb_flushes++;
+		if(!asid)
+			asid = ASID_FIRST_VERSION;
+	}
+	mm->context = asid_cache = asid;
+}
+
+//make mm (0 for kernel threads) the address space walked by TLB refill
+//entries of different address spaces coexist in the TLB under their own
+//ASIDs, so the switch itself flushes nothing
+//called with interrupts off
+void switch_mm(struct mm_struct* mm)
+{
+	if(!mm)
+	{
+		pgd_current = swapper_pg_dir;
+		return;
+	}
+	pgd_current = mm->pgd;
+	mm_switches++;
+	if((mm->context ^ asid_cache) & ASID_VERSION_MASK)
+		get_new_mmu_context(mm);
+	else if(mm==asid_mm)
+		return;
+	set_tlb_asid(mm->context & ASID_MASK);
+	asid_mm = mm;
+	asid_switches++;
+}
+
+//drop every TLB entry of mm by retiring its ASID; mm gets a fresh one now
+//if it is the one in EntryHi, otherwise on its next switch_mm()
+//called with interrupts off
+void flush_tlb_mm(struct mm_struct* mm)
+{
+	if(mm==asid_mm)
+	{
+		get_new_mmu_context(mm);
+		set_tlb_asid(mm->context & ASID_MASK);
+	}
+	else
+		mm->context = 0;
+}
+
+void print_tlb_stat()
+{
+	unsigned int n = mm_switches;
+
+	kernel_printf("switches %d (asid %d), flushes %d, generation %d\n", n, asid_switches, tlb_flushes,
+				  asid_cache >> 8);
+	kernel_printf("misses %d, faults %d\n", tlb_refills, tlb_faults);
+	if(n)
+		kernel_printf("per switch: %d.%d%d misses, %d.%d%d faults, %d flushes per 1000\n", tlb_refills / n,
+					  tlb_refills * 10 / n % 10, tlb_refills * 100 / n % 10, tlb_faults / n, tlb_faults * 10 / n % 10,
+					  tlb_faults * 100 / n % 10, tlb_flushes * 1000 / n);
+}
+
+void reset_tlb_stat()
+{
+	tlb_refills = tlb_faults = tlb_flushes = mm_switches = asid_switches = 0;
+}
 
 struct mm_struct* mm_create()
 {
@@ -15,10 +99,11 @@ struct mm_struct* mm_create()
 	if(mm)
 	{
 		kernel_memset(mm , 0 , sizeof(*mm));
+		mm->free_area_cache = TASK_UNMAPPED_BASE;
 		mm->pgd = kmalloc(PAGE_SIZE);
 		if(mm->pgd)
 		{
-			kernel_memset(mm->pgd,0,PAGE_SIZE);
+			pgd_init(mm->pgd);
 			return mm;
 		}
 #ifdef VMA_AREA_DEBUG
@@ -26,120 +111,315 @@ struct mm_struct* mm_create()
 #endif
 		kfree(mm);
 	}
+	return 0;
+}
+
+//link vma into mm after prev (0: at the head of the list)
+static void vma_link(struct mm_struct* mm, struct vm_area_struct* vma, struct vm_area_struct* prev)
+{
+	struct vm_area_struct* next = prev ? prev->vm_next : mm->mmap;
+
+	vma->vm_prev = prev;
+	vma->vm_next = next;
+	if(prev)
+		prev->vm_next = vma;
+	else
+		mm->mmap = vma;
+	if(next)
+		next->vm_prev = vma;
+	avl_insert(vma, &mm->mmap_avl);
+	mm->map_count++;
+}
+
+static void vma_unlink(struct mm_struct* mm, struct vm_area_struct* vma)
+{
+	if(vma->vm_prev)
+		vma->vm_prev->vm_next = vma->vm_next;
+	else
+		mm->mmap = vma->vm_next;
+	if(vma->vm_next)
+		vma->vm_next->vm_prev = vma->vm_prev;
+	avl_remove(vma, &mm->mmap_avl);
+	if(mm->mmap_cache==vma)
+		mm->mmap_cache = 0;
+	mm->map_count--;
+}
+
+static void free_vma(struct vm_area_struct* vma)
+{
+	put_vm_file(vma->vm_file);
+	kfree(vma);
+}
+
+//copy_page_range() for a VM_HUGEPAGE vma, which covers whole 4MB regions
+static int copy_huge_range(struct mm_struct* mm, struct mm_struct* oldmm, struct vm_area_struct* vma, int copy)
+{
+	unsigned int order = vma->vm_page_order;
+	unsigned long addr;
+	pte_t *src, *dst;
+	pte_t pte;
+	unsigned int i, j, k;
+	void* page;
+
+	for(addr=vma->vm_start;addr<vma->vm_end;addr+=1<<PGD_SHIFT)
+	{
+		src = pgd_table(oldmm->pgd[pgd_index(addr)]);
+		if(src==invalid_pte_table)
+			continue;
+		dst = hpte_alloc(mm->pgd, addr, order);
+		if(!dst)
+			return 1;
+		//the even and odd page of each TLB entry
+		for(i=0;i<PTRS_PER_PTE;i+=2<<order)
+		{
+			for(j=i;j<i+2;j++)
+			{
+				pte = src[j];
+				if(!pte_valid(pte))
+					continue;
+				if(copy)
+				{
+					page = kmalloc(PAGE_SIZE << order);
+					if(!page)
+						return 1;
+					for(k=0;k<1<<order;k++)
+						copy_user_page((char*)page + k * PAGE_SIZE, (void*)(pte_pa(pte) + VM_CHANGE2PHY + k * PAGE_SIZE));
+					pte = mk_pte((unsigned int)page - VM_CHANGE2PHY, pte & ((1 << PTE_PFN_SHIFT) - 1));
+					set_ref(pte_page(pte), 1);
+				}
+				else
+				{
+					if(!(vma->vm_flags & VM_SHARED))
+					{
+						pte &= ~_PAGE_DIRTY;
+						set_hpte(src, j, order, pte);
+					}
+					inc_ref(pte_page(pte), 1);
+				}
+				set_hpte(dst, j, order, pte);
+				mm->rss += 1 << order;
+			}
+		}
+	}
+	return 0;
+}
+
+//give mm the pages oldmm maps in vma
+//copy: copy every page now; otherwise share them, write-protected in both
+//address spaces unless the vma is VM_SHARED
+//file pages are always shared, they belong to the page cache
+static int copy_page_range(struct mm_struct* mm, struct mm_struct* oldmm, struct vm_area_struct* vma, int copy)
+{
+	unsigned long addr;
+	pte_t *src, *dst;
+	void* page;
+
+	if(vma->vm_flags & VM_HUGEPAGE)
+		return copy_huge_range(mm, oldmm, vma, copy);
+	if(vma->vm_file)
+		copy = 0;
+	for(addr=vma->vm_start;addr<vma->vm_end;addr+=PAGE_SIZE)
+	{
+		src = pte_lookup(oldmm->pgd, addr);
+		if(!src)
+		{
+			//no page table: skip the rest of this 4MB region
+			addr = (addr & PGD_MASK) + (1 << PGD_SHIFT) - PAGE_SIZE;
+			continue;
+		}
+		if(!pte_valid(*src))
+			continue;
+		dst = pte_alloc(mm->pgd, addr);
+		if(!dst)
+			return 1;
+		if(copy)
+		{
+			page = kmalloc(PAGE_SIZE);
+			if(!page)
+				return 1;
+			copy_user_page(page, (void*)(pte_pa(*src) + VM_CHANGE2PHY));
+			*dst = mk_pte((unsigned int)page - VM_CHANGE2PHY, *src & ((1 << PTE_PFN_SHIFT) - 1));
+			set_ref(pte_page(*dst), 1);
+		}
+		else
+		{
+			if(!(vma->vm_flags & VM_SHARED))
+				*src &= ~_PAGE_DIRTY;
+			*dst = *src;
+			inc_ref(pte_page(*src), 1);
+		}
+		mm->rss++;
+	}
+	return 0;
+}
+
+//duplicate oldmm for a new task
+//the pages are shared and copied on the first write to them (do_page_fault());
+//copy: copy every page at once instead
+struct mm_struct* dup_mm(struct mm_struct* oldmm, int copy)
+{
+	struct mm_struct* mm;
+	struct vm_area_struct *vma, *new, *prev;
+	int old_ie, shared = !copy;
+
+	mm = mm_create();
+	if(!mm)
+		return 0;
+	mm->start_code = oldmm->start_code;
+	mm->end_code = oldmm->end_code;
+	mm->start_data = oldmm->start_data;
+	mm->end_data = oldmm->end_data;
+	mm->start_brk = oldmm->start_brk;
+	mm->brk = oldmm->brk;
+	mm->start_stack = oldmm->start_stack;
+	mm->tatal_vm = oldmm->tatal_vm;
+	mm->locked_vm = oldmm->locked_vm;
+	mm->shared_vm = oldmm->shared_vm;
+	mm->exec_vm = oldmm->exec_vm;
+	mm->free_area_cache = oldmm->free_area_cache;
+
+	prev = NULL;
+	for(vma=oldmm->mmap;vma;vma=vma->vm_next)
+	{
+		new = kmalloc(sizeof(struct vm_area_struct));
+		if(!new)
+			goto fail;
+		kernel_memcpy(new, vma, sizeof(struct vm_area_struct));
+		new->vm_mm = mm;
+		get_vm_file(new->vm_file);
+		vma_link(mm, new, prev);
+		prev = new;
+		if(vma->vm_file)
+			shared = 1;
+		if(copy_page_range(mm, oldmm, vma, copy))
+			goto fail;
+	}
+	//the parent's TLB entries may still allow writes to the shared pages
+	if(shared)
+	{
+		old_ie = disable_interrupts();
+		flush_tlb_mm(oldmm);
+		if(old_ie)
+			enable_interrupts();
+	}
+	return mm;
+
+fail:
+	mm_delete(mm);
+	return 0;
 }
 
 void mm_delete(struct mm_struct* mm)
 {
+	int old_ie;
 #ifdef VMA_AREA_DEBUG
-	kernel_printf("mm_delete:pgd%x\n",mm->pdg);
+	kernel_printf("mm_delete:pgd%x\n",mm->pgd);
 #endif
+	//the TLB may still map the freed pages under mm's ASID; no other mm
+	//gets that ASID before the rollover flush, so only forget it is loaded
+	old_ie = disable_interrupts();
+	if(asid_mm==mm)
+		asid_mm = 0;
+	if(old_ie)
+		enable_interrupts();
+
+	//stores through shared file mappings were written back by
+	//filemap_sync_mm() before the owner terminated
 	pgd_delete(mm->pgd);
 	exit_map(mm);
+#ifdef VMA_AREA_DEBUG
 	kernel_printf("exit_map finished!\n");
-
+#endif
 	kfree(mm);	
 }
 
 void pgd_delete(pgd_t* pgd)
 {
-	int i, j;
-	unsigned int pde;// page directory item
-	unsigned int pte;//page table item
-	unsigned int* pde_ptr;
-	i = 0;
+	int i;
+	pte_t* pt;//page table
+#ifdef VMA_AREA_DEBUG
 	kernel_printf("enter pgd_delete\n");
-	while(i<1024)
+#endif
+	for(i=0;i<PTRS_PER_PGD;i++)
 	{
-		pde = pgd[i];
-		pde = pde&PAGE_MASK;
-		if(pde==0)//not exist in 2 level page table
+		pt = pgd_table(pgd[i]);
+		if(pt==invalid_pte_table)//not exist in 2 level page table
 			continue;
-
-		kernel_printf("delete pde:%x\n", pde);
-
-		pde_ptr = (unsigned int*)pde;
-			for(j=0;j<1024;j++)
-			{
-				pte = pde_ptr[j];
-				pte = pte&PAGE_MASK;//页目录中的每一项的内容（每项8个字节，64位）低12位之后的M-12位用来放一个页表（页表 放在一个物理页中）的物理地址，低12bit放着一些标志。
-
-				if(pte!=0){
 #ifdef VMA_AREA_DEBUG
-				kernel_printf("delete pte:%x\n", pte);
-#endif			
-				kfree((void*)pte);
-			}
-		}
-		kfree((void*)pde_ptr);	
-		i++;	
+		kernel_printf("delete pde:%x\n", pgd[i]);
+#endif
+		pt_release(pt, pgd_order(pgd[i]));
 	}
 	kfree(pgd);
+#ifdef VMA_AREA_DEBUG
 	kernel_printf("pgd_delete success\n");
+#endif
 	return;
 }
 
-struct vm_area_struct *vma_merge(struct mm_struct *mm,struct vm_area_struct *prev, unsigned long addr,unsigned long end, unsigned long vm_flags)
+//split vma at addr inside it; a new vma takes over [addr, vm_end)
+static int split_vma(struct mm_struct* mm, struct vm_area_struct* vma, unsigned long addr)
+{
+	struct vm_area_struct* new;
+
+	new = kmalloc(sizeof(struct vm_area_struct));
+	if(!new)
+		return 1;
+	kernel_memcpy(new, vma, sizeof(struct vm_area_struct));
+	new->vm_start = addr;
+	new->vm_pgoff += (addr - vma->vm_start) >> PAGE_SHIFT;
+	get_vm_file(new->vm_file);
+	//the order by vm_start is unchanged, so the tree stays valid
+	vma->vm_end = addr;
+	vma_link(mm, new, vma);
+	return 0;
+}
+
+//map [addr, end) by extending prev (the vma before addr, 0 if none), the
+//vma after it, or both into one, when they are adjacent, have vm_flags
+//and continue file (0: anonymous memory) at vm_pgoff pgoff
+//the range must be unmapped; returns the vma now covering it, or NULL if
+//a new vma is needed
+struct vm_area_struct *vma_merge(struct mm_struct *mm,struct vm_area_struct *prev, unsigned long addr,unsigned long end, unsigned long vm_flags, struct vm_file *file, unsigned long pgoff)
 {
-	struct vm_area_struct *area, *next;
+	struct vm_area_struct *next;
  	unsigned long pglen = (end-addr)>>PAGE_SHIFT;
-	/*
-	 * We later require that vma->vm_flags == vm_flags,
-	 * so this tests vma->vm_flags & VM_SPECIAL, too.
-	 */
-	if (vm_flags & VM_NONE)
-		return NULL;
- 
-	if (prev)//指定了先驱vma，则获取先驱vma的后驱vma
-		next = prev->vm_next;
-	else     //否则指定mm的vma链表中的第一个元素为后驱vma
-		next = mm->mmap;
-	area = next;
- 
-	/*后驱节点存在，并且后驱vma的结束地址和给定区域的结束地址相同，
-	  也就是说两者有重叠，那么调整后驱vma*/
-	if (next && next->vm_end == end)		/* cases 6, 7, 8 */
-		next = next->vm_next;
- 
-	/*
-	 * 先判断给定的区域能否和前驱vma进行合并，需要判断如下的几个方面:
-	   1.前驱vma必须存在
-	   2.前驱vma的结束地址正好等于给定区域的起始地址
-	   3.两者的struct mempolicy中的相关属性要相同，这项检查只对NUMA架构有意义
-	   4.其他相关项必须匹配，包括两者的vm_flags，是否映射同一个文件等等
-	 */
-	if (prev && prev->vm_end == addr ) {
-		/*
-		 *确定可以和前驱vma合并后再判断是否能和后驱vma合并，判断方式和前面一样，
-		  不过这里多了一项检查，在给定区域能和前驱、后驱vma合并的情况下还要检查
-		  前驱、后驱vma的匿名映射可以合并
-		 */
-		
-		//vma_adjust(prev, prev->vm_start,next->end, prev->vm_pgoff, NULL);
+
+	next = prev ? prev->vm_next : mm->mmap;
+	if(prev && !(prev->vm_end==addr && prev->vm_flags==vm_flags && prev->vm_file==file &&
+				 prev->vm_pgoff+((prev->vm_end-prev->vm_start)>>PAGE_SHIFT)==pgoff))
+		prev = NULL;
+	if(next && !(next->vm_start==end && next->vm_flags==vm_flags && next->vm_file==file &&
+				 next->vm_pgoff==pgoff+pglen))
+		next = NULL;
+
+	if(prev)
+	{
+		if(next)	//the range fills the hole between them
+		{
+			prev->vm_end = next->vm_end;
+			vma_unlink(mm, next);
+			free_vma(next);
+		}
+		else
+			prev->vm_end = end;
 		return prev;
 	}
- 
-	/*
-	 * Can this new request be merged in front of next?
-	 */
-	 /*如果前面的步骤失败，那么则从后驱vma开始进行和上面类似的步骤*/
-	//if (next && end == next->vm_start ) {
-	//	if (prev && addr < prev->vm_end)	/* case 4 */
-			//vma_adjust(prev, prev->vm_start,addr, prev->vm_pgoff, NULL);
-	//	else					/* cases 3, 8 */
-			//vma_adjust(area, addr, next->vm_end, next->vm_pgoff - pglen, NULL);
-		return area;
-	
- 
+	if(next)
+	{
+		//still after prev, so the tree order holds
+		next->vm_start = addr;
+		next->vm_pgoff = pgoff;
+		return next;
+	}
 	return NULL;
 }
 
-
-
-
  /* Look up the first VMA which satisfies  addr<vm_end,  NULL if none. */
 struct vm_area_struct* find_vma(struct mm_struct* mm, unsigned long addr)
 {
 	struct vm_area_struct *vma = NULL;
+	struct vm_area_struct *tree;
 	if(mm)
 	{	
 		/* Check the cache first. */
@@ -147,33 +427,18 @@ struct vm_area_struct* find_vma(struct mm_struct* mm, unsigned long addr)
  		vma = mm->mmap_cache;
  		if(!(vma && vma->vm_end > addr && vma->vm_start <= addr))
  		{
- 			if(!mm->mmap_avl)//goto the innear list
- 			{
- 				vma = mm->mmap;
- 				while(vma&&vma->vm_end<=addr)
- 				{
- 					vma = vma->vm_next;
- 				}
- 			}
- 			else//goto the AVL tree
- 			{
- 				struct vm_area_struct *tree  = mm->mmap_avl;
- 				vma = NULL;
- 				for(;;)
- 				{
- 					if(tree==VM_AVL_EMPTY)
- 						break;
- 					if(tree->vm_end>addr){
- 						vma = tree;
- 						if(tree->vm_start<=addr)
- 							break;
- 						tree = tree->vm_avl_left;
- 					}
- 					else 
- 						tree = tree->vm_avl_right;
- 				}
-
- 			}
+			vma = NULL;
+			for(tree=mm->mmap_avl;tree!=VM_AVL_EMPTY;)
+			{
+				if(tree->vm_end>addr){
+					vma = tree;
+					if(tree->vm_start<=addr)
+						break;
+					tree = tree->vm_avl_left;
+				}
+				else 
+					tree = tree->vm_avl_right;
+			}
  			if(vma)
  				mm->mmap_cache = vma;
  		}
@@ -191,168 +456,191 @@ struct vm_area_struct *find_vma_intersection(struct mm_struct* mm, unsigned long
 }
 
 
-// Get unmapped area starting after addr        
+// Like find_vma(), also returning the vma before it (the last one if none)
 struct vm_area_struct *find_vma_and_prev(struct mm_struct* mm, unsigned long addr, struct vm_area_struct** prev)
 {
-	struct vm_area_struct *vma = NULL;
+	struct vm_area_struct *vma, *tree;
 	*prev = 0;
-	if(mm)
+	vma = find_vma(mm, addr);
+	if(vma)
+		*prev = vma->vm_prev;
+	else if(mm)
 	{
-		vma = mm->mmap;
-		while(vma)
-		{
-			if(vma->vm_end>addr){
-				mm->mmap_cache = vma;
-				break;
-			}
-			*prev = vma;
-			vma = vma->vm_next;
-		}
+		for(tree=mm->mmap_avl;tree!=VM_AVL_EMPTY;tree=tree->vm_avl_right)
+			*prev = tree;
 	}
 	return vma;
 }
 
-unsigned long get_unmapped_area(unsigned long addr, unsigned long len,unsigned long flags)
+//first gap of len bytes at or above addr starting on a multiple of align,
+//-1 if it would reach the kernel
+static unsigned long search_unmapped_area(struct mm_struct* mm, unsigned long addr, unsigned long len, unsigned long align)
 {
 	struct vm_area_struct* vma;
+
+	addr = Allign(addr, align);
+	for(vma=find_vma(mm,addr);;vma=vma->vm_next)
+	{
+		if(addr>KERNEL_ENTRY-len)
+			return -1;
+		if(!vma||addr+len<=vma->vm_start)
+			return addr;
+		addr = Allign(vma->vm_end, align);
+	}
+}
+
+//place a mapping of len bytes at addr, or the first gap above it
+//without addr the search starts at mm->free_area_cache, the end of the last
+//such mapping, so repeated anonymous mmaps do not rescan the address space
+//VM_HUGEPAGE mappings start on a 4MB region
+unsigned long get_unmapped_area(unsigned long addr, unsigned long len,unsigned long flags)
+{
 	struct mm_struct* mm = current_task->mm; //global variable
+	unsigned long align = flags & VM_HUGEPAGE ? 1 << PGD_SHIFT : PAGE_SIZE;
 
-	addr = Allign(addr, PAGE_SIZE);
-	if(addr+len>KERNEL_ENTRY)
+	len = Allign(len, PAGE_SIZE);
+	if(!len||len>KERNEL_ENTRY||addr>=KERNEL_ENTRY)
 		return -1;
-	/*
-     * 以下分别判断：
-     * 1: 请求分配的长度是否小于进程虚拟地址空间大小
-     * 2: 新分配的虚拟地址空间的起始地址是否在mmap_min_addr(允许分配虚拟地址空间的最低地址)之上
-     * 3: vma是否空
-     * 4: vma非空，新分配的虚拟地址空间，是否与相邻的vma重合
-     */
-    if(addr)
-    {
-		if(addr&&addr+len<=KERNEL_ENTRY)
-		{		
-			vma = find_vma(mm,addr);
-			for(;;vma = vma->vm_next)
-			{
-				if(addr+len>KERNEL_ENTRY)
-					return -1;
-				if(!vma||addr+len<=vma->vm_start)
-					return addr;
-			}
-			addr = vma->vm_end;
-		}
-	}
-	return 0;
+	if(addr)
+		return search_unmapped_area(mm, addr, len, align);
+
+	addr = search_unmapped_area(mm, mm->free_area_cache, len, align);
+	if(addr==(unsigned long)-1&&mm->free_area_cache!=TASK_UNMAPPED_BASE)
+		addr = search_unmapped_area(mm, TASK_UNMAPPED_BASE, len, align);
+	if(addr!=(unsigned long)-1)
+		mm->free_area_cache = addr + len;
+	return addr;
 }
 
 void insert_vma_struct(struct mm_struct* mm, struct vm_area_struct* area)
 {	
-	//find the vma preceding addr
-	struct vm_area_struct* vma = mm->mmap;
-	struct vm_area_struct* prev = 0;
-	while(vma)
-	{
-		if(area->vm_start<vma->vm_start)
-			break;
-		prev = vma;
-		vma = vma->vm_next;
-	}
-	vma = prev;
-#ifdef VMA_AREA_DEBUG
-	kernel_printf("Insert: %x	%x\n", vma, area->vm_start);
-#endif
-	if(!vma)
-	{
+	struct vm_area_struct* prev;
+
+	find_vma_and_prev(mm, area->vm_start, &prev);
 #ifdef VMA_AREA_DEBUG
-		kernel_printf("mmap init.\n");
+	kernel_printf("Insert: %x	%x\n", prev, area->vm_start);
 #endif
-		mm->mmap = area;
-		area->vm_next = 0;
-	}
-	else{
-		area->vm_next = vma->vm_next;
-		vma->vm_next = area;
-	}
-	mm->map_count++;
+	vma_link(mm, area, prev);
+}
+
+//TLB page order of a VM_HUGEPAGE mapping of len bytes: the largest page
+//size the PageMask supports (4^n pages) that is no larger than len
+static unsigned long huge_page_order(unsigned long len)
+{
+	unsigned long order = HPAGE_MAX_ORDER;
+	while(order>2&&(PAGE_SIZE<<order)>len)
+		order -= 2;
+	return order;
 }
 
-//map
+//map anonymous memory
 unsigned long do_mmap(unsigned long addr, unsigned long len, unsigned long flags)
+{
+	return do_mmap_pgoff(0, addr, len, flags, 0);
+}
+
+//map file (0: anonymous memory) from its page pgoff
+//VM_HUGEPAGE: map with large TLB pages; the vma is rounded out to whole
+//4MB regions, since the page size is set per region (see page.h)
+unsigned long do_mmap_pgoff(struct vm_file* file, unsigned long addr, unsigned long len, unsigned long flags, unsigned long pgoff)
 {
 	struct mm_struct* mm = current_task->mm;
 	struct vm_area_struct* vma, *prev;
+	unsigned long end, order = 0;
 	if(!len)
 		return addr;
+	//file pages are the page cache's 4KB clusters
+	if(file)
+		flags &= ~VM_HUGEPAGE;
+	if(flags & VM_HUGEPAGE)
+	{
+		order = huge_page_order(len);
+		len = Allign(len, 1 << PGD_SHIFT);
+		if(!len)
+			return -1;
+	}
 	addr = get_unmapped_area(addr, len, flags);
+	if(addr==(unsigned long)-1)
+		return -1;
+	end = Allign(addr+len, PAGE_SIZE);
+	find_vma_and_prev(mm, addr, &prev);
+	//anonymous memory counts vm_pgoff from address 0, so any two adjacent
+	//vmas with the same flags continue each other
+	if(!file)
+		pgoff = addr>>PAGE_SHIFT;
+	if(!(flags & VM_HUGEPAGE)&&vma_merge(mm, prev, addr, end, flags, file, pgoff))
+		return addr;
 	vma = kmalloc(sizeof(struct vm_area_struct));
 	if(!vma)
 		return -1;
+	kernel_memset(vma, 0, sizeof(struct vm_area_struct));
 	vma->vm_mm = mm;
 	vma->vm_start = addr;
-	vma->vm_end = Allign(addr+len, PAGE_SIZE);
+	vma->vm_end = end;
+	vma->vm_flags = flags;//pages are faulted in on first access with these protections
+	vma->vm_pgoff = pgoff;
+	vma->vm_file = get_vm_file(file);
+	vma->vm_page_order = order;
 #ifdef VMA_AREA_DEBUG
 	kernel_printf("MAP: %x	%x\n", vma->vm_start, vma->vm_end);
 #endif
-	insert_vma_struct(mm,vma);
+	vma_link(mm, vma, prev);
 	return addr;
 }
 
+//unmap [addr, addr+len); vmas reaching outside the range are split first
+//stores through shared file mappings are written back to the file
 int do_unmap(unsigned long addr, unsigned long len)
 {
 	unsigned long end;
 	struct mm_struct* mm = current_task->mm;
-	struct vm_area_struct *vma, *prev;
-	if(addr>KERNEL_ENTRY||len+addr>KERNEL_ENTRY)//if the addr is bigger than kernal_entry, or the length is 0
+	struct vm_area_struct *vma, *next;
+	len = Allign(len, PAGE_SIZE);
+	if(addr&~PAGE_MASK||addr>KERNEL_ENTRY||len>KERNEL_ENTRY-addr)
 		return -1;
-	//find the first overlapping VMA
-	vma = find_vma_and_prev(mm,addr, &prev);
-	if(!vma)
-		return 0;
 	end  = addr + len;
-	if(vma->vm_start>=end)
+	//find the first overlapping VMA
+	vma = find_vma(mm,addr);
+	if(!vma||vma->vm_start>=end)
 		return 0;
 #ifdef VMA_AREA_DEBUG
 	kernel_printf("do_unmap: %x	%x\n", addr, vma->vm_start);
 #endif
-//match the length
-	if(vma->vm_end>=end)
+	//large-page vmas are only split on 4MB regions
+	next = find_vma(mm, end-1);
+	if(vma->vm_start<addr&&(vma->vm_flags & VM_HUGEPAGE)&&(addr & ~PGD_MASK))
+		return -1;
+	if(next&&next->vm_start<end&&next->vm_end>end&&(next->vm_flags & VM_HUGEPAGE)&&(end & ~PGD_MASK))
+		return -1;
+	if(vma->vm_start<addr)
 	{
-#ifdef	VMA_AREA_DEBUG
-		kernel_printf("length match.\n");
-#endif
-		if(!prev)
-		{
-			mm->mmap = vma->vm_next;//if prev ==NLLL, mm->mmap get the fisrt address
-		}
-		else
-		{
-			prev->vm_next = vma->vm_next;
-		}
-		kfree(vma);
-		mm->map_count--;
-#ifdef	VMA_AREA_DEBUG
-		kernel_printf("unmapped finished! %d vmas left\n", mm->map_count);
-#endif
-		return 0;
+		if(split_vma(mm, vma, addr))
+			return 1;
+		vma = vma->vm_next;
 	}
-//the length doesn't match
+	next = find_vma(mm, end-1);
+	if(next&&next->vm_start<end&&next->vm_end>end)
+	{
+		if(split_vma(mm, next, end))
+			return 1;
+	}
+
+	while(vma&&vma->vm_start<end)
+	{
+		next = vma->vm_next;
+		if(vma->vm_file&&(vma->vm_flags & VM_SHARED))
+			filemap_sync(mm, vma, vma->vm_start, vma->vm_end);
+		vma_unlink(mm, vma);
+		free_vma(vma);
+		vma = next;
+	}
+	zap_page_range(mm, addr, end);
+	if(addr<mm->free_area_cache)
+		mm->free_area_cache = addr>TASK_UNMAPPED_BASE ? addr : TASK_UNMAPPED_BASE;
 #ifdef	VMA_AREA_DEBUG
-		kernel_printf("length mismatch!\n");
+	kernel_printf("unmapped finished! %d vmas left\n", mm->map_count);
 #endif
-		return 1;
-		if(mm->locked_vm)
-		{
-			struct vm_area_struct *tmp = vma;
-			while(tmp&&tmp->vm_start<end)
-			{
-				//if(tmp->vm_flags&VM_LOCKED)
-				//{
-				//	mm->locked_vm -=vma_pages(tmp);
-				//	munlock_vma_pages_all(tmp);
-				//}
-				tmp = tmp->vm_next;
-			}
-		}
+	return 0;
 }
 
 //free the VMAs
@@ -361,10 +649,11 @@ void exit_map(struct mm_struct* mm)
 	struct vm_area_struct * vmap = mm->mmap;
 	mm->mmap_cache = 0;
 	mm->mmap = mm->mmap_cache;
+	mm->mmap_avl = VM_AVL_EMPTY;
 	while(vmap)
 	{
 		struct vm_area_struct *next = vmap->vm_next;
-		kfree(vmap);
+		free_vma(vmap);
 		mm->map_count--;
 		vmap = next;
 	}
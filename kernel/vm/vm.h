@@ -10,6 +10,11 @@ struct vm_area_struct* find_vma_and_prev(struct mm_struct* mm, unsigned long add
 void insert_vma_struct(struct mm_struct* mm, struct vm_area_struct* area);
 void exit_map(struct mm_struct* mm);
 void pgd_delete(pgd_t* pgd);
+void avl_insert(struct vm_area_struct* vma, struct vm_area_struct** ptree);
+void avl_remove(struct vm_area_struct* vma, struct vm_area_struct** ptree);
+extern unsigned int tlb_faults;
+void* filemap_page(struct vm_file* file, unsigned long index);
+int filemap_sync(struct mm_struct* mm, struct vm_area_struct* vma, unsigned long start, unsigned long end);
 
 
 
@@ -0,0 +1,765 @@
+/*
+ * Host-side scheduler simulator.
+ *
+ * Links the real kernel/pc sources (pc.c, pid.c, fair.c, rt.c, ...) against the stubs in
+ * stubs.c and drives them with synthetic workloads on a simulated CP0 cycle
+ * counter: timer ticks call pc_schedule(), tasks that finish a burst call
+ * sleep_on() or task_exit(), and I/O completions call wakeup_task() from
+ * "interrupt context", followed by pc_resched() when a real-time task was
+ * woken, as on interrupt return. SCHED_DEADLINE tasks call wait_next_period()
+ * instead and are released by the kernel on the tick. Task bodies never run; the simulator only tracks which
+ * task is current_task and charges it the elapsed cycles. The system
+ * workqueue thread is the exception: when it gets the CPU its pending work
+ * (task reaping) runs immediately and it goes back to sleep. Worker pool
+ * threads run the burst of the job handed to them by run_on_worker(), then
+ * park again. SIM_KSECT tasks model long kernel loops that hold a lock:
+ * preemption is disabled for the whole burst, or for 1ms chunks when the
+ * loop breaks the lock and calls preempt_enable() between iterations.
+ * SIM_YIELD tasks play yield ping-pong: after each short burst they call
+ * sched_yield(), which must hand the CPU to the other one. In the
+ * pi-inversion scenario the real-time I/O tasks and a low-priority
+ * SIM_LOCKER take the same mutex for each burst, so the I/O tasks wait
+ * behind the locker while hogs compete with it.
+ *
+ * usage: schedsim [hogs|mixed|periodic|periodic-edf|churn|churn-pool|dispatch|dispatch-pool|
+ *                  interactive|interactive-rt|ksection|ksection-break|yield-pingpong|pi-inversion|all]
+ *                  [seconds] [seed] [-v]
+ * schedsim is built with the priority-array scheduler, schedsim-fair with
+ * SCHED_FAIR; run both on the same scenario and seed to compare policies.
+ */
+#include <zjunix/pc.h>
+#include <zjunix/fair.h>
+#include <zjunix/time.h>
+#include <zjunix/workqueue.h>
+#include <zjunix/workerpool.h>
+#include <zjunix/preempt.h>
+#include <zjunix/mutex.h>
+#include <zjunix/slab.h>
+
+int printf(const char *format, ...);
+
+extern unsigned long long sim_now;
+extern int sim_verbose;
+int sim_host_init();
+unsigned long long sim_host_ns();
+void sim_sort_u32(unsigned int *buf, int n);
+void *sim_alloc(unsigned int size);
+
+#define SIM_INIT 1          // shell: always runnable, not counted as work
+#define SIM_WORKER 2        // system workqueue thread
+#define SIM_HOG 3           // never blocks
+#define SIM_IO 4            // short burst, then sleeps for a random time
+#define SIM_PERIODIC 5      // released every period, runs one burst per release
+#define SIM_CHURN 6         // created by the spawner, exits after one burst
+#define SIM_POOL 7          // worker pool thread, runs one burst per job
+#define SIM_KSECT 8         // periodic burst with preemption disabled
+#define SIM_YIELD 9         // short burst, then sched_yield()
+#define SIM_LOCKER 10       // low priority, periodic burst holding sim_mutex
+
+#define SIM_FOREVER 0xffffffffffffffffull
+#define MS(x) ((unsigned long long)(x) * (CYCLES_PER_SEC / 1000))
+#define US(x) ((unsigned long long)(x) * (CYCLES_PER_SEC / 1000000))
+#define SIM_MAX_SAMPLES (1 << 20)
+#define SIM_SLOTS 256
+// churn jobs in flight at most: arrivals beyond it are throttled, so a
+// scheduler that falls behind shows up as throttled arrivals and turnaround
+// instead of exhausting SIM_SLOTS
+#define SIM_CHURN_MAX 64
+
+struct sim_task {
+    int kind;                       // 0 for a free slot
+    pid_t pid;
+    task_struct *task;
+    unsigned long long burst;       // cycles per job
+    unsigned long long remain;      // cycles left in the current job
+    unsigned long long sleep_min;   // SIM_IO sleep range
+    unsigned long long sleep_max;
+    unsigned long long period;      // SIM_PERIODIC release period
+    unsigned long long wake_at;     // next wakeup / release, 0 if none
+    unsigned long long stamp;       // when the task became runnable
+    unsigned long long created;
+    int blocked;                    // sleeping on sim_wait
+    int waiting;                    // runnable but not yet run since stamp
+    unsigned long long work;
+    unsigned int jobs;
+    unsigned int misses;
+    struct sim_job *job;            // SIM_POOL: job being run
+    struct pool_worker *worker;     // SIM_POOL: its pool slot
+    int locked;                     // SIM_KSECT: holds preempt_disable()
+    unsigned long long chunk;       // SIM_KSECT: cycles left until preempt_enable()
+    int uses_lock;                  // takes sim_mutex for each burst
+    int holds;                      // owns sim_mutex
+    int lockwait;                   // sleeping in mutex_lock()
+    unsigned long long lock_stamp;  // when it blocked on sim_mutex
+};
+
+// a short job handed to the worker pool instead of a new task
+struct sim_job {
+    int used;
+    unsigned long long burst;
+    unsigned long long created;
+};
+
+struct sim_scenario {
+    const char *name;
+    int hogs;
+    int io;
+    int periodic;
+    unsigned long long spawn_interval;  // SIM_CHURN arrival interval, 0 if none
+    int rt;                             // SIM_IO tasks are SCHED_RR like the shell,
+                                        // SIM_PERIODIC tasks SCHED_DEADLINE
+    int pool;                           // SIM_CHURN jobs go to run_on_worker()
+    int ksect;                          // 1: SIM_KSECT task, 2: same with lock breaking
+    int yielders;                       // SIM_YIELD tasks
+    int lock;                           // SIM_IO tasks share sim_mutex with a SIM_LOCKER
+};
+
+static const struct sim_scenario scenarios[] = {
+    { "hogs", 8, 0, 0, 0, 0 },
+    { "mixed", 4, 4, 0, 0, 0 },
+    { "periodic", 4, 0, 2, 0, 0 },
+    { "periodic-edf", 4, 0, 2, 0, 1 },
+    { "churn", 2, 0, 0, MS(20), 0 },
+    { "churn-pool", 2, 0, 0, MS(20), 0, 1 },
+    // churn on an otherwise idle CPU: per-job cost of task_create / run_on_worker
+    { "dispatch", 0, 0, 0, MS(500), 0 },
+    { "dispatch-pool", 0, 0, 0, MS(500), 0, 1 },
+    { "interactive", 4, 1, 0, 0, 0 },
+    { "interactive-rt", 4, 1, 0, 0, 1 },
+    { "ksection", 2, 1, 0, 0, 1, 0, 1 },
+    { "ksection-break", 2, 1, 0, 0, 1, 0, 2 },
+    { "yield-pingpong", 0, 0, 0, 0, 0, 0, 0, 2 },
+    { "pi-inversion", 2, 2, 0, 0, 1, 0, 0, 0, 1 },
+};
+
+static struct sim_task sims[SIM_SLOTS];
+static struct sim_job sim_jobs[SIM_SLOTS];
+static unsigned long long spawn_ns;     // host time spent in task_create / run_on_worker
+static unsigned long long teardown_ns;  // host time spent in task_exit and reaping / returning to the pool
+static struct sim_task sim_none;     // idle and unknown tasks
+static struct list_head sim_wait;
+static context sim_regs;
+static task_struct *sim_last;
+static unsigned int sim_seed;
+static unsigned int sim_seed0;
+
+static unsigned int *lat;
+static int nlat;
+static unsigned long long tick_ns, tick_ns_max, ticks;
+static unsigned long long block_ns, blocks;
+static unsigned long long idle_cycles, init_cycles, switches;
+static unsigned long long turnaround, reaped_work;
+static unsigned int spawned, spawn_failed, throttled, reaped;
+static unsigned long long dispatch_sum, dispatch_max;
+static unsigned int dispatched;
+static unsigned long long yield_ns, yields, yield_switched;
+static struct mutex sim_mutex;
+static unsigned long long lock_wait_sum, lock_wait_max, lock_waits;
+
+static unsigned int sim_rand() {
+    sim_seed ^= sim_seed << 13;
+    sim_seed ^= sim_seed >> 17;
+    sim_seed ^= sim_seed << 5;
+    return sim_seed;
+}
+
+static unsigned long long sim_rand_range(unsigned long long lo, unsigned long long hi) {
+    return lo + sim_rand() % (unsigned int)(hi - lo + 1);
+}
+
+static int sim_atoi(const char *s) {
+    int v = 0;
+    while (*s >= '0' && *s <= '9')
+        v = v * 10 + *s++ - '0';
+    return v;
+}
+
+static int sim_streq(const char *a, const char *b) {
+    return kernel_strcmp(a, b) == 0;
+}
+
+static struct sim_task *sim_find(pid_t pid) {
+    int i;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        if (sims[i].kind && sims[i].pid == pid)
+            return &sims[i];
+    }
+    return &sim_none;
+}
+
+static struct sim_task *sim_attach(pid_t pid, int kind) {
+    int i;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        if (!sims[i].kind) {
+            kernel_memset(&sims[i], 0, sizeof(struct sim_task));
+            sims[i].kind = kind;
+            sims[i].pid = pid;
+            sims[i].task = find_in_tasks(pid);
+            return &sims[i];
+        }
+    }
+    return 0;
+}
+
+static struct sim_task *sim_setup(pid_t pid, int kind, unsigned long long burst) {
+    struct sim_task *st;
+
+    st = sim_attach(pid, kind);
+    if (st == 0) {
+        pc_kill(pid);
+        spawn_failed++;
+        return 0;
+    }
+    st->burst = burst;
+    st->remain = burst;
+    st->created = sim_now;
+    st->stamp = sim_now;
+    st->waiting = 1;
+    return st;
+}
+
+// create a kernel task and attach a workload to it
+static struct sim_task *sim_spawn(char *name, int kind, long prio, int policy, unsigned long long burst) {
+    pid_t pid;
+    unsigned long long t0 = sim_host_ns();
+    int failed;
+
+    failed = task_create_policy(name, policy == SCHED_NORMAL ? prio : 0, policy, policy == SCHED_NORMAL ? 0 : prio,
+                                0, 0, 0, &pid, 0);
+    spawn_ns += sim_host_ns() - t0;
+    if (failed) {
+        spawn_failed++;
+        return 0;
+    }
+    return sim_setup(pid, kind, burst);
+}
+
+static struct sim_task *sim_spawn_periodic(char *name, unsigned long long period, unsigned long long runtime,
+                                           unsigned long long burst) {
+    pid_t pid;
+    struct sim_task *st;
+
+    if (task_create_periodic(name, period, runtime, 0, 0, 0, 0, &pid)) {
+        spawn_failed++;
+        return 0;
+    }
+    st = sim_setup(pid, SIM_PERIODIC, burst);
+    if (st)
+        st->period = period;
+    return st;
+}
+
+// the kernel released SCHED_DEADLINE tasks on this tick: start their next job
+static void sim_dl_released() {
+    int i;
+    struct sim_task *st;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        st = &sims[i];
+        if (st->kind && st->blocked && st->task->policy == SCHED_DEADLINE && st->task->state != TASK_WAITING) {
+            st->blocked = 0;
+            st->remain = st->burst;
+            st->stamp = sim_now - (unsigned int)((unsigned int)sim_now - st->task->dl_release);
+            st->waiting = 1;
+        }
+    }
+}
+
+// a churn job started running: record the delay since it was submitted
+static void sim_dispatched(unsigned long long created) {
+    unsigned long long d = sim_now - created;
+
+    dispatch_sum += d;
+    if (d > dispatch_max)
+        dispatch_max = d;
+    dispatched++;
+}
+
+// run_on_worker() callback, called by pool_worker_run() when the burst is done
+static void sim_job_done(void *arg) {
+    struct sim_job *job = (struct sim_job *)arg;
+
+    turnaround += sim_now - job->created;
+    reaped++;
+    job->used = 0;
+}
+
+// attach workloads to pool threads created since the last call
+static void sim_pool_attach() {
+    int i;
+    struct sim_task *st;
+
+    for (i = 0; i < worker_pool_size; i++) {
+        st = sim_find(worker_pool[i]->task->pid);
+        if (st->kind == 0) {
+            st = sim_attach(worker_pool[i]->task->pid, SIM_POOL);
+            if (st)
+                st->worker = worker_pool[i];
+        }
+    }
+}
+
+// submit a churn job to the worker pool, falling back to a new task
+static int sim_submit(unsigned long long burst) {
+    int i, failed;
+    unsigned long long t0;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        if (!sim_jobs[i].used)
+            break;
+    }
+    if (i < SIM_SLOTS) {
+        sim_jobs[i].used = 1;
+        sim_jobs[i].burst = burst;
+        sim_jobs[i].created = sim_now;
+        t0 = sim_host_ns();
+        failed = run_on_worker(sim_job_done, &sim_jobs[i]);
+        spawn_ns += sim_host_ns() - t0;
+        if (!failed) {
+            sim_pool_attach();
+            return 0;
+        }
+        sim_jobs[i].used = 0;
+    }
+    return sim_spawn("job", SIM_CHURN, 15, SCHED_NORMAL, burst) == 0;
+}
+
+// called after every entry into the scheduler: record wakeup latency of the
+// task that just got the CPU
+static void sim_observe() {
+    struct sim_task *st;
+
+    if (current_task == sim_last)
+        return;
+    sim_last = current_task;
+    switches++;
+    st = sim_find(current_task->pid);
+    if (st->kind && st->waiting) {
+        st->waiting = 0;
+        if (st->kind == SIM_CHURN)
+            sim_dispatched(st->created);
+        if (nlat < SIM_MAX_SAMPLES)
+            lat[nlat++] = (unsigned int)((sim_now - st->stamp) / US(1));
+    }
+}
+
+static void sim_block(struct sim_task *st) {
+    unsigned long long t0 = sim_host_ns();
+
+    st->blocked = 1;
+    sleep_on(&sim_wait);
+    block_ns += sim_host_ns() - t0;
+    blocks++;
+}
+
+static void sim_wake(struct sim_task *st) {
+    wakeup_task(st->task);
+    st->blocked = 0;
+    st->remain = st->burst;
+    st->stamp = sim_now;
+    st->waiting = 1;
+}
+
+// the current task finished its job
+static void sim_complete(struct sim_task *st) {
+    unsigned long long t0;
+
+    st->jobs++;
+    if (st->holds) {
+        st->holds = 0;
+        mutex_unlock(&sim_mutex);
+    }
+    switch (st->kind) {
+        case SIM_IO:
+            st->wake_at = sim_now + sim_rand_range(st->sleep_min, st->sleep_max);
+            sim_block(st);
+            break;
+        case SIM_KSECT:
+        case SIM_LOCKER:
+            sim_block(st);
+            break;
+        case SIM_PERIODIC:
+            if (st->task->policy == SCHED_DEADLINE) {
+                st->blocked = 1;
+                wait_next_period();
+            } else {
+                sim_block(st);
+            }
+            break;
+        case SIM_YIELD:
+            st->remain = st->burst;
+            t0 = sim_host_ns();
+            sched_yield();
+            yield_ns += sim_host_ns() - t0;
+            yields++;
+            if (current_task != st->task)
+                yield_switched++;
+            break;
+        case SIM_CHURN:
+            turnaround += sim_now - st->created;
+            reaped++;
+            reaped_work += st->work;
+            st->kind = 0;
+            t0 = sim_host_ns();
+            task_exit();
+            teardown_ns += sim_host_ns() - t0;
+            break;
+    }
+    sim_observe();
+}
+
+// deliver wakeups, releases and arrivals due at sim_now
+static void sim_events(unsigned long long *next_spawn, const struct sim_scenario *sc) {
+    int i;
+    struct sim_task *st;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        st = &sims[i];
+        if (!st->wake_at || st->wake_at > sim_now)
+            continue;
+        if (st->kind == SIM_IO) {
+            st->wake_at = 0;
+            sim_wake(st);
+        } else if (st->kind == SIM_PERIODIC || st->kind == SIM_KSECT || st->kind == SIM_LOCKER) {
+            st->wake_at += st->period;
+            if (st->blocked) {
+                sim_wake(st);
+            } else {
+                // previous job still running: deadline missed; a late
+                // kernel loop covers the new period too
+                st->misses++;
+                if (st->kind == SIM_PERIODIC)
+                    st->remain += st->burst;
+            }
+        }
+    }
+    if (sc->spawn_interval && *next_spawn <= sim_now) {
+        unsigned long long burst = sim_rand_range(MS(1), MS(9));
+        int failed;
+
+        *next_spawn += sc->spawn_interval;
+        if (spawned - reaped >= SIM_CHURN_MAX) {
+            throttled++;
+            return;
+        }
+        if (sc->pool)
+            failed = sim_submit(burst);
+        else
+            failed = sim_spawn("job", SIM_CHURN, 15, SCHED_NORMAL, burst) == 0;
+        if (!failed)
+            spawned++;
+    }
+}
+
+static unsigned long long sim_next_event(unsigned long long step, unsigned long long next_spawn,
+                                         const struct sim_scenario *sc) {
+    int i;
+
+    if (sc->spawn_interval && next_spawn < step)
+        step = next_spawn;
+    for (i = 0; i < SIM_SLOTS; i++) {
+        if (sims[i].kind && sims[i].wake_at && sims[i].wake_at < step)
+            step = sims[i].wake_at;
+    }
+    return step;
+}
+
+static unsigned int sim_pct(int p) {
+    int i = (int)((unsigned long long)nlat * p / 100);
+
+    if (nlat == 0)
+        return 0;
+    return lat[i < nlat ? i : nlat - 1];
+}
+
+static void sim_report(const struct sim_scenario *sc, unsigned long long end) {
+    int i, nhog = 0;
+    double work = 0, sum = 0, sq = 0, x;
+    unsigned int jobs = 0, misses = 0;
+    double secs = (double)end / CYCLES_PER_SEC;
+
+    for (i = 0; i < SIM_SLOTS; i++) {
+        if (sims[i].kind == SIM_HOG) {
+            x = (double)sims[i].work;
+            sum += x;
+            sq += x * x;
+            nhog++;
+        }
+        if (sims[i].kind > SIM_WORKER) {
+            work += sims[i].work;
+            jobs += sims[i].jobs;
+            misses += sims[i].misses + sims[i].task->dl_misses;
+        }
+    }
+    jobs += reaped;
+    work += reaped_work;
+    sim_sort_u32(lat, nlat);
+
+#ifdef SCHED_FAIR
+    printf("policy fair  scenario %s  duration %.0fs  seed %u\n", sc->name, secs, sim_seed0);
+#else
+    printf("policy prio  scenario %s  duration %.0fs  seed %u\n", sc->name, secs, sim_seed0);
+#endif
+    printf("  throughput  work %.1f%%  idle %.1f%%  init %.1f%%  jobs %.1f/s  switches %.1f/s\n",
+           100.0 * work / end, 100.0 * idle_cycles / end, 100.0 * init_cycles / end, jobs / secs,
+           switches / secs);
+    if (nhog)
+        printf("  fairness    jain %.4f over %d hogs\n", sum * sum / (nhog * sq), nhog);
+    if (sc->periodic || sc->ksect)
+        printf("  deadlines   missed %u\n", misses);
+    if (sc->ksect)
+        printf("  preemption  worst resched latency %.1fms\n", (double)resched_lat_max / MS(1));
+    if (sc->lock)
+        printf("  mutex       waits %llu  wait avg %.2fms max %.2fms  inversions %u\n", lock_waits,
+               lock_waits ? (double)lock_wait_sum / lock_waits / MS(1) : 0.0, (double)lock_wait_max / MS(1),
+               sim_mutex.inv_count);
+    if (sc->yielders)
+        printf("  yield       n %llu  switched %.1f%%  cost avg %.0fns\n", yields,
+               yields ? 100.0 * yield_switched / yields : 0.0, yields ? (double)yield_ns / yields : 0.0);
+    if (sc->spawn_interval)
+        printf("  churn       spawned %u  throttled %u  exited %u  turnaround avg %.1fms\n", spawned, throttled,
+               reaped, reaped ? (double)turnaround / reaped / MS(1) : 0.0);
+    if (sc->spawn_interval)
+        printf("  dispatch    cost avg %.0fns  teardown avg %.0fns  latency avg %.2fms max %.2fms\n",
+               spawned ? (double)spawn_ns / spawned : 0.0, reaped ? (double)teardown_ns / reaped : 0.0,
+               dispatched ? (double)dispatch_sum / dispatched / MS(1) : 0.0, (double)dispatch_max / MS(1));
+    printf("  wakeup lat  n %d  p50 %uus  p90 %uus  p99 %uus  max %uus\n", nlat, sim_pct(50), sim_pct(90),
+           sim_pct(99), nlat ? lat[nlat - 1] : 0);
+    printf("  sched cost  tick avg %.0fns max %lluns  block avg %.0fns\n", ticks ? (double)tick_ns / ticks : 0.0,
+           tick_ns_max, blocks ? (double)block_ns / blocks : 0.0);
+    if (spawn_failed)
+        printf("  ERROR       %u task creations failed\n", spawn_failed);
+}
+
+// returns 1 if a task could not be created
+static int sim_run(const struct sim_scenario *sc, int seconds, unsigned int seed) {
+    unsigned long long end = (unsigned long long)seconds * CYCLES_PER_SEC;
+    unsigned long long next_tick = TICK_CYCLES;
+    unsigned long long next_spawn = sc->spawn_interval;
+    unsigned long long step, delta, t0;
+    struct sim_task *cur, *st;
+    struct pool_worker *w;
+    int i;
+
+    // fresh kernel state; tasks of the previous scenario are leaked
+    sim_now = 0;
+    sim_seed = seed;
+    sim_seed0 = seed;
+    kernel_memset(sims, 0, sizeof(sims));
+    kernel_memset(sim_jobs, 0, sizeof(sim_jobs));
+    kernel_memset(&sim_regs, 0, sizeof(context));
+    INIT_LIST_HEAD(&sim_wait);
+    nlat = 0;
+    tick_ns = tick_ns_max = ticks = block_ns = blocks = 0;
+    idle_cycles = init_cycles = switches = turnaround = reaped_work = 0;
+    spawned = spawn_failed = throttled = reaped = dispatched = 0;
+    dispatch_sum = dispatch_max = 0;
+    yield_ns = yields = yield_switched = 0;
+    lock_wait_sum = lock_wait_max = lock_waits = 0;
+    init_mutex(&sim_mutex, "sim");
+    preempt_count = 0;
+    resched_lat_max = 0;
+    init_pid();
+    init_pc();
+    sim_last = current_task;
+
+    sim_spawn("init", SIM_INIT, 0, SCHED_NORMAL, SIM_FOREVER);
+    init_workqueues();
+    sim_attach(system_wq->worker->pid, SIM_WORKER);
+    if (sc->pool) {
+        init_worker_pool();
+        sim_pool_attach();
+    }
+    for (i = 0; i < sc->hogs; i++)
+        sim_spawn("hog", SIM_HOG, 15, SCHED_NORMAL, SIM_FOREVER);
+    for (i = 0; i < sc->io; i++) {
+        if (sc->rt)
+            st = sim_spawn("io", SIM_IO, 16, SCHED_RR, US(500));
+        else
+            st = sim_spawn("io", SIM_IO, 15, SCHED_NORMAL, US(500));
+        st->sleep_min = MS(5);
+        st->sleep_max = MS(50);
+        st->uses_lock = sc->lock;
+    }
+    for (i = 0; i < sc->periodic; i++) {
+        if (sc->rt) {
+            // releases happen on the tick, so the period is a multiple of it
+            sim_spawn_periodic("periodic", 2 * TICK_CYCLES, MS(5), MS(2));
+            continue;
+        }
+        st = sim_spawn("periodic", SIM_PERIODIC, 20, SCHED_NORMAL, MS(2));
+        st->period = MS(50);
+        st->wake_at = st->period;
+    }
+    for (i = 0; i < sc->yielders; i++)
+        sim_spawn("yield", SIM_YIELD, 15, SCHED_NORMAL, US(100));
+    if (sc->lock) {
+        // e.g. a background flush holding the SD card
+        st = sim_spawn("locker", SIM_LOCKER, 5, SCHED_NORMAL, MS(20));
+        st->period = MS(100);
+        st->wake_at = st->period;
+        st->uses_lock = 1;
+    }
+    if (sc->ksect) {
+        // e.g. a writeback of the whole cache once a second
+        st = sim_spawn("ksect", SIM_KSECT, 15, SCHED_NORMAL, MS(300));
+        st->period = MS(1000);
+        st->wake_at = st->period;
+    }
+
+    spawn_ns = teardown_ns = 0;
+    while (sim_now < end) {
+        // a real-time task was created or woken, or a deferred tick is due:
+        // reschedule before time advances, as on return from interrupt
+        if (need_resched && preemptible()) {
+            pc_resched(&sim_regs);
+            sim_observe();
+        }
+        cur = sim_find(current_task->pid);
+        if (cur->kind == SIM_WORKER) {
+            // the system workqueue only reaps exited tasks here
+            t0 = sim_host_ns();
+            run_workqueue(system_wq);
+            teardown_ns += sim_host_ns() - t0;
+            worker_wait(system_wq);
+            sim_observe();
+            continue;
+        }
+        if (cur->kind == SIM_POOL && cur->remain == 0) {
+            // between jobs: finish the previous one, then take the next or park
+            w = cur->worker;
+            t0 = sim_host_ns();
+            if (cur->job) {
+                cur->job = 0;
+                if (pool_worker_run(w)) {
+                    // the job ran too long and the thread left the pool
+                    cur->kind = 0;
+                    kfree(w);
+                    task_exit();
+                    teardown_ns += sim_host_ns() - t0;
+                    sim_observe();
+                    continue;
+                }
+            }
+            pool_worker_wait(w);
+            teardown_ns += sim_host_ns() - t0;
+            if (current_task == cur->task && w->fn) {
+                cur->job = (struct sim_job *)w->arg;
+                cur->remain = cur->job->burst;
+                sim_dispatched(cur->job->created);
+            }
+            sim_observe();
+            continue;
+        }
+
+        if (cur->kind == SIM_KSECT && !cur->blocked && !cur->locked) {
+            preempt_disable();
+            cur->locked = 1;
+            cur->chunk = sc->ksect == 2 ? MS(1) : cur->remain;
+        }
+
+        if (cur->uses_lock && !cur->blocked && !cur->holds) {
+            if (cur->lockwait) {
+                // mutex_unlock() handed sim_mutex over before waking us
+                cur->lockwait = 0;
+                delta = sim_now - cur->lock_stamp;
+                lock_wait_sum += delta;
+                if (delta > lock_wait_max)
+                    lock_wait_max = delta;
+                lock_waits++;
+            } else {
+                mutex_lock(&sim_mutex);
+                if (current_task != cur->task) {
+                    cur->lockwait = 1;
+                    cur->lock_stamp = sim_now;
+                    sim_observe();
+                    continue;
+                }
+            }
+            cur->holds = 1;
+        }
+
+        step = sim_next_event(next_tick, next_spawn, sc);
+        if (cur->kind > SIM_HOG && !cur->blocked && sim_now + cur->remain < step)
+            step = sim_now + cur->remain;
+        if (cur->locked && sim_now + cur->chunk < step)
+            step = sim_now + cur->chunk;
+        if (step > end)
+            step = end;
+
+        // charge the elapsed cycles to the running task
+        delta = step - sim_now;
+        if (current_task->pid == IDLE_PID) {
+            idle_cycles += delta;
+        } else if (cur->kind == SIM_INIT) {
+            init_cycles += delta;
+        } else if (cur->kind) {
+            cur->work += delta;
+            if (cur->remain != SIM_FOREVER)
+                cur->remain -= delta;
+            if (cur->locked)
+                cur->chunk -= delta;
+        }
+        sim_now = step;
+
+        if (cur->locked && (cur->chunk == 0 || cur->remain == 0)) {
+            cur->locked = 0;
+            preempt_enable();
+        }
+
+        if (cur->kind > SIM_HOG && cur->kind != SIM_POOL && !cur->blocked && cur->remain == 0)
+            sim_complete(cur);
+
+        sim_events(&next_spawn, sc);
+
+        if (sim_now == next_tick) {
+            t0 = sim_host_ns();
+            pc_schedule(0, 0, &sim_regs);
+            t0 = sim_host_ns() - t0;
+            tick_ns += t0;
+            if (t0 > tick_ns_max)
+                tick_ns_max = t0;
+            ticks++;
+            next_tick += TICK_CYCLES;
+            sim_dl_released();
+            sim_observe();
+        }
+    }
+    sim_report(sc, end);
+    return spawn_failed != 0;
+}
+
+int main(int argc, char **argv) {
+    const char *name = "all";
+    int seconds = 300;
+    unsigned int seed = 1;
+    int i, n = 0, found = 0, failed = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (sim_streq(argv[i], "-v"))
+            sim_verbose = 1;
+        else if (argv[i][0] >= '0' && argv[i][0] <= '9')
+            n++ == 0 ? (seconds = sim_atoi(argv[i])) : (seed = sim_atoi(argv[i]));
+        else
+            name = argv[i];
+    }
+    if (seconds <= 0 || seed == 0 || sim_host_init()) {
+        printf("usage: %s [hogs|mixed|periodic|churn|all] [seconds] [seed] [-v]\n", argv[0]);
+        return 1;
+    }
+    lat = sim_alloc(SIM_MAX_SAMPLES * sizeof(unsigned int));
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (sim_streq(name, "all") || sim_streq(name, scenarios[i].name)) {
+            failed |= sim_run(&scenarios[i], seconds, seed);
+            found = 1;
+        }
+    }
+    if (!found) {
+        printf("unknown scenario %s\n", name);
+        return 1;
+    }
+    return failed;
+}
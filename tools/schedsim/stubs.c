@@ -0,0 +1,165 @@
+/*
+ * Host replacements for the kernel services used by kernel/pc.
+ *
+ * This file is built against the host libc and must not include kernel
+ * headers (zjunix/utils.h redefines va_list). Interrupt masking, the timer
+ * and context switches are no-ops: the simulator drives pc_schedule(),
+ * sleep_on() and task_exit() directly and only looks at the scheduler state
+ * they leave behind.
+ */
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define IDLE_UNION_SIZE 4096
+
+// simulated CP0 cycle counter, advanced by sim.c
+unsigned long long sim_now;
+int sim_verbose;
+
+// init_pc() places idle's task_union right below kernel_sp, which is a
+// 32-bit value: back it with memory mapped below 4GB
+volatile unsigned int kernel_sp;
+
+int sim_host_init() {
+    void *p = mmap(0, IDLE_UNION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (p == MAP_FAILED)
+        return 1;
+    kernel_sp = (unsigned int)(unsigned long)p + IDLE_UNION_SIZE;
+    return 0;
+}
+
+unsigned long long sim_host_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+void sim_sort_u32(unsigned int *buf, int n) {
+    qsort(buf, n, sizeof(unsigned int), cmp_u32);
+}
+
+void *sim_alloc(unsigned int size) {
+    return calloc(1, size);
+}
+
+// kernel services
+
+int kernel_printf(const char *format, ...) {
+    va_list ap;
+    int ret = 0;
+
+    if (sim_verbose) {
+        va_start(ap, format);
+        ret = vprintf(format, ap);
+        va_end(ap);
+    }
+    return ret;
+}
+
+void *kmalloc(unsigned int size) {
+    return malloc(size);
+}
+
+void kfree(void *obj) {
+    free(obj);
+}
+
+void *kernel_memcpy(void *dest, void *src, int len) {
+    return memcpy(dest, src, len);
+}
+
+void *kernel_memset(void *dest, int b, int len) {
+    return memset(dest, b, len);
+}
+
+char *kernel_strcpy(char *dest, const char *src) {
+    return strcpy(dest, src);
+}
+
+int kernel_strcmp(const char *dest, const char *src) {
+    return strcmp(dest, src);
+}
+
+unsigned int get_cycles() {
+    return (unsigned int)sim_now;
+}
+
+unsigned long long get_cycles64() {
+    return sim_now;
+}
+
+void format_time(unsigned long long cycles, char *buf, int len) {
+    unsigned int sec = (unsigned int)(cycles / 100000000ull);
+    snprintf(buf, len, "%02u:%02u:%02u", sec / 3600 % 24, sec / 60 % 60, sec % 60);
+}
+
+int enable_interrupts() {
+    return 0;
+}
+
+int disable_interrupts() {
+    return 1;
+}
+
+void register_interrupt_handler(int index, void *fn) {
+}
+
+void init_timer(unsigned int interval) {
+}
+
+void reset_timer() {
+}
+
+void set_exl() {
+}
+
+// a raised software interrupt is taken immediately: sim.c calls pc_resched()
+// whenever need_resched is set and preemption is enabled
+void raise_soft_irq() {
+}
+
+void clear_soft_irq() {
+}
+
+unsigned int get_gp() {
+    return 0;
+}
+
+void switch_ex(void *regs) {
+}
+
+void switch_to(void *prev, void *next) {
+}
+
+void switch_to_ex(void *prev, void *regs) {
+}
+
+// simulated tasks have no user address space
+void switch_mm(void *mm) {
+}
+
+void mm_delete(void *mm) {
+}
+
+int filemap_sync_mm(void *mm) {
+    return 0;
+}
+
+void *mm_create() {
+    return 0;
+}
+
+void *dup_mm(void *oldmm, int copy) {
+    return 0;
+}
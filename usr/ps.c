@@ -2,21 +2,104 @@
 #include <driver/ps2.h>
 #include <driver/sd.h>
 #include <driver/vga.h>
+#include <irqsoff.h>
 #include <zjunix/bootmm.h>
+#include <zjunix/coroutine.h>
+#include <zjunix/semaphore.h>
 #include <zjunix/buddy.h>
 #include <zjunix/fs/fat.h>
+#include <zjunix/mutex.h>
 #include <zjunix/mfs/fat32.h>
+#include <zjunix/pc.h>
+#include <zjunix/preempt.h>
 #include <zjunix/slab.h>
 #include <zjunix/time.h>
 #include <zjunix/vm.h>
 #include <zjunix/utils.h>
 #include "../usr/ls.h"
+#include "../kernel/mfs/utils.h"
 #include "exec.h"
 #include "myvi.h"
 
 char ps_buffer[64];
 int ps_buffer_index;
 
+// top: snapshot buffers live in .bss, the shell stack is far too small for them
+#define TOP_MAX_TASKS 32
+#define TOP_INTERVAL CYCLES_PER_SEC
+struct task_snapshot top_snap[TOP_MAX_TASKS];
+pid_t top_prev_pid[TOP_MAX_TASKS];
+unsigned long long top_prev_run[TOP_MAX_TASKS];
+int top_prev_cnt;
+
+// keystroke-to-echo latency in microseconds, measured from the PS/2 interrupt to the echo
+#define CYCLES_PER_US (CYCLES_PER_SEC / 1000000)
+unsigned int key_lat_cnt;
+unsigned int key_lat_max;
+unsigned int key_lat_sum;
+
+// yield ping-pong: two kernel threads of the same priority hand the CPU back
+// and forth with sched_yield() while the shell sleeps
+#define YIELD_ROUNDS 10000
+#define YIELD_PRIORITY 15
+unsigned int yield_rounds;
+unsigned int yield_switched;
+volatile int yield_running;
+pid_t yield_last;
+unsigned int yield_start;
+unsigned int yield_end;
+static LIST_HEAD(yield_done);
+
+// cotest: I/O flows as coroutines, each sleeps a few ticks and then reads a
+// sector through the SD coroutine, twice; none of them has a kernel stack
+#define COTEST_FLOWS 1000
+#define COTEST_MAX 4096
+#define COTEST_ROUNDS 2
+struct cotest_flow {
+    struct coroutine co;
+    struct sd_request req;
+    int round;
+};
+struct cotest_flow *cotest_flows;
+unsigned char cotest_buf[SECSIZE];
+volatile int cotest_running;
+unsigned int cotest_end;
+static DEFINE_SEMAPHORE(cotest_done, 0);
+
+// tlbbench: touch one page in each of n page pairs of a scratch address
+// space. The first pass faults every page in through the C slow path; the
+// later passes flush the TLB first, so every touch is a refill-only miss.
+#define TLBBENCH_BASE 0x00400000
+#define TLBBENCH_PAIRS 64
+#define TLBBENCH_MAX 512
+#define TLBBENCH_ROUNDS 16
+
+// vm: a sparse address space, one large vma touched once per VMTEST_STRIDE;
+// only the touched pages get memory
+#define VMTEST_BASE 0x01000000
+#define VMTEST_SIZE (64 << 20)
+#define VMTEST_STRIDE (1 << 20)
+
+// forkbench: fork and exit of an address space with n resident pages, the
+// child sharing them copy-on-write or copying them all
+#define FORKBENCH_BASE 0x00400000
+#define FORKBENCH_PAGES 256
+#define FORKBENCH_MAX 4096
+
+// hugebench: sequential reads over a buffer of n MB, mapped with 4KB pages
+// and then with large pages, counting TLB misses per pass
+#define HUGEBENCH_BASE 0x20000000
+#define HUGEBENCH_MB 4
+#define HUGEBENCH_MAX_MB 32
+#define HUGEBENCH_ROUNDS 4
+#define HUGEBENCH_STRIDE 64
+
+// filebench: sum a file's words twice as copied in chunks by fat32_read(),
+// then twice in place through a file mapping; the first mapped pass faults
+// the page cache's clusters in
+#define FILEBENCH_BASE 0x30000000
+#define FILEBENCH_CHUNK 4096
+
 void test_proc() {
     unsigned int timestamp;
     unsigned int currTime;
@@ -66,6 +149,527 @@ void testMem() {
     buddy_info();
 }
 
+char top_state_char(int state) {
+    switch (state) {
+        case TASK_UNINIT: return 'U';
+        case TASK_READY: return 'R';
+        case TASK_RUNNING: return 'X';
+        case TASK_TERMINAL: return 'T';
+        default: return 'W';
+    }
+}
+
+// Run time of pid in the previous snapshot, 0 if it is new
+unsigned long long top_prev_run_of(pid_t pid) {
+    int i;
+    for (i = 0; i < top_prev_cnt; i++) {
+        if (top_prev_pid[i] == pid)
+            return top_prev_run[i];
+    }
+    return 0;
+}
+
+void top_render(int count, int total, unsigned int interval) {
+    int i;
+#ifdef SCHED_PRIO_TIME
+    int j;
+#endif
+    unsigned int delta, cpu;
+    struct sched_stat *st;
+
+    kernel_clear_screen(31);
+    kernel_printf("top - %d tasks (%d shown), refresh every %d ms, press any key to quit\n", total, count,
+                  cycles_to_ms(TOP_INTERVAL));
+    kernel_printf("PID\tNAME\t\tS  PRI\tCPU\tTIME(ms)\tVCSW\tIVCSW\tLAT(us) last/avg/max\n");
+    for (i = 0; i < count; i++) {
+        st = &(top_snap[i].stat);
+        delta = (unsigned int)(st->run_cycles - top_prev_run_of(top_snap[i].pid));
+        cpu = interval >> 10 ? (delta >> 10) * 100 / (interval >> 10) : 0;
+        if (cpu > 100)
+            cpu = 100;
+        kernel_printf("%d\t%s\t\t%c  %d\t%d\t%d\t\t%d\t%d\t%d/%d/%d\n", top_snap[i].pid, top_snap[i].name,
+                      top_state_char(top_snap[i].state), top_snap[i].dynamic_prority, cpu, cycles_to_ms(st->run_cycles),
+                      st->nvcsw, st->nivcsw, st->wakeup_lat_last / 100, st->wakeup_lat_avg / 100, st->wakeup_lat_max / 100);
+#ifdef SCHED_PRIO_TIME
+        // time spent in each dynamic priority, only the non-empty ones
+        kernel_printf("\tprio(ms):");
+        for (j = 0; j < PRORITY_NUM; j++) {
+            if (st->prio_time[j])
+                kernel_printf(" %d:%d", j, cycles_to_ms((unsigned long long)st->prio_time[j] << 10));
+        }
+        kernel_printf("\n");
+#endif
+    }
+}
+
+// top: periodically snapshot per-task scheduler statistics and display them.
+// The snapshot is taken with interrupts off, rendering happens afterwards.
+int top() {
+    int i, count, total;
+    unsigned int last, now;
+
+    top_prev_cnt = 0;
+    last = get_cycles();
+    while (1) {
+        count = snapshot_proc(top_snap, TOP_MAX_TASKS, &total);
+        now = get_cycles();
+        top_render(count, total, now - last);
+        for (i = 0; i < count; i++) {
+            top_prev_pid[i] = top_snap[i].pid;
+            top_prev_run[i] = top_snap[i].stat.run_cycles;
+        }
+        top_prev_cnt = count;
+        last = now;
+        while (get_cycles() - now < TOP_INTERVAL) {
+            if (kernel_getkey() != 0xfff) {
+                kernel_clear_screen(31);
+                return 0;
+            }
+        }
+    }
+}
+
+void key_lat_record() {
+    unsigned int lat = (get_cycles() - ps2_key_stamp()) / CYCLES_PER_US;
+    key_lat_cnt++;
+    key_lat_sum += lat;
+    if (lat > key_lat_max)
+        key_lat_max = lat;
+}
+
+// Print and reset keystroke-to-echo latency, in microseconds
+int keylat() {
+    if (key_lat_cnt == 0) {
+        kernel_printf("no keystrokes recorded\n");
+        return 1;
+    }
+    kernel_printf("keys: %d  avg: %dus  max: %dus\n", key_lat_cnt, key_lat_sum / key_lat_cnt, key_lat_max);
+    key_lat_cnt = 0;
+    key_lat_max = 0;
+    key_lat_sum = 0;
+    return 0;
+}
+
+// Print and reset the worst delay between a reschedule request (woken
+// real-time task, tick deferred by a held lock) and the task switch
+int schedlat() {
+    kernel_printf("worst-case scheduling latency: %dus\n", resched_lat_max / CYCLES_PER_US);
+    resched_lat_max = 0;
+    return 0;
+}
+
+void yield_thread(void *arg) {
+    pid_t self = current_task->pid;
+    unsigned int i;
+
+    for (i = 0; i < yield_rounds; i++) {
+        yield_last = self;
+        sched_yield();
+        if (yield_last != self)
+            yield_switched++;
+    }
+    disable_interrupts();
+    if (--yield_running == 0) {
+        yield_end = get_cycles();
+        wakeup_queue(&yield_done);
+    }
+    enable_interrupts();
+}
+
+int cotest_flow(struct coroutine *co) {
+    struct cotest_flow *f = (struct cotest_flow *)co->arg;
+    int id = f - cotest_flows;
+
+    CO_BEGIN(co);
+    for (f->round = 0; f->round < COTEST_ROUNDS; f->round++) {
+        CO_SLEEP(co, 1 + id % 4);
+        sd_request_init(&f->req, 0, id % 64, cotest_buf);
+        CO_AWAIT_SD(co, &f->req);
+    }
+    CO_END(co);
+}
+
+// Runs in the executor, one flow at a time
+void cotest_flow_done(struct coroutine *co) {
+    if (--cotest_running == 0) {
+        cotest_end = get_cycles();
+        up(&cotest_done);
+    }
+}
+
+// Run n concurrent coroutine I/O flows and report time and memory per flow
+int cotest(char *param) {
+    unsigned int n = 0, i, start;
+
+    while (*param >= '0' && *param <= '9')
+        n = n * 10 + *param++ - '0';
+    if (n == 0)
+        n = COTEST_FLOWS;
+    if (n > COTEST_MAX)
+        n = COTEST_MAX;
+    cotest_flows = (struct cotest_flow *)kmalloc(n * sizeof(struct cotest_flow));
+    if (cotest_flows == 0)
+        return 1;
+    cotest_running = n;
+    start = get_cycles();
+    for (i = 0; i < n; i++) {
+        co_init(&cotest_flows[i].co, cotest_flow, &cotest_flows[i], cotest_flow_done);
+        co_start(&cotest_flows[i].co);
+    }
+    down(&cotest_done);
+
+    kernel_printf("%d flows, %d sector reads in %dms, %d bytes per flow (task_union %d)\n", n, n * COTEST_ROUNDS,
+                  (cotest_end - start) / (CYCLES_PER_SEC / 1000), sizeof(struct cotest_flow), sizeof(task_union));
+    kfree(cotest_flows);
+    return 0;
+}
+
+// Measure the cost of a voluntary switch: rounds sched_yield() calls per thread
+int yieldbench(char *param) {
+    unsigned int total, per_yield;
+
+    yield_rounds = 0;
+    while (*param >= '0' && *param <= '9')
+        yield_rounds = yield_rounds * 10 + *param++ - '0';
+    if (yield_rounds == 0)
+        yield_rounds = YIELD_ROUNDS;
+    yield_switched = 0;
+    yield_running = 2;
+    yield_last = 0;
+    // the shell is a real-time task: the threads only start once it sleeps
+    if (kthread_create("yield", YIELD_PRIORITY, yield_thread, 0, 0))
+        return 1;
+    if (kthread_create("yield", YIELD_PRIORITY, yield_thread, 0, 0)) {
+        yield_running = 1;
+        return 1;
+    }
+    disable_interrupts();
+    yield_start = get_cycles();
+    sleep_on(&yield_done);
+
+    total = 2 * yield_rounds;
+    per_yield = (yield_end - yield_start) / total;
+    kernel_printf("%d yields, %d switched, %d cycles (%dns) per yield\n", total, yield_switched, per_yield,
+                  per_yield * 1000 / CYCLES_PER_US);
+    return 0;
+}
+
+// Measure the cost of a TLB miss: refill handler only, and refill plus the
+// slow path that allocates the page
+int tlbbench(char *param) {
+    struct mm_struct *mm, *old;
+    unsigned int n = 0, i, r, t0;
+    unsigned int fault, refill = 0, hit = 0;
+    volatile unsigned int sum = 0;
+
+    while (*param >= '0' && *param <= '9')
+        n = n * 10 + *param++ - '0';
+    if (n == 0)
+        n = TLBBENCH_PAIRS;
+    if (n > TLBBENCH_MAX)
+        n = TLBBENCH_MAX;
+    mm = mm_create();
+    if (mm == 0)
+        return 1;
+
+    // the shell borrows the scratch address space with interrupts off, so
+    // nothing else runs in it and the timer does not disturb the counts
+    disable_interrupts();
+    old = current_task->mm;
+    current_task->mm = mm;
+    activate_mm(current_task);
+    do_mmap(TLBBENCH_BASE, n * 2 * PAGE_SIZE, VM_READ | VM_WRITE);
+
+    t0 = get_cycles();
+    for (i = 0; i < n; i++)
+        *(volatile unsigned int *)(TLBBENCH_BASE + i * 2 * PAGE_SIZE) = i;
+    fault = get_cycles() - t0;
+    for (r = 0; r < TLBBENCH_ROUNDS; r++) {
+        flush_tlb_all();
+        t0 = get_cycles();
+        for (i = 0; i < n; i++)
+            sum += *(volatile unsigned int *)(TLBBENCH_BASE + i * 2 * PAGE_SIZE);
+        refill += get_cycles() - t0;
+    }
+    // the same loads, all hitting one pair, to subtract the loop itself
+    for (r = 0; r < TLBBENCH_ROUNDS; r++) {
+        t0 = get_cycles();
+        for (i = 0; i < n; i++)
+            sum += *(volatile unsigned int *)TLBBENCH_BASE;
+        hit += get_cycles() - t0;
+    }
+
+    current_task->mm = old;
+    activate_mm(current_task);
+    enable_interrupts();
+    mm_delete(mm);
+
+    refill = (refill - hit) / (n * TLBBENCH_ROUNDS);
+    fault = fault / n;
+    kernel_printf("%d pairs: refill %d cycles (%dns), fault %d cycles (%dns) per miss\n", n, refill,
+                  refill * 1000 / CYCLES_PER_US, fault, fault * 1000 / CYCLES_PER_US);
+    return 0;
+}
+
+// Map a large vma, touch it sparsely and report how many pages it really uses
+int vmtest() {
+    struct mm_struct *mm, *old;
+    unsigned int addr, touched = 0, rss, ret = 0;
+
+    mm = mm_create();
+    if (mm == 0)
+        return 1;
+    disable_interrupts();
+    old = current_task->mm;
+    current_task->mm = mm;
+    activate_mm(current_task);
+
+    if (do_mmap(VMTEST_BASE, VMTEST_SIZE, VM_READ | VM_WRITE) == VMTEST_BASE) {
+        for (addr = VMTEST_BASE; addr < VMTEST_BASE + VMTEST_SIZE; addr += VMTEST_STRIDE) {
+            *(volatile unsigned int *)addr = addr;
+            touched++;
+        }
+        rss = mm->rss;
+        do_unmap(VMTEST_BASE, VMTEST_SIZE);
+        kernel_printf("vma %d pages, %d touched, %d resident, %d after unmap\n", VMTEST_SIZE >> PAGE_SHIFT, touched,
+                      rss, mm->rss);
+    } else
+        ret = 1;
+
+    current_task->mm = old;
+    activate_mm(current_task);
+    enable_interrupts();
+    mm_delete(mm);
+    return ret;
+}
+
+// Compare fork-and-exit latency with copy-on-write and with an eager copy
+int forkbench(char *param) {
+    struct mm_struct *parent, *child, *old;
+    unsigned int n = 0, i, t0, ret = 0;
+    unsigned int cow = 0, refault = 0, eager = 0;
+
+    while (*param >= '0' && *param <= '9')
+        n = n * 10 + *param++ - '0';
+    if (n == 0)
+        n = FORKBENCH_PAGES;
+    if (n > FORKBENCH_MAX)
+        n = FORKBENCH_MAX;
+    parent = mm_create();
+    if (parent == 0)
+        return 1;
+
+    disable_interrupts();
+    old = current_task->mm;
+    current_task->mm = parent;
+    activate_mm(current_task);
+    if (do_mmap(FORKBENCH_BASE, n * PAGE_SIZE, VM_READ | VM_WRITE) != FORKBENCH_BASE) {
+        ret = 1;
+        goto out;
+    }
+    for (i = 0; i < n; i++)
+        *(volatile unsigned int *)(FORKBENCH_BASE + i * PAGE_SIZE) = i;
+
+    t0 = get_cycles();
+    child = dup_mm(parent, 0);
+    if (child == 0) {
+        ret = 1;
+        goto out;
+    }
+    mm_delete(child);
+    cow = get_cycles() - t0;
+    // the parent then takes one write fault per page to make it writable again
+    t0 = get_cycles();
+    for (i = 0; i < n; i++)
+        *(volatile unsigned int *)(FORKBENCH_BASE + i * PAGE_SIZE) = i + 1;
+    refault = get_cycles() - t0;
+
+    t0 = get_cycles();
+    child = dup_mm(parent, 1);
+    if (child == 0) {
+        ret = 1;
+        goto out;
+    }
+    mm_delete(child);
+    eager = get_cycles() - t0;
+
+    // a write in the child must not show in the parent
+    child = dup_mm(parent, 0);
+    if (child == 0) {
+        ret = 1;
+        goto out;
+    }
+    current_task->mm = child;
+    activate_mm(current_task);
+    *(volatile unsigned int *)FORKBENCH_BASE = 0xdead;
+    current_task->mm = parent;
+    activate_mm(current_task);
+    if (*(volatile unsigned int *)FORKBENCH_BASE != 1) {
+        kernel_printf("forkbench: child write reached the parent\n");
+        ret = 1;
+    }
+    mm_delete(child);
+
+out:
+    current_task->mm = old;
+    activate_mm(current_task);
+    enable_interrupts();
+    mm_delete(parent);
+    if (ret == 0)
+        kernel_printf("%d pages: fork+exit cow %dus (parent refaults %dus), copy %dus\n", n, cow / CYCLES_PER_US,
+                      refault / CYCLES_PER_US, eager / CYCLES_PER_US);
+    return ret;
+}
+
+// One hugebench pass set over a scratch address space mapped with flags
+static int hugebench_run(unsigned int len, unsigned int flags, unsigned int *misses, unsigned int *cycles) {
+    struct mm_struct *mm, *old;
+    unsigned int addr, r, t0, m0;
+    volatile unsigned int sum = 0;
+    int ret = 0;
+
+    mm = mm_create();
+    if (mm == 0)
+        return 1;
+    disable_interrupts();
+    old = current_task->mm;
+    current_task->mm = mm;
+    activate_mm(current_task);
+
+    if (do_mmap(HUGEBENCH_BASE, len, VM_READ | VM_WRITE | flags) == HUGEBENCH_BASE) {
+        // fault the buffer in before timing
+        for (addr = HUGEBENCH_BASE; addr < HUGEBENCH_BASE + len; addr += PAGE_SIZE)
+            *(volatile unsigned int *)addr = addr;
+        m0 = tlb_refills;
+        t0 = get_cycles();
+        for (r = 0; r < HUGEBENCH_ROUNDS; r++) {
+            for (addr = HUGEBENCH_BASE; addr < HUGEBENCH_BASE + len; addr += HUGEBENCH_STRIDE)
+                sum += *(volatile unsigned int *)addr;
+        }
+        *cycles = (get_cycles() - t0) / HUGEBENCH_ROUNDS;
+        *misses = (tlb_refills - m0) / HUGEBENCH_ROUNDS;
+    } else
+        ret = 1;
+
+    current_task->mm = old;
+    activate_mm(current_task);
+    enable_interrupts();
+    mm_delete(mm);
+    return ret;
+}
+
+// Compare TLB misses of a sequential scan with 4KB and with large pages
+int hugebench(char *param) {
+    unsigned int n = 0, len;
+    unsigned int small_misses, small_cycles, huge_misses, huge_cycles;
+
+    while (*param >= '0' && *param <= '9')
+        n = n * 10 + *param++ - '0';
+    if (n == 0)
+        n = HUGEBENCH_MB;
+    if (n > HUGEBENCH_MAX_MB)
+        n = HUGEBENCH_MAX_MB;
+    len = n << 20;
+
+    if (hugebench_run(len, 0, &small_misses, &small_cycles))
+        return 1;
+    if (hugebench_run(len, VM_HUGEPAGE, &huge_misses, &huge_cycles))
+        return 1;
+    kernel_printf("%dMB, per pass: 4KB pages %d misses %dus, %dKB pages %d misses %dus\n", n, small_misses,
+                  small_cycles / CYCLES_PER_US, 4 << HPAGE_MAX_ORDER, huge_misses, huge_cycles / CYCLES_PER_US);
+    if (huge_misses)
+        kernel_printf("misses reduced %d times\n", small_misses / huge_misses);
+    return 0;
+}
+
+// One pass over the file as copied by fat32_read() into buf
+static unsigned int filebench_read(MY_FILE *file, u8 *buf, unsigned int size) {
+    unsigned int pos, n, i, sum = 0;
+
+    fat32_lseek(file, 0);
+    for (pos = 0; pos < size; pos += n) {
+        n = size - pos < FILEBENCH_CHUNK ? size - pos : FILEBENCH_CHUNK;
+        fat32_read(file, buf, n);
+        for (i = 0; i + 4 <= n; i += 4)
+            sum += *(unsigned int *)(buf + i);
+    }
+    return sum;
+}
+
+// One pass over the file mapped at addr
+static unsigned int filebench_map(unsigned int addr, unsigned int size) {
+    unsigned int i, sum = 0;
+
+    for (i = 0; i + 4 <= size; i += 4)
+        sum += *(volatile unsigned int *)(addr + i);
+    return sum;
+}
+
+// Compare reading a file through fat32_read() with reading its mapping
+int filebench(char *param) {
+    MY_FILE file;
+    struct mm_struct *mm, *old;
+    unsigned int size, t0, read_sum, map_sum = 0;
+    unsigned int read_cold, read_warm, map_cold = 0, map_warm = 0;
+    u8 *buf;
+    int ret = 0;
+
+    if (fat32_open(&file, (u8 *)param) != 0) {
+        kernel_printf("cannot open %s\n", param);
+        return 1;
+    }
+    size = get_file_size(&file);
+    if (size == 0) {
+        kernel_printf("%s is empty\n", param);
+        return 1;
+    }
+    buf = (u8 *)kmalloc(FILEBENCH_CHUNK);
+    if (buf == 0)
+        return 1;
+    mm = mm_create();
+    if (mm == 0) {
+        kfree(buf);
+        return 1;
+    }
+
+    t0 = get_cycles();
+    read_sum = filebench_read(&file, buf, size);
+    read_cold = get_cycles() - t0;
+    t0 = get_cycles();
+    filebench_read(&file, buf, size);
+    read_warm = get_cycles() - t0;
+
+    disable_interrupts();
+    old = current_task->mm;
+    current_task->mm = mm;
+    activate_mm(current_task);
+    // faults on the mapping may sleep on the page cache
+    enable_interrupts();
+    if (do_mmap_file(&file, FILEBENCH_BASE, size, VM_READ, 0) == FILEBENCH_BASE) {
+        t0 = get_cycles();
+        map_sum = filebench_map(FILEBENCH_BASE, size);
+        map_cold = get_cycles() - t0;
+        t0 = get_cycles();
+        filebench_map(FILEBENCH_BASE, size);
+        map_warm = get_cycles() - t0;
+        do_unmap(FILEBENCH_BASE, size);
+    } else
+        ret = 1;
+
+    disable_interrupts();
+    current_task->mm = old;
+    activate_mm(current_task);
+    enable_interrupts();
+    mm_delete(mm);
+    kfree(buf);
+    fat32_close(&file);
+    if (ret == 0)
+        kernel_printf("%d bytes: fat32_read %dus then %dus, mmap %dus then %dus, sums %s\n", size,
+                      read_cold / CYCLES_PER_US, read_warm / CYCLES_PER_US, map_cold / CYCLES_PER_US,
+                      map_warm / CYCLES_PER_US, read_sum == map_sum ? "match" : "differ");
+    return ret;
+}
+
 void ps() {
     kernel_printf("Press any key to enter shell.\n");
     kernel_getchar();
@@ -100,6 +704,7 @@ void ps() {
             if (ps_buffer_index < 63) {
                 ps_buffer[ps_buffer_index++] = c;
                 kernel_putchar(c, 0xfff, 0);
+                key_lat_record();
             }
         }
     }
@@ -159,19 +764,55 @@ void parse_cmd() {
         testMem();
         kernel_printf("Memory test return with 0\n");
     } else if (kernel_strcmp(ps_buffer, "vm") == 0) {
-        struct mm_struct* mm = mm_create();
-        kernel_printf("Create succeed. %x\n", mm);
-        mm_delete(mm);   
+        result = vmtest();
+        kernel_printf("vm return with %d\n", result);
     }else if (kernel_strcmp(ps_buffer, "ps") == 0) {
-        
-        disable_interrupts();
-
         result = print_proc();
-
-        enable_interrupts();
         kernel_printf("ps return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "top") == 0) {
+        result = top();
+        kernel_printf("top return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "keylat") == 0) {
+        result = keylat();
+    } else if (kernel_strcmp(ps_buffer, "schedlat") == 0) {
+        result = schedlat();
+    } else if (kernel_strcmp(ps_buffer, "cotest") == 0) {
+        result = cotest(param);
+        kernel_printf("cotest return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "pitrace") == 0) {
+        print_pi_trace();
+    } else if (kernel_strcmp(ps_buffer, "lockstat") == 0) {
+        print_lock_stat();
+    } else if (kernel_strcmp(ps_buffer, "tlbstat") == 0) {
+        if (kernel_strcmp(param, "reset") == 0)
+            reset_tlb_stat();
+        else
+            print_tlb_stat();
+    } else if (kernel_strcmp(ps_buffer, "irqsoff") == 0) {
+        if (kernel_strcmp(param, "reset") == 0)
+            reset_irqsoff();
+        else
+            print_irqsoff();
+    } else if (kernel_strcmp(ps_buffer, "yieldbench") == 0) {
+        result = yieldbench(param);
+        kernel_printf("yieldbench return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "forkbench") == 0) {
+        result = forkbench(param);
+        kernel_printf("forkbench return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "hugebench") == 0) {
+        result = hugebench(param);
+        kernel_printf("hugebench return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "filebench") == 0) {
+        result = filebench(param);
+        kernel_printf("filebench return with %d\n", result);
+    } else if (kernel_strcmp(ps_buffer, "tlbbench") == 0) {
+        result = tlbbench(param);
+        kernel_printf("tlbbench return with %d\n", result);
     } else if (kernel_strcmp(ps_buffer, "kill") == 0) {
-        int pid = param[0] - '0';
+        int pid = 0;
+        char *digit = param;
+        while (*digit >= '0' && *digit <= '9')
+            pid = pid * 10 + *digit++ - '0';
         kernel_printf("Killing process %d\n", pid);
         result = pc_kill(pid);
         kernel_printf("kill return with %d\n", result);
@@ -1,5 +1,21 @@
 #ifndef _PS_H
 #define _PS_H
+
+// Shell runs as a round-robin real-time task so typing stays responsive under load
+#define SHELL_RT_PRIORITY 16
+
 void ps();
 void parse_cmd();
+int top();
+void key_lat_record();
+int keylat();
+int schedlat();
+void yield_thread(void *arg);
+int yieldbench(char *param);
+int cotest(char *param);
+int tlbbench(char *param);
+int vmtest();
+int forkbench(char *param);
+int hugebench(char *param);
+int filebench(char *param);
 #endif
@@ -0,0 +1,85 @@
+#include <zjunix/ring.h>
+#include <zjunix/utils.h>
+
+// Orders element copies against the index store that publishes or releases
+// them; enough on this single CPU, where an interrupt sees program order
+#define ring_barrier() asm volatile("" : : : "memory")
+
+// Return 0, or -1 if size is not a power of two
+int init_ring(struct ring *r, void *data, unsigned int esize, unsigned int size) {
+    if (size == 0 || (size & (size - 1)) != 0)
+        return -1;
+    r->data = data;
+    r->mask = size - 1;
+    r->esize = esize;
+    r->head = 0;
+    r->tail = 0;
+    r->dropped = 0;
+    r->high_water = 0;
+    return 0;
+}
+
+// Copy n elements between the ring slot at index and buf; word elements
+// skip the byte loop in kernel_memcpy()
+static void ring_copy(struct ring *r, unsigned int index, void *buf, unsigned int n, int to_ring) {
+    char *slot = (char *)r->data + (index & r->mask) * r->esize;
+    unsigned int *src, *dst;
+
+    if (r->esize == sizeof(unsigned int)) {
+        src = to_ring ? (unsigned int *)buf : (unsigned int *)slot;
+        dst = to_ring ? (unsigned int *)slot : (unsigned int *)buf;
+        while (n--)
+            *dst++ = *src++;
+    } else if (to_ring)
+        kernel_memcpy(slot, buf, n * r->esize);
+    else
+        kernel_memcpy(buf, slot, n * r->esize);
+}
+
+// Queue up to n elements, return how many fit; the rest count as dropped
+unsigned int ring_push_n(struct ring *r, const void *elems, unsigned int n) {
+    unsigned int head = r->head;
+    unsigned int space = r->mask + 1 - (head - r->tail);
+    unsigned int first;
+
+    if (n > space) {
+        r->dropped += n - space;
+        n = space;
+    }
+    if (n == 0)
+        return 0;
+    // Up to the end of the array, then from its start
+    first = r->mask + 1 - (head & r->mask);
+    if (first > n)
+        first = n;
+    ring_copy(r, head, (void *)elems, first, 1);
+    if (n > first)
+        ring_copy(r, head + first, (char *)elems + first * r->esize, n - first, 1);
+    ring_barrier();
+    r->head = head + n;
+    if (head + n - r->tail > r->high_water)
+        r->high_water = head + n - r->tail;
+    return n;
+}
+
+// Dequeue up to n elements, return how many were available
+unsigned int ring_pop_n(struct ring *r, void *elems, unsigned int n) {
+    unsigned int tail = r->tail;
+    unsigned int count = r->head - tail;
+    unsigned int first;
+
+    if (n > count)
+        n = count;
+    if (n == 0)
+        return 0;
+    ring_barrier();
+    first = r->mask + 1 - (tail & r->mask);
+    if (first > n)
+        first = n;
+    ring_copy(r, tail, elems, first, 0);
+    if (n > first)
+        ring_copy(r, tail + first, (char *)elems + first * r->esize, n - first, 0);
+    ring_barrier();
+    r->tail = tail + n;
+    return n;
+}